@@ -0,0 +1,96 @@
+#include <pebble.h>
+#include <string.h>
+
+#include "glance.h"
+
+#define GLANCE_WAKEUP_COOKIE 0x676c
+// Persist key of the refresh setting, kept clear of the other modules' keys
+#define GLANCE_REFRESH_KEY 80
+
+#if PBL_API_EXISTS(app_glance_reload)
+
+static char s_subtitle[GLANCE_SUBTITLE_MAX + 1];
+
+static void prv_reload(AppGlanceReloadSession *session, size_t limit, void *context) {
+  if (limit < 1) return;
+  const AppGlanceSlice slice = {
+    .layout = {
+      .icon = APP_GLANCE_SLICE_DEFAULT_ICON,
+      .subtitle_template_string = s_subtitle,
+    },
+    .expiration_time = APP_GLANCE_SLICE_NO_EXPIRATION,
+  };
+  AppGlanceResult result = app_glance_add_slice(session, slice);
+  if (result != APP_GLANCE_RESULT_SUCCESS) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to publish the glance: %d", (int)result);
+  }
+}
+
+// Append `text` to the subtitle as far as it fits, without splitting a UTF-8
+// character. Braces would start a template, they become parentheses.
+static void prv_append(size_t pos, const char *text) {
+  size_t length = strlen(text);
+  if (pos + length > GLANCE_SUBTITLE_MAX) {
+    length = GLANCE_SUBTITLE_MAX - pos;
+    while (length > 0 && (text[length] & 0xC0) == 0x80) length--;
+  }
+  for (size_t i = 0; i < length; i++) {
+    char c = text[i];
+    s_subtitle[pos + i] = c == '{' ? '(' : c == '}' ? ')' : c;
+  }
+  s_subtitle[pos + length] = '\0';
+}
+
+void glance_publish(int open_count, const char *next) {
+  if (open_count == 0) {
+    strcpy(s_subtitle, "All done!");
+  } else if (!next || next[0] == '\0') {
+    snprintf(s_subtitle, sizeof(s_subtitle), "%d open", open_count);
+  } else {
+    int pos = snprintf(s_subtitle, sizeof(s_subtitle), "%d open: ", open_count);
+    prv_append(pos, next);
+  }
+  app_glance_reload(prv_reload, NULL);
+}
+
+void glance_set_refresh_enabled(bool enabled) {
+  persist_write_int(GLANCE_REFRESH_KEY, enabled ? 1 : 0);
+  if (!enabled) glance_cancel_refresh();
+}
+
+void glance_schedule_refresh(void) {
+  wakeup_cancel_all();
+  if (persist_read_int(GLANCE_REFRESH_KEY) == 0) return;
+  WakeupId id = wakeup_schedule(time(NULL) + GLANCE_REFRESH_INTERVAL_S, GLANCE_WAKEUP_COOKIE, false);
+  if (id < 0) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Failed to schedule the refresh: %d", (int)id);
+  }
+}
+
+void glance_cancel_refresh(void) {
+  wakeup_cancel_all();
+}
+
+bool glance_refresh_launch(void) {
+  WakeupId id;
+  int32_t cookie;
+  return launch_reason() == APP_LAUNCH_WAKEUP
+    && wakeup_get_launch_event(&id, &cookie)
+    && cookie == GLANCE_WAKEUP_COOKIE;
+}
+
+#else
+
+void glance_publish(int open_count, const char *next) {}
+
+void glance_set_refresh_enabled(bool enabled) {}
+
+void glance_schedule_refresh(void) {}
+
+void glance_cancel_refresh(void) {}
+
+bool glance_refresh_launch(void) {
+  return false;
+}
+
+#endif
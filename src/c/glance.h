@@ -0,0 +1,39 @@
+#pragma once
+
+#include <pebble.h>
+
+// The App Glance shown in the launcher and the scheduled refresh behind it.
+//
+// When the app exits with a task list that changed, main.c publishes how many
+// of its items are open and the first of them, so checking the list does not
+// need the app to be opened. If the user turned the refresh on in the settings
+// (CONFIG_GLANCE_REFRESH), a wakeup is scheduled GLANCE_REFRESH_INTERVAL_S
+// after the app closes; the app it launches fetches the list from the phone,
+// which publishes the glance and refreshes the cached list, and quits again
+// by itself. A background worker cannot reach the phone, so the refresh has
+// to be done by the app.
+//
+// Platforms without glances (aplite) publish nothing and schedule no wakeups.
+
+#define GLANCE_REFRESH_INTERVAL_S (2 * 60 * 60)
+
+// Longest subtitle the glance shows, without the terminator
+#define GLANCE_SUBTITLE_MAX 80
+
+// Publish `open_count` open items, the first of them being `next` (NULL or
+// empty if it is not in memory).
+void glance_publish(int open_count, const char *next);
+
+// Turn the scheduled refresh on or off. The setting is kept in persistent
+// storage and is off until the phone says otherwise.
+void glance_set_refresh_enabled(bool enabled);
+
+// Schedule the next refresh if it is turned on, replacing one scheduled
+// before.
+void glance_schedule_refresh(void);
+
+// Cancel a scheduled refresh.
+void glance_cancel_refresh(void);
+
+// True if the app was launched by the refresh wakeup.
+bool glance_refresh_launch(void);
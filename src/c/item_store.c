@@ -0,0 +1,538 @@
+#include <pebble.h>
+#include <string.h>
+
+#include "item_store.h"
+
+#define NO_PAGE 0xFFFF
+#define NO_SLOT (-1)
+
+// Titles are stored NUL-terminated in the list's title pool, sections only
+// keep where
+typedef struct {
+  uint16_t title_offset;
+  uint16_t item_count;
+  uint16_t first_item;
+  uint8_t  title_length;
+} MenuSection;
+
+// Bookkeeping for one resident page
+typedef struct {
+  uint16_t page;
+  uint16_t pool_used;
+} PageSlot;
+
+// Everything about one list. All arrays point into `memory`.
+typedef struct {
+  uint8_t     *memory;
+  MenuSection *sections;
+  int          num_sections;
+  char        *titles;
+  size_t       titles_size;
+  size_t       titles_used;
+  int          num_items;
+  int          num_pages;
+  // Page number -> slot holding it, or NO_SLOT
+  int8_t      *page_slots;
+  PageSlot    *slots;
+  int          num_slots;
+  TodoItem    *items;
+  char        *pools;
+  size_t       pool_size;
+  // Label dictionary, see item_store.h
+  uint8_t     *dictionary;
+  size_t       dictionary_length;
+  int          loaded;
+  int          dropped;
+  size_t       size;
+} Store;
+
+static Store s_store;
+// The previous list while a new one is built from it
+static Store s_old;
+static int   s_focus_page = 0;
+
+static size_t prv_align(size_t size) {
+  return (size + 3) & ~(size_t)3;
+}
+
+// Heap a new list may take while `held` bytes of the heap belong to lists
+// that it replaces.
+static size_t prv_heap_available(size_t held) {
+  size_t free_bytes = heap_bytes_free() + held;
+  if (free_bytes <= ITEM_STORE_HEAP_RESERVE) return 0;
+  free_bytes -= ITEM_STORE_HEAP_RESERVE;
+  return free_bytes < ITEM_STORE_HEAP_BUDGET ? free_bytes : ITEM_STORE_HEAP_BUDGET;
+}
+
+// Heap the parts of a full window other than the labels take.
+static size_t prv_window_size(int num_slots) {
+  return prv_align(num_slots * sizeof(PageSlot)) + num_slots * ITEM_STORE_PAGE_SIZE * sizeof(TodoItem);
+}
+
+static bool prv_store_init(Store *store, int num_items, int num_sections, int title_bytes,
+                           int page_bytes, const uint8_t *dictionary, size_t dictionary_length) {
+  memset(store, 0, sizeof(*store));
+  if (num_items < 0) num_items = 0;
+  if (num_sections < 0) num_sections = 0;
+  if (title_bytes < 0) title_bytes = 0;
+  if (page_bytes < 0) page_bytes = 0;
+  if (!dictionary || dictionary_length > ITEM_STORE_DICT_MAX_BYTES) dictionary_length = 0;
+
+  int num_pages = (num_items + ITEM_STORE_PAGE_SIZE - 1) / ITEM_STORE_PAGE_SIZE;
+  int num_slots = num_pages < ITEM_STORE_WINDOW_PAGES ? num_pages : ITEM_STORE_WINDOW_PAGES;
+
+  size_t sections_size = prv_align(num_sections * sizeof(MenuSection));
+  // One NUL terminator per title, offsets are 16 bit
+  size_t titles_size = num_sections > 0 ? (size_t)title_bytes + num_sections : 0;
+  if (titles_size > UINT16_MAX) titles_size = UINT16_MAX;
+  titles_size = prv_align(titles_size);
+  size_t page_table_size = prv_align(num_pages * sizeof(int8_t));
+  size_t slots_size = prv_align(num_slots * sizeof(PageSlot));
+  size_t items_size = num_slots * ITEM_STORE_PAGE_SIZE * sizeof(TodoItem);
+  size_t dictionary_size = prv_align(dictionary_length);
+  size_t fixed = sections_size + titles_size + page_table_size + slots_size + items_size +
+                 dictionary_size;
+
+  // A list being rebuilt or grown is still held, so only what is free counts
+  size_t available = prv_heap_available(0);
+  if (fixed + num_slots * ITEM_STORE_PAGE_SIZE > available) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "List of %d items in %d sections needs %d bytes, %d available",
+            num_items, num_sections, (int)(fixed + num_slots * ITEM_STORE_PAGE_SIZE), (int)available);
+    return false;
+  }
+
+  // One NUL terminator per label, offsets are 16 bit, and all pools together
+  // have to stay within the platform budget and what the heap has left.
+  size_t pool_budget = available - fixed;
+  if (pool_budget > ITEM_STORE_POOL_BUDGET) pool_budget = ITEM_STORE_POOL_BUDGET;
+  size_t pool_size = (size_t)page_bytes + ITEM_STORE_PAGE_SIZE;
+  if (num_slots > 0 && pool_size > pool_budget / num_slots) {
+    pool_size = pool_budget / num_slots;
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Only %d of %d label bytes per page fit",
+            (int)pool_size, page_bytes + ITEM_STORE_PAGE_SIZE);
+  }
+  if (pool_size > UINT16_MAX) pool_size = UINT16_MAX;
+
+  size_t pools_size = num_slots * pool_size;
+  size_t total = fixed + pools_size;
+
+  if (total > 0) {
+    store->memory = calloc(1, total);
+    if (!store->memory) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to allocate %d bytes for items", (int)total);
+      return false;
+    }
+  }
+
+  uint8_t *cursor = store->memory;
+  store->sections = num_sections > 0 ? (MenuSection *)cursor : NULL;
+  cursor += sections_size;
+  store->titles = (char *)cursor;
+  cursor += titles_size;
+  store->page_slots = (int8_t *)cursor;
+  cursor += page_table_size;
+  store->slots = (PageSlot *)cursor;
+  cursor += slots_size;
+  store->items = (TodoItem *)cursor;
+  cursor += items_size;
+  store->dictionary = dictionary_length > 0 ? cursor : NULL;
+  cursor += dictionary_size;
+  store->pools = (char *)cursor;
+
+  store->num_sections = num_sections;
+  store->titles_size = titles_size;
+  store->num_items = num_items;
+  store->num_pages = num_pages;
+  store->num_slots = num_slots;
+  store->pool_size = pool_size;
+  store->dictionary_length = dictionary_length;
+  store->size = total;
+  if (dictionary_length > 0) memcpy(store->dictionary, dictionary, dictionary_length);
+  for (int i = 0; i < num_pages; i++) store->page_slots[i] = NO_SLOT;
+  for (int i = 0; i < num_slots; i++) store->slots[i].page = NO_PAGE;
+
+  APP_LOG(APP_LOG_LEVEL_INFO, "Item store: %d items, %d pages, %d slots of %d label bytes, "
+          "%d byte dictionary", num_items, num_pages, num_slots, (int)pool_size,
+          (int)dictionary_length);
+  return true;
+}
+
+static void prv_store_free(Store *store) {
+  free(store->memory);
+  memset(store, 0, sizeof(*store));
+}
+
+bool item_store_init(int num_items, int num_sections, int title_bytes, int page_bytes,
+                     const uint8_t *dictionary, size_t dictionary_length) {
+  item_store_deinit();
+  s_focus_page = 0;
+  return prv_store_init(&s_store, num_items, num_sections, title_bytes, page_bytes,
+                        dictionary, dictionary_length);
+}
+
+void item_store_deinit(void) {
+  prv_store_free(&s_store);
+  prv_store_free(&s_old);
+}
+
+int item_store_count(void) {
+  return s_store.num_items;
+}
+
+int item_store_section_count(void) {
+  return s_store.num_sections;
+}
+
+// Sections arrive in order, so recomputing the running offsets on every update
+// is cheap and keeps item_store_global_index() O(1).
+static void prv_update_section_offsets(void) {
+  int first = 0;
+  for (int i = 0; i < s_store.num_sections; i++) {
+    s_store.sections[i].first_item = first;
+    first += s_store.sections[i].item_count;
+  }
+}
+
+static TodoItem *prv_get(Store *store, int index) {
+  if (index < 0 || index >= store->num_items) return NULL;
+  int slot = store->page_slots[index / ITEM_STORE_PAGE_SIZE];
+  if (slot == NO_SLOT) return NULL;
+  return &store->items[slot * ITEM_STORE_PAGE_SIZE + index % ITEM_STORE_PAGE_SIZE];
+}
+
+static const char *prv_label(const Store *store, const TodoItem *item) {
+  if (!item || !(item->flags & ITEM_FLAG_LOADED)) return "";
+  int slot = (item - store->items) / ITEM_STORE_PAGE_SIZE;
+  return store->pools + slot * store->pool_size + item->label_offset;
+}
+
+static const char *prv_section_title(const Store *store, int section) {
+  if (!store->sections || section < 0 || section >= store->num_sections) return "";
+  const MenuSection *entry = &store->sections[section];
+  return entry->title_length > 0 ? store->titles + entry->title_offset : "";
+}
+
+static bool prv_rebuild(int num_items, int num_sections, int title_bytes, int page_bytes) {
+  prv_store_free(&s_old);
+  s_old = s_store;
+  // Titles carried over need their room whatever the caller asked for
+  if (title_bytes < (int)s_old.titles_used) title_bytes = s_old.titles_used;
+  // Labels copied from the old list stay encoded with its dictionary
+  if (!prv_store_init(&s_store, num_items, num_sections, title_bytes, page_bytes,
+                      s_old.dictionary, s_old.dictionary_length)) {
+    prv_store_free(&s_old);
+    return false;
+  }
+
+  // Sections keep their titles and counts until the caller changes them
+  int copied = s_old.num_sections < num_sections ? s_old.num_sections : num_sections;
+  for (int i = 0; i < copied; i++) {
+    const char *title = prv_section_title(&s_old, i);
+    item_store_set_section(i, title, s_old.sections[i].title_length, s_old.sections[i].item_count);
+  }
+  prv_update_section_offsets();
+  return true;
+}
+
+bool item_store_begin_rebuild(int num_items, int num_sections, int page_bytes) {
+  return prv_rebuild(num_items, num_sections, s_store.titles_used, page_bytes);
+}
+
+bool item_store_copy_from_old(int old_index, int index) {
+  const TodoItem *item = prv_get(&s_old, old_index);
+  if (!item || !(item->flags & ITEM_FLAG_LOADED)) return false;
+  if (!item_store_set(index, prv_label(&s_old, item), item->label_length, item->flags, item->id)) {
+    return false;
+  }
+  // Same label, so the measured line count still holds
+  prv_get(&s_store, index)->flags |= item->flags & ITEM_FLAG_LINES_MASK;
+  return true;
+}
+
+int item_store_old_id(int old_index) {
+  const TodoItem *item = prv_get(&s_old, old_index);
+  return item ? item->id : -1;
+}
+
+void item_store_end_rebuild(void) {
+  prv_store_free(&s_old);
+}
+
+bool item_store_grow(int num_items, int num_sections, int title_bytes, int page_bytes) {
+  if (num_items < s_store.num_items) num_items = s_store.num_items;
+  if (num_sections < s_store.num_sections) num_sections = s_store.num_sections;
+
+  if (!prv_rebuild(num_items, num_sections, title_bytes, page_bytes)) {
+    return false;
+  }
+  // Everything that was in memory stays where it was
+  for (int slot = 0; slot < s_old.num_slots; slot++) {
+    if (s_old.slots[slot].page == NO_PAGE) continue;
+    int first = s_old.slots[slot].page * ITEM_STORE_PAGE_SIZE;
+    for (int i = first; i < first + ITEM_STORE_PAGE_SIZE; i++) {
+      item_store_copy_from_old(i, i);
+    }
+  }
+  item_store_end_rebuild();
+  return true;
+}
+
+void item_store_set_section(int section, const char *title, size_t title_length, int item_count) {
+  if (!s_store.sections || section < 0 || section >= s_store.num_sections) return;
+  MenuSection *entry = &s_store.sections[section];
+  if (title_length > ITEM_STORE_SECTION_TITLE_MAX) title_length = ITEM_STORE_SECTION_TITLE_MAX;
+
+  // A title sent again keeps its place if it still fits there
+  if (title_length > entry->title_length) {
+    size_t available = s_store.titles_size - s_store.titles_used;
+    if (entry->title_length > 0 && title_length + 1 > available) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Title pool full, section %d keeps its length", section);
+      title_length = entry->title_length;
+    } else if (available == 0) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Title pool full, section %d without title", section);
+      title_length = 0;
+    } else {
+      if (title_length + 1 > available) {
+        APP_LOG(APP_LOG_LEVEL_WARNING, "Title pool full, truncating section %d", section);
+        title_length = available - 1;
+      }
+      entry->title_offset = s_store.titles_used;
+      s_store.titles_used += title_length + 1;
+    }
+  }
+  if (title_length > 0) {
+    memcpy(s_store.titles + entry->title_offset, title, title_length);
+    s_store.titles[entry->title_offset + title_length] = '\0';
+  }
+  entry->title_length = title_length;
+  entry->item_count = item_count > 0 ? item_count : 0;
+  prv_update_section_offsets();
+}
+
+void item_store_set_section_item_count(int section, int item_count) {
+  if (!s_store.sections || section < 0 || section >= s_store.num_sections) return;
+  s_store.sections[section].item_count = item_count > 0 ? item_count : 0;
+  prv_update_section_offsets();
+}
+
+const char *item_store_section_title(int section) {
+  return prv_section_title(&s_store, section);
+}
+
+int item_store_section_item_count(int section) {
+  if (!s_store.sections || section < 0 || section >= s_store.num_sections) return 0;
+  return s_store.sections[section].item_count;
+}
+
+int item_store_global_index(int section, int row) {
+  if (s_store.num_sections == 0) return row;
+  if (section < 0 || section >= s_store.num_sections) return -1;
+  return s_store.sections[section].first_item + row;
+}
+
+void item_store_position(int index, int *section, int *row) {
+  *section = 0;
+  *row = index;
+  for (int i = s_store.num_sections - 1; i >= 0; i--) {
+    if (s_store.sections[i].item_count > 0 && index >= s_store.sections[i].first_item) {
+      *section = i;
+      *row = index - s_store.sections[i].first_item;
+      return;
+    }
+  }
+}
+
+TodoItem *item_store_get(int index) {
+  return prv_get(&s_store, index);
+}
+
+const char *item_store_label(const TodoItem *item) {
+  return prv_label(&s_store, item);
+}
+
+// Entry `code` of the dictionary, NULL if there is none.
+static const uint8_t *prv_dictionary_entry(uint8_t code, size_t *length) {
+  const uint8_t *cursor = s_store.dictionary;
+  const uint8_t *end = cursor + s_store.dictionary_length;
+  for (int i = code - ITEM_STORE_DICT_FIRST_CODE; cursor < end; i--) {
+    if (cursor + 1 + *cursor > end) break;
+    if (i == 0) {
+      *length = *cursor;
+      return cursor + 1;
+    }
+    cursor += 1 + *cursor;
+  }
+  return NULL;
+}
+
+const char *item_store_text(const TodoItem *item, char *buffer, size_t size) {
+  const char *label = prv_label(&s_store, item);
+  if (s_store.dictionary_length == 0 || size == 0) return label;
+  size_t pos = 0;
+  for (const uint8_t *cursor = (const uint8_t *)label; *cursor; cursor++) {
+    if (*cursor > ITEM_STORE_DICT_LAST_CODE) {
+      if (pos + 1 >= size) break;
+      buffer[pos++] = *cursor;
+      continue;
+    }
+    size_t length = 0;
+    const uint8_t *entry = prv_dictionary_entry(*cursor, &length);
+    if (!entry) continue;
+    if (pos + length >= size) break;
+    memcpy(buffer + pos, entry, length);
+    pos += length;
+  }
+  buffer[pos] = '\0';
+  return buffer;
+}
+
+const uint8_t *item_store_dictionary(size_t *length) {
+  *length = s_store.dictionary_length;
+  return s_store.dictionary;
+}
+
+static int prv_page_distance(int page) {
+  return page > s_focus_page ? page - s_focus_page : s_focus_page - page;
+}
+
+static void prv_evict(int slot) {
+  TodoItem *items = &s_store.items[slot * ITEM_STORE_PAGE_SIZE];
+  for (int i = 0; i < ITEM_STORE_PAGE_SIZE; i++) {
+    if (items[i].flags & ITEM_FLAG_LOADED) s_store.loaded--;
+  }
+  memset(items, 0, ITEM_STORE_PAGE_SIZE * sizeof(TodoItem));
+  s_store.page_slots[s_store.slots[slot].page] = NO_SLOT;
+  s_store.slots[slot].page = NO_PAGE;
+  s_store.slots[slot].pool_used = 0;
+}
+
+// The slot a new page would go into: a free one, or the one holding the page
+// farthest away from the focus.
+static int prv_find_victim(void) {
+  int victim = NO_SLOT;
+  for (int i = 0; i < s_store.num_slots; i++) {
+    if (s_store.slots[i].page == NO_PAGE) return i;
+    if (victim == NO_SLOT
+        || prv_page_distance(s_store.slots[i].page) > prv_page_distance(s_store.slots[victim].page)) {
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+// A page only displaces a resident one that is farther away from the focus.
+static bool prv_page_wanted(int page) {
+  int victim = prv_find_victim();
+  if (victim == NO_SLOT) return false;
+  return s_store.slots[victim].page == NO_PAGE
+         || prv_page_distance(s_store.slots[victim].page) > prv_page_distance(page);
+}
+
+static int prv_claim_slot(int page) {
+  if (!prv_page_wanted(page)) return NO_SLOT;
+  int victim = prv_find_victim();
+  if (s_store.slots[victim].page != NO_PAGE) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Evicting page %d for page %d", s_store.slots[victim].page, page);
+    prv_evict(victim);
+  }
+  s_store.slots[victim].page = page;
+  s_store.page_slots[page] = victim;
+  return victim;
+}
+
+bool item_store_set(int index, const char *label, size_t length, uint8_t flags, uint16_t id) {
+  if (index < 0 || index >= s_store.num_items || !label) return false;
+  if (length > UINT8_MAX) length = UINT8_MAX;
+
+  int page = index / ITEM_STORE_PAGE_SIZE;
+  int slot = s_store.page_slots[page];
+  if (slot == NO_SLOT) {
+    slot = prv_claim_slot(page);
+    if (slot == NO_SLOT) return false;
+  }
+  PageSlot *page_slot = &s_store.slots[slot];
+  char *pool = s_store.pools + slot * s_store.pool_size;
+  TodoItem *item = &s_store.items[slot * ITEM_STORE_PAGE_SIZE + index % ITEM_STORE_PAGE_SIZE];
+
+  // A resent item keeps its place in the pool if the label still fits there
+  bool loaded = item->flags & ITEM_FLAG_LOADED;
+  if (!loaded || item->label_length < length) {
+    size_t available = s_store.pool_size - page_slot->pool_used;
+    if (loaded && length + 1 > available) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Label pool full, item %d keeps its length", index);
+      length = item->label_length;
+      s_store.dropped++;
+    } else if (available == 0) {
+      // The item is still shown, with an empty label sharing the terminator
+      // of the label before it
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Label pool full, item %d without label", index);
+      item->label_offset = page_slot->pool_used - 1;
+      length = 0;
+      s_store.dropped++;
+    } else {
+      if (length + 1 > available) {
+        APP_LOG(APP_LOG_LEVEL_WARNING, "Label pool full, truncating item %d", index);
+        length = available - 1;
+        s_store.dropped++;
+      }
+      item->label_offset = page_slot->pool_used;
+      page_slot->pool_used += length + 1;
+    }
+  }
+
+  memcpy(pool + item->label_offset, label, length);
+  pool[item->label_offset + length] = '\0';
+  item->label_length = length;
+  item->flags = ITEM_FLAG_LOADED | (flags & ITEM_FLAG_CHECKED);
+  item->id = id;
+  if (!loaded) s_store.loaded++;
+  return true;
+}
+
+int item_store_heap_budget(void) {
+  return prv_heap_available(s_store.size + s_old.size);
+}
+
+int item_store_pool_budget(void) {
+  size_t available = item_store_heap_budget();
+  size_t window = prv_window_size(ITEM_STORE_WINDOW_PAGES) + prv_align(ITEM_STORE_DICT_MAX_BYTES);
+  if (available <= window) return 0;
+  available -= window;
+  return available < ITEM_STORE_POOL_BUDGET ? (int)available : ITEM_STORE_POOL_BUDGET;
+}
+
+int item_store_dropped_count(void) {
+  return s_store.dropped;
+}
+
+int item_store_loaded_count(void) {
+  return s_store.loaded;
+}
+
+int item_store_capacity(void) {
+  int capacity = s_store.num_slots * ITEM_STORE_PAGE_SIZE;
+  return capacity < s_store.num_items ? capacity : s_store.num_items;
+}
+
+bool item_store_fully_resident(void) {
+  return s_store.loaded == s_store.num_items;
+}
+
+void item_store_set_focus(int index) {
+  if (index < 0) index = 0;
+  s_focus_page = index / ITEM_STORE_PAGE_SIZE;
+}
+
+int item_store_missing_page(void) {
+  // Look at the focus page first, then alternate outwards. Once a page would
+  // not be kept, nothing farther away would be either.
+  for (int distance = 0; distance < s_store.num_pages; distance++) {
+    int candidates[2] = { s_focus_page + distance, s_focus_page - distance };
+    for (int i = 0; i < (distance == 0 ? 1 : 2); i++) {
+      int page = candidates[i];
+      if (page < 0 || page >= s_store.num_pages || s_store.page_slots[page] != NO_SLOT) continue;
+      return prv_page_wanted(page) ? page : -1;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <pebble.h>
+
+// Storage for the checklist shown on the watch.
+//
+// Items are grouped into pages of ITEM_STORE_PAGE_SIZE. Only a window of
+// ITEM_STORE_WINDOW_PAGES pages around the current focus (the selected row)
+// is kept in memory; pages that scroll far away are evicted and requested
+// again from the phone when needed. Lists that fit into the window are simply
+// kept in full. Everything (sections and their titles, page table, items and
+// labels) lives in a single allocation made when a new list is announced.
+//
+// Labels may be stored in a compact encoding: the companion sends a small
+// dictionary of substrings common in the list along with it, and bytes
+// ITEM_STORE_DICT_FIRST_CODE to ITEM_STORE_DICT_LAST_CODE of a label stand
+// for its entries. Labels stay encoded in memory and are only expanded with
+// item_store_text() when drawn or measured. Lists without a dictionary store
+// their labels as they are.
+
+#define ITEM_STORE_PAGE_SIZE 32
+
+// Memory available for labels across all resident pages. The companion is
+// told about these limits and truncates labels so every page fits.
+//
+// The whole list (sections, page table, window and labels) may take at most
+// ITEM_STORE_HEAP_BUDGET bytes, and has to leave ITEM_STORE_HEAP_RESERVE
+// bytes of the heap free for the menu, AppMessage and everything else. If the
+// heap is tighter than that, labels get less room; a list whose sections and
+// page table alone do not fit is refused.
+#if defined(PBL_PLATFORM_APLITE)
+#define ITEM_STORE_WINDOW_PAGES 3
+#define ITEM_STORE_POOL_BUDGET  3072
+#define ITEM_STORE_HEAP_BUDGET  8192
+#define ITEM_STORE_HEAP_RESERVE 3072
+#else
+#define ITEM_STORE_WINDOW_PAGES 6
+#define ITEM_STORE_POOL_BUDGET  12288
+#define ITEM_STORE_HEAP_BUDGET  32768
+#define ITEM_STORE_HEAP_RESERVE 8192
+#endif
+
+// Dictionary entries are stored back to back, each as a uint8 length followed
+// by its bytes; entry i is written as code ITEM_STORE_DICT_FIRST_CODE + i.
+#define ITEM_STORE_DICT_FIRST_CODE 0x01
+#define ITEM_STORE_DICT_LAST_CODE  0x1F
+#define ITEM_STORE_DICT_MAX_BYTES  255
+// Longest label item_store_text() expands to, without the terminator
+#define ITEM_STORE_TEXT_MAX 255
+// Section titles are cut to this many bytes
+#define ITEM_STORE_SECTION_TITLE_MAX 63
+
+// Per-item flag bits. ITEM_FLAG_CHECKED is also used in ITEMS_BATCH records,
+// ITEM_FLAG_LOADED marks items whose label has arrived.
+#define ITEM_FLAG_CHECKED 0x01
+#define ITEM_FLAG_LOADED  0x80
+// Bits 1-3 cache how many lines the label wraps to on screen, 0 if it was not
+// measured yet. item_store_set() clears them, the UI fills them in.
+#define ITEM_FLAG_LINES_MASK  0x0E
+#define ITEM_FLAG_LINES_SHIFT 1
+
+// Labels are stored NUL-terminated in the label pool of their page, items
+// only keep where. `id` identifies the item towards the companion; it is the
+// item's index unless the list was changed by a diff since.
+typedef struct {
+  uint16_t label_offset;
+  uint16_t id;
+  uint8_t  label_length;
+  uint8_t  flags;
+} TodoItem;
+
+// Allocate storage for a list of `num_items` items in `num_sections` sections.
+// `title_bytes` is the length of all section titles together and `page_bytes`
+// the size of the largest page's labels, both as announced by the companion;
+// `dictionary` is the list's label dictionary or NULL. Any previous list is
+// freed. Returns false if the list does not fit the heap budget or allocation
+// failed.
+bool item_store_init(int num_items, int num_sections, int title_bytes, int page_bytes,
+                     const uint8_t *dictionary, size_t dictionary_length);
+
+// Replace the list by one with the given geometry, keeping the old one
+// readable for item_store_copy_from_old() until item_store_end_rebuild().
+// Section titles and counts and the dictionary carry over. Returns false if allocation failed, in
+// which case both lists are gone.
+bool item_store_begin_rebuild(int num_items, int num_sections, int page_bytes);
+
+// Copy item `old_index` of the old list to `index` of the new one.
+bool item_store_copy_from_old(int old_index, int index);
+
+// Id of item `old_index` of the old list, or -1 if it is not in memory.
+int item_store_old_id(int old_index);
+
+void item_store_end_rebuild(void);
+
+// Enlarge the current list to `num_items` items in `num_sections` sections,
+// keeping its sections and whatever pages are in memory. Used while a list
+// arrives section by section. Returns false if allocation failed, in which
+// case the list is gone.
+bool item_store_grow(int num_items, int num_sections, int title_bytes, int page_bytes);
+
+void item_store_deinit(void);
+
+int item_store_count(void);
+
+int item_store_section_count(void);
+
+// Titles that do not fit the room announced for them are cut short, to
+// nothing if need be.
+void item_store_set_section(int section, const char *title, size_t title_length, int item_count);
+
+void item_store_set_section_item_count(int section, int item_count);
+
+const char *item_store_section_title(int section);
+
+int item_store_section_item_count(int section);
+
+// Map a (section, row) position to the index of the item in the whole list.
+int item_store_global_index(int section, int row);
+
+// The reverse of item_store_global_index().
+void item_store_position(int index, int *section, int *row);
+
+// Returns the item at `index`, or NULL if its page is not in memory.
+TodoItem *item_store_get(int index);
+
+// The label as stored, which may be encoded.
+const char *item_store_label(const TodoItem *item);
+
+// The label as shown. Expanded into `buffer` of `size` bytes if the list has a
+// dictionary, otherwise the stored label itself.
+const char *item_store_text(const TodoItem *item, char *buffer, size_t size);
+
+// The current list's dictionary, NULL with `length` 0 if it has none.
+const uint8_t *item_store_dictionary(size_t *length);
+
+// Store an item's label and flags, making room for its page if necessary.
+// Labels that do not fit their page's pool are cut short, to nothing if need
+// be. Returns false if the item was dropped because its page is not wanted.
+bool item_store_set(int index, const char *label, size_t length, uint8_t flags, uint16_t id);
+
+// Heap a list announced now could take, counting the current list as free.
+int item_store_heap_budget(void);
+
+// Label bytes all resident pages of a list announced now could share: the
+// platform's ITEM_STORE_POOL_BUDGET, or less if the heap budget is smaller.
+// Room for a dictionary is kept aside.
+int item_store_pool_budget(void);
+
+// Items of the current list that were cut short or dropped because their
+// page's labels did not fit.
+int item_store_dropped_count(void);
+
+// Number of items whose labels are currently in memory.
+int item_store_loaded_count(void);
+
+// Number of items the window can hold at once.
+int item_store_capacity(void);
+
+// True if every page of the list is in memory.
+bool item_store_fully_resident(void);
+
+// Tell the store which item is selected, so eviction keeps its neighbours.
+void item_store_set_focus(int index);
+
+// The closest page to the focus that should be in memory but is not, or -1.
+int item_store_missing_page(void);
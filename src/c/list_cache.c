@@ -0,0 +1,97 @@
+#include <pebble.h>
+#include <string.h>
+
+#include "list_cache.h"
+
+// Persist keys: one header, followed by the data chunks.
+#define LIST_CACHE_HEADER_KEY 100
+#define LIST_CACHE_CHUNK_KEY  101
+#define LIST_CACHE_VERSION    4
+
+typedef struct {
+  uint8_t  version;
+  uint8_t  num_chunks;
+  uint16_t length;
+  uint32_t hash;
+} ListCacheHeader;
+
+static bool prv_read_header(ListCacheHeader *header) {
+  if (persist_read_data(LIST_CACHE_HEADER_KEY, header, sizeof(*header)) != sizeof(*header)) {
+    return false;
+  }
+  return header->version == LIST_CACHE_VERSION && header->length <= LIST_CACHE_MAX_SIZE;
+}
+
+void list_cache_clear(void) {
+  ListCacheHeader header;
+  if (persist_read_data(LIST_CACHE_HEADER_KEY, &header, sizeof(header)) == sizeof(header)) {
+    for (int i = 0; i < header.num_chunks; i++) {
+      persist_delete(LIST_CACHE_CHUNK_KEY + i);
+    }
+  }
+  persist_delete(LIST_CACHE_HEADER_KEY);
+}
+
+bool list_cache_write(uint32_t hash, const uint8_t *data, size_t length) {
+  list_cache_clear();
+  if (length > LIST_CACHE_MAX_SIZE) {
+    APP_LOG(APP_LOG_LEVEL_INFO, "List of %d bytes is too large to cache", (int)length);
+    return false;
+  }
+
+  ListCacheHeader header = {
+    .version = LIST_CACHE_VERSION,
+    .num_chunks = (length + PERSIST_DATA_MAX_LENGTH - 1) / PERSIST_DATA_MAX_LENGTH,
+    .length = length,
+    .hash = hash,
+  };
+  for (int i = 0; i < header.num_chunks; i++) {
+    size_t offset = i * PERSIST_DATA_MAX_LENGTH;
+    size_t chunk = length - offset < PERSIST_DATA_MAX_LENGTH
+      ? length - offset
+      : PERSIST_DATA_MAX_LENGTH;
+    if (persist_write_data(LIST_CACHE_CHUNK_KEY + i, data + offset, chunk) != (int)chunk) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to write list cache chunk %d", i);
+      list_cache_clear();
+      return false;
+    }
+  }
+  // Write the header last so a partially written cache is never considered valid
+  persist_write_data(LIST_CACHE_HEADER_KEY, &header, sizeof(header));
+  APP_LOG(APP_LOG_LEVEL_INFO, "Cached list of %d bytes in %d chunks",
+          (int)length, header.num_chunks);
+  return true;
+}
+
+size_t list_cache_read(uint32_t *hash, uint8_t **data) {
+  ListCacheHeader header;
+  *data = NULL;
+  if (!prv_read_header(&header) || header.length == 0) return 0;
+
+  uint8_t *buffer = malloc(header.length);
+  if (!buffer) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to allocate %d bytes for the list cache",
+            (int)header.length);
+    return 0;
+  }
+  for (int i = 0; i < header.num_chunks; i++) {
+    size_t offset = i * PERSIST_DATA_MAX_LENGTH;
+    size_t chunk = header.length - offset < PERSIST_DATA_MAX_LENGTH
+      ? header.length - offset
+      : PERSIST_DATA_MAX_LENGTH;
+    if (persist_read_data(LIST_CACHE_CHUNK_KEY + i, buffer + offset, chunk) != (int)chunk) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "List cache chunk %d is missing", i);
+      free(buffer);
+      return 0;
+    }
+  }
+
+  *hash = header.hash;
+  *data = buffer;
+  return header.length;
+}
+
+uint32_t list_cache_hash(void) {
+  ListCacheHeader header;
+  return prv_read_header(&header) ? header.hash : 0;
+}
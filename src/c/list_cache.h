@@ -0,0 +1,22 @@
+#pragma once
+
+#include <pebble.h>
+
+// Largest serialized list that is kept in persistent storage. Pebble gives each
+// app 4 KB of persist storage in values of at most PERSIST_DATA_MAX_LENGTH
+// bytes, so the list is split into chunks across consecutive keys and some
+// room is left for other settings.
+#define LIST_CACHE_MAX_SIZE (12 * PERSIST_DATA_MAX_LENGTH)
+
+// Store a serialized list together with the hash the companion computed for it.
+// Returns false (and clears the cache) if the data does not fit.
+bool list_cache_write(uint32_t hash, const uint8_t *data, size_t length);
+
+// Read the cached list into a newly allocated buffer that the caller must free.
+// Returns the length of the data, or 0 if there is no valid cache.
+size_t list_cache_read(uint32_t *hash, uint8_t **data);
+
+// Hash of the cached list, or 0 if there is none.
+uint32_t list_cache_hash(void);
+
+void list_cache_clear(void);
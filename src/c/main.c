@@ -1,99 +1,318 @@
 #include <pebble.h>
 #include <string.h>
 
+#include "glance.h"
+#include "item_store.h"
+#include "list_cache.h"
 #include "message_keys.auto.h"
 #include "statusbar.h"
+#include "telemetry.h"
+#include "toggle_journal.h"
 
 #define CELL_HEIGHT 22
+// Labels wrap to at most ROW_MAX_LINES lines, every line after the first
+// makes the row ROW_LINE_HEIGHT taller.
+#define ROW_LINE_HEIGHT 18
+#define ROW_MAX_LINES 4
+#define ROW_FONT FONT_KEY_GOTHIC_18_BOLD
+#define ROW_SPACING 4
+
+// The inbox is opened as large as the platform allows so ITEMS_BATCH messages
+// can carry as many items as possible per round trip. Aplite has to keep most
+// of its small heap for the list itself.
+#if defined(PBL_PLATFORM_APLITE)
+#define INBOX_SIZE_LIMIT 2048
+#else
+#define INBOX_SIZE_LIMIT 8192
+#endif
+#define OUTBOX_SIZE 128
+// Toggles per ITEM_TOGGLES message, which has to fit OUTBOX_SIZE together
+// with the telemetry riding along
+#define TOGGLES_PER_MESSAGE 16
+// A toggle message that failed while connected goes out again after this
+#define TOGGLE_RETRY_MS 2000
+// Telemetry of a complete list goes out on its own after this long, unless a
+// toggle or page request took it along before
+#define TELEMETRY_SEND_DELAY_MS 1000
+
+// Hello retries back off exponentially from HELLO_RETRY_MS up to
+// HELLO_RETRY_MAX_MS, a busy outbox is tried again after HELLO_BUSY_RETRY_MS.
+#define HELLO_RETRY_MS 1000
+#define HELLO_RETRY_MAX_MS 8000
+#define HELLO_BUSY_RETRY_MS 100
+#define HELLO_MAX_ATTEMPTS 10
+
+// Label bytes assumed per item if the companion did not announce a page size,
+// and title bytes per section if it did not announce those
+#define DEFAULT_LABEL_BYTES 32
+#define DEFAULT_TITLE_BYTES 16
+
+// SET_PROGRESSING value while the phone sends a list, the progress bar then
+// fills up as the items arrive. Other non-zero values (downloading, uploading)
+// have no known end.
+#define PROGRESS_SENDING 3
+
+// A page request that was not answered in time may be sent again
+#define PAGE_REQUEST_TIMEOUT_MS 2000
+
+// An app launched to refresh the glance quits once the phone was quiet for
+// REFRESH_IDLE_MS, or REFRESH_START_MS at first while PebbleKit JS starts. A
+// phone still busy (downloading, sending) gets up to REFRESH_MAX_WAITS more.
+#define REFRESH_START_MS 15000
+#define REFRESH_IDLE_MS 3000
+#define REFRESH_MAX_WAITS 20
 
 static Window *s_window;
 static MenuLayer *s_menu_layer;
 static char s_menu_title[64] = "Checklist";
 
-typedef struct {
-  bool checked;
-  char *label;
-} TodoItem;
-
-typedef struct {
-  char title[64];
-  int  item_count;
-} MenuSection;
-
-static TodoItem   *s_items       = NULL;
-static int         s_num_items   = 0;
-static MenuSection *s_sections   = NULL;
-static int         s_num_sections = 0;
+static size_t s_heap_before_list = 0;
+// True once the first window of the current list has arrived and is shown. The
+// menu may be up before, as soon as the first screen of it arrived.
+static bool s_list_shown = false;
+// Page we asked the phone for and are still waiting on (-1 if none)
+static int s_requested_page = -1;
+static AppTimer *s_page_request_timer = NULL;
 static GRect s_menu_bounds;
 static GBitmap *s_checked_icon;
+static uint32_t s_inbox_size = 0;
+static int s_hello_attempts = 0;
+static AppTimer *s_hello_timer = NULL;
+// Companion-computed hash of the list on screen (0 if none), and whether that
+// list still has to be written to the persistent cache once it is complete.
+static uint32_t s_list_hash = 0;
+static bool s_list_needs_caching = false;
+// Items were toggled since the list was cached, it is saved again on exit so
+// toggles the phone has not seen yet still show after a restart
+static bool s_list_toggled = false;
+// The user was told that labels of the current list did not fit
+static bool s_drops_reported = false;
+// Label bytes per page the current list was announced with
+static int s_page_bytes = 0;
+// Transfer generation of the list being received, see prv_accept_generation()
+static uint16_t s_generation = 0;
+static AppTimer *s_toggle_timer = NULL;
+static AppTimer *s_telemetry_timer = NULL;
+// The user was told the toggles will be sent later
+static bool s_toggles_delayed = false;
+// The phone said it is sending a list
+static bool s_progress_sending = false;
+// Telemetry overlay, shown and hidden with a long press on the list
+static TextLayer *s_debug_layer = NULL;
+static char s_debug_text[224];
+// Scratch space a label is expanded into to be drawn or measured
+static char s_label_text[ITEM_STORE_TEXT_MAX + 1];
+// The list is a task list the phone wants on the app glance (LIST_GLANCE)
+static bool s_list_glance = false;
+// The list changed since the glance was published. The glance only shows once
+// the app is closed and every publish writes to flash, so it is published
+// when the app exits rather than on every change.
+static bool s_glance_dirty = false;
+// The phone said it is doing something (any non-zero SET_PROGRESSING)
+static bool s_phone_busy = false;
+// Runs while the app was launched by the glance refresh wakeup and quits by
+// itself, see prv_refresh_timer_fired()
+static AppTimer *s_refresh_timer = NULL;
+static int s_refresh_waits = 0;
+// The app was launched by the refresh and the user did not pick it up, and
+// the hash of the list it started with. A refresh that brings nothing new is
+// the last one until the app is opened again.
+static bool s_refresh_launch = false;
+static uint32_t s_refresh_hash = 0;
 
 static void complete_list_update();
+static bool prv_first_screen_loaded(void);
+static void prv_show_menu();
+
+// The menu's slide-in animation while it runs
+static PropertyAnimation *s_menu_anim = NULL;
 
-// Clean up PropertyAnimation when it finishes
+// Clean up PropertyAnimation when it finishes or is cancelled
 static void prv_property_animation_stopped(Animation *anim, bool finished,
                                            void *context) {
-  if (finished) {
-    property_animation_destroy((PropertyAnimation *)anim);
+  if (anim == (Animation *)s_menu_anim) s_menu_anim = NULL;
+  property_animation_destroy((PropertyAnimation *)anim);
+}
+
+static void prv_destroy_menu(void) {
+  if (!s_menu_layer) return;
+  // The slide-in animation must not outlive the layer it moves
+  if (s_menu_anim) animation_unschedule((Animation *)s_menu_anim);
+  layer_remove_from_parent(menu_layer_get_layer(s_menu_layer));
+  menu_layer_destroy(s_menu_layer);
+  s_menu_layer = NULL;
+}
+
+// The telemetry of the list shown last rides along with a toggle or page
+// request going out anyway, so it never keeps the outbox busy when one has to.
+static void prv_append_telemetry(DictionaryIterator *out_iter) {
+  if (!telemetry_pending()) return;
+  uint8_t blob[TELEMETRY_SIZE];
+  telemetry_serialize(blob);
+  dict_write_data(out_iter, MESSAGE_KEY_TELEMETRY, blob, sizeof(blob));
+}
+
+// If nothing took the telemetry along, it goes out by itself once the outbox
+// is free. Toggles waiting to go out still take it along.
+static void prv_send_telemetry(void) {
+  if (!telemetry_pending() || s_telemetry_timer) return;
+  if (toggle_journal_unsent() > 0 || !connection_service_peek_pebble_app_connection()) return;
+  DictionaryIterator *out_iter;
+  if (app_message_outbox_begin(&out_iter) != APP_MSG_OK || out_iter == NULL) {
+    // Outbox busy, try again from outbox_sent_handler
+    return;
   }
+  prv_append_telemetry(out_iter);
+  app_message_outbox_send();
+}
+
+static void prv_telemetry_timer_fired(void *data) {
+  s_telemetry_timer = NULL;
+  prv_send_telemetry();
+}
+
+// A list completed: give a toggle or page request a moment to take its
+// telemetry along, then send it.
+static void prv_schedule_telemetry(void) {
+  if (s_telemetry_timer) app_timer_cancel(s_telemetry_timer);
+  s_telemetry_timer = app_timer_register(TELEMETRY_SEND_DELAY_MS, prv_telemetry_timer_fired, NULL);
 }
 
-static bool prv_send_item_update(int index, bool checked) {
+static bool prv_item_checked(const TodoItem *item) {
+  return item->flags & ITEM_FLAG_CHECKED;
+}
+
+// Send what the toggle journal holds, unless a message of it is still on its
+// way. Items are identified towards the phone by their id, which stays valid
+// when a diff moves them around, and the hash of the list they were toggled
+// on, so the phone can tell entries of a list it no longer shows. A busy
+// outbox or a missing connection is no failure: the toggles go out once the
+// outbox is free (outbox_sent_handler()), or after the hello once the phone
+// is back.
+static void prv_send_toggles(void) {
+  if (toggle_journal_in_flight() || toggle_journal_unsent() == 0) return;
+  if (!connection_service_peek_pebble_app_connection()) return;
   DictionaryIterator *out_iter;
   AppMessageResult res = app_message_outbox_begin(&out_iter);
   if (res != APP_MSG_OK || out_iter == NULL) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to begin outbox: %d", (int)res);
-    return false;
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Outbox busy, toggles wait: %d", (int)res);
+    return;
   }
 
-  uint32_t key = checked ? MESSAGE_KEY_ITEM_CHECKED : MESSAGE_KEY_ITEM_UNCHECKED;
-  dict_write_int(out_iter, key, &index, sizeof(index), true);
+  uint8_t blob[TOGGLES_PER_MESSAGE * TOGGLE_JOURNAL_ENTRY_SIZE];
+  size_t length = toggle_journal_take(blob, TOGGLES_PER_MESSAGE);
+  dict_write_data(out_iter, MESSAGE_KEY_ITEM_TOGGLES, blob, length);
+  int32_t list_hash = (int32_t)toggle_journal_list_hash();
+  dict_write_int(out_iter, MESSAGE_KEY_TOGGLES_LIST_HASH, &list_hash, sizeof(list_hash), true);
+  prv_append_telemetry(out_iter);
   res = app_message_outbox_send();
   if (res != APP_MSG_OK) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to send action outbox: %d", (int)res);
-    status_bar_set_status("Failed to send!");
-    return false;
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to send toggles: %d", (int)res);
+    toggle_journal_failed();
   }
-  return true;
 }
 
+static void prv_toggle_timer_fired(void *data) {
+  s_toggle_timer = NULL;
+  prv_send_toggles();
+}
+
+// Position of the item the phone knows by `id`, or -1 if it is gone. Items
+// of pages that are not loaded have never been moved by a diff.
+static int prv_index_of_id(uint16_t id) {
+  for (int i = 0; i < item_store_count(); i++) {
+    TodoItem *item = item_store_get(i);
+    if (item ? item->id == id : i == id) return i;
+  }
+  return -1;
+}
+
+// --- Row heights ---
+//
+// Rows are as high as their wrapped label. Measuring text is slow, so every
+// label is measured once, when it arrives or when the checked icon changes
+// the width left for it, and the line count is kept in the item's flags.
+
+static int prv_label_x(const TodoItem *item) {
+  int x = ROW_SPACING;
+  if (prv_item_checked(item) && s_checked_icon) {
+    x += gbitmap_get_bounds(s_checked_icon).size.w + ROW_SPACING;
+  }
+  return x;
+}
+
+static int prv_measure_lines(TodoItem *item) {
+  int x = prv_label_x(item);
+  GSize size = graphics_text_layout_get_content_size(
+    item_store_text(item, s_label_text, sizeof(s_label_text)),
+    fonts_get_system_font(ROW_FONT),
+    GRect(0, 0, s_menu_bounds.size.w - x - ROW_SPACING, ROW_MAX_LINES * ROW_LINE_HEIGHT),
+    GTextOverflowModeWordWrap, GTextAlignmentLeft);
+  int lines = (size.h + ROW_LINE_HEIGHT - 1) / ROW_LINE_HEIGHT;
+  if (lines < 1) lines = 1;
+  if (lines > ROW_MAX_LINES) lines = ROW_MAX_LINES;
+  item->flags = (item->flags & ~ITEM_FLAG_LINES_MASK) | (lines << ITEM_FLAG_LINES_SHIFT);
+  return lines;
+}
+
+static int prv_item_height(TodoItem *item) {
+  if (!item || !(item->flags & ITEM_FLAG_LOADED)) return CELL_HEIGHT;
+  int lines = (item->flags & ITEM_FLAG_LINES_MASK) >> ITEM_FLAG_LINES_SHIFT;
+  if (lines == 0) lines = prv_measure_lines(item);
+  return CELL_HEIGHT + (lines - 1) * ROW_LINE_HEIGHT;
+}
+
+static int prv_row_height(int index) {
+  return prv_item_height(item_store_get(index));
+}
+
+static void prv_list_changed();
+static void prv_stop_refresh(void);
+
 static void prv_item_selected(int index, void *ctx) {
-  if (index < 0 || index >= s_num_items)
+  prv_stop_refresh();
+  TodoItem *item = item_store_get(index);
+  if (!item || !(item->flags & ITEM_FLAG_LOADED))
     return;
 
-  bool new_checked_state = !s_items[index].checked;
-  if (!prv_send_item_update(index, new_checked_state)) {
+  bool new_checked_state = !prv_item_checked(item);
+  if (!toggle_journal_record(item->id, new_checked_state)) {
+    status_bar_set_status("Too many changes!");
     return;
   }
 
-  s_items[index].checked = new_checked_state;
-  layer_mark_dirty(menu_layer_get_layer(s_menu_layer));
+  int old_height = prv_item_height(item);
+  item->flags ^= ITEM_FLAG_CHECKED;
+  s_list_toggled = true;
+  item->flags &= ~ITEM_FLAG_LINES_MASK;
+  if (prv_item_height(item) != old_height) {
+    prv_list_changed();
+  } else {
+    layer_mark_dirty(menu_layer_get_layer(s_menu_layer));
+  }
+  prv_send_toggles();
+  s_glance_dirty = true;
 }
 
 // --- MenuLayer callbacks ---
 
 static uint16_t prv_get_num_sections(MenuLayer *layer, void *ctx) {
-  return s_num_sections > 0 ? (uint16_t)s_num_sections : 1;
+  int num_sections = item_store_section_count();
+  return num_sections > 0 ? (uint16_t)num_sections : 1;
 }
 
 static uint16_t prv_get_num_rows(MenuLayer *layer, uint16_t section_index, void *ctx) {
-  if (s_num_sections == 0) return (uint16_t)s_num_items;
-  if (section_index >= (uint16_t)s_num_sections) return 0;
-  return (uint16_t)s_sections[section_index].item_count;
-}
-
-static int prv_global_index(uint16_t section, uint16_t row) {
-  int base = 0;
-  for (int i = 0; i < (int)section; i++) base += s_sections[i].item_count;
-  return base + (int)row;
+  if (item_store_section_count() == 0) return (uint16_t)item_store_count();
+  return (uint16_t)item_store_section_item_count(section_index);
 }
 
 static int16_t prv_cell_height(MenuLayer *layer, MenuIndex *idx, void *ctx) {
-  return CELL_HEIGHT;
+  return prv_row_height(item_store_global_index(idx->section, idx->row));
 }
 
 static int16_t prv_header_height(MenuLayer *layer, uint16_t section_index, void *ctx) {
-  if (s_num_sections > 0 && section_index < (uint16_t)s_num_sections
-      && s_sections[section_index].title[0] == '\0') {
+  if (item_store_section_count() > 0
+      && item_store_section_title(section_index)[0] == '\0') {
     return 0;
   }
   return MENU_CELL_BASIC_HEADER_HEIGHT;
@@ -101,8 +320,8 @@ static int16_t prv_header_height(MenuLayer *layer, uint16_t section_index, void
 
 static void prv_draw_header(GContext *ctx, const Layer *cell_layer,
                             uint16_t section_index, void *cb_ctx) {
-  const char *title = (s_num_sections > 0 && section_index < (uint16_t)s_num_sections)
-    ? s_sections[section_index].title
+  const char *title = item_store_section_count() > 0
+    ? item_store_section_title(section_index)
     : s_menu_title;
   if (title[0] == '\0') return;
 
@@ -118,111 +337,452 @@ static void prv_draw_header(GContext *ctx, const Layer *cell_layer,
 
 static void prv_draw_row(GContext *ctx, const Layer *cell_layer,
                          MenuIndex *idx, void *cb_ctx) {
-  int global = (s_num_sections > 0)
-    ? prv_global_index(idx->section, idx->row)
-    : (int)idx->row;
-  if (global < 0 || global >= s_num_items) return;
-  TodoItem *item = &s_items[global];
+  int global = item_store_global_index(idx->section, idx->row);
+  if (global < 0 || global >= item_store_count()) return;
+  TodoItem *item = item_store_get(global);
   GRect bounds = layer_get_bounds(cell_layer);
-  GFont font = fonts_get_system_font(FONT_KEY_GOTHIC_18_BOLD);
+  GFont font = fonts_get_system_font(ROW_FONT);
 
-  int horizontal_spacing = 4;
-  int x = horizontal_spacing;
-  if (item->checked && s_checked_icon) {
+  if (!item || !(item->flags & ITEM_FLAG_LOADED)) {
+    // Not arrived yet, or not in memory and requested from the phone
+    graphics_draw_text(ctx, "...", font,
+      GRect(4, -2, bounds.size.w - 8, bounds.size.h),
+      GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, NULL);
+    return;
+  }
+
+  if (prv_item_checked(item) && s_checked_icon) {
+    // Next to the first line
     GRect icon_bounds = gbitmap_get_bounds(s_checked_icon);
-    int icon_y = (bounds.size.h - icon_bounds.size.h) / 2;
+    int icon_y = (CELL_HEIGHT - icon_bounds.size.h) / 2;
     graphics_context_set_compositing_mode(ctx, GCompOpSet);
     graphics_draw_bitmap_in_rect(ctx, s_checked_icon,
-      GRect(x, icon_y, icon_bounds.size.w, icon_bounds.size.h));
-    x += icon_bounds.size.w + horizontal_spacing;
+      GRect(ROW_SPACING, icon_y, icon_bounds.size.w, icon_bounds.size.h));
   }
 
-  graphics_draw_text(ctx, item->label, font,
-    GRect(x, -2, bounds.size.w - x - horizontal_spacing, bounds.size.h),
+  // Labels longer than ROW_MAX_LINES end in an ellipsis
+  int x = prv_label_x(item);
+  graphics_draw_text(ctx, item_store_text(item, s_label_text, sizeof(s_label_text)), font,
+    GRect(x, -2, bounds.size.w - x - ROW_SPACING, bounds.size.h),
     GTextOverflowModeTrailingEllipsis,
     GTextAlignmentLeft,
     NULL);
 }
 
 static void prv_select_click(MenuLayer *layer, MenuIndex *idx, void *ctx) {
-  int global = (s_num_sections > 0)
-    ? prv_global_index(idx->section, idx->row)
-    : (int)idx->row;
-  prv_item_selected(global, ctx);
+  prv_item_selected(item_store_global_index(idx->section, idx->row), ctx);
+}
+
+static void prv_update_debug_overlay(void) {
+  if (!s_debug_layer) return;
+  telemetry_format(s_debug_text, sizeof(s_debug_text));
+  layer_mark_dirty(text_layer_get_layer(s_debug_layer));
+}
+
+static void prv_toggle_debug_overlay(void) {
+  if (s_debug_layer) {
+    text_layer_destroy(s_debug_layer);
+    s_debug_layer = NULL;
+    return;
+  }
+  s_debug_layer = text_layer_create(s_menu_bounds);
+  text_layer_set_font(s_debug_layer, fonts_get_system_font(FONT_KEY_GOTHIC_14));
+  text_layer_set_background_color(s_debug_layer, GColorBlack);
+  text_layer_set_text_color(s_debug_layer, GColorWhite);
+  text_layer_set_overflow_mode(s_debug_layer, GTextOverflowModeWordWrap);
+  text_layer_set_text(s_debug_layer, s_debug_text);
+  layer_add_child(window_get_root_layer(s_window), text_layer_get_layer(s_debug_layer));
+  prv_update_debug_overlay();
+}
+
+static void prv_select_long_click(MenuLayer *layer, MenuIndex *idx, void *ctx) {
+  prv_stop_refresh();
+  prv_toggle_debug_overlay();
+}
+
+static void prv_request_missing_page();
+
+static void prv_selection_changed(MenuLayer *layer, MenuIndex new_index,
+                                  MenuIndex old_index, void *ctx) {
+  item_store_set_focus(item_store_global_index(new_index.section, new_index.row));
+  prv_request_missing_page();
 }
 
 // ---------------------------
 
-static void dealloc_items() {
-  if (s_items) {
-    for (int i = 0; i < s_num_items; i++) {
-      free(s_items[i].label);
+// Allocate storage for a new list and throw away the old one. `dictionary`
+// is the LABEL_DICT the list came with, or NULL.
+static void update_count(int count, int num_sections, int title_bytes, int page_bytes,
+                         const uint8_t *dictionary, size_t dictionary_length) {
+  if (count < 0) count = 0;
+
+  prv_destroy_menu();
+  item_store_deinit();
+  s_list_shown = false;
+  s_list_toggled = false;
+  s_list_glance = false;
+  s_requested_page = -1;
+
+  s_heap_before_list = heap_bytes_used();
+  s_page_bytes = page_bytes;
+  s_drops_reported = false;
+  APP_LOG(APP_LOG_LEVEL_INFO, "Received count=%d sections=%d page_bytes=%d dictionary=%d",
+          count, num_sections, page_bytes, (int)dictionary_length);
+  if (!item_store_init(count, num_sections, title_bytes, page_bytes,
+                       dictionary, dictionary_length)) {
+    // Left empty, the phone should have capped the list to our budget
+    item_store_init(0, 0, 0, 0, NULL, 0);
+    status_bar_set_status("List too large!");
+  }
+}
+
+// A list arriving section by section grows in place: what is already on screen
+// stays there and the menu only gets longer.
+static void grow_count(int count, int num_sections, int title_bytes, int page_bytes) {
+  if (!item_store_grow(count, num_sections, title_bytes, page_bytes)) {
+    prv_destroy_menu();
+    s_list_shown = false;
+    status_bar_set_status("List too large!");
+    return;
+  }
+  s_requested_page = -1;
+  s_page_bytes = page_bytes;
+  APP_LOG(APP_LOG_LEVEL_INFO, "Grew list to count=%d sections=%d page_bytes=%d",
+          count, num_sections, page_bytes);
+}
+
+static void add_item(int index, const char *item_text, size_t length, bool checked) {
+  if (!item_text) return;
+  item_store_set(index, item_text, length, checked ? ITEM_FLAG_CHECKED : 0, index);
+}
+
+// Decode an ITEMS_BATCH blob straight into the item table.
+// Layout: uint16 first index (little endian), followed by one record per item:
+// uint8 flags, uint8 label length, label bytes (UTF-8, not NUL-terminated).
+// Returns the index one past the last decoded item.
+static int prv_receive_batch(const uint8_t *data, uint16_t length) {
+  if (length < 2) return -1;
+  int index = data[0] | (data[1] << 8);
+  const uint8_t *cursor = data + 2;
+  const uint8_t *end = data + length;
+
+  while (cursor + 2 <= end) {
+    uint8_t flags = cursor[0];
+    uint8_t label_length = cursor[1];
+    cursor += 2;
+    if (cursor + label_length > end) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Truncated batch record at index %d", index);
+      break;
     }
-    free(s_items);
-    s_items = NULL;
+    add_item(index, (const char *)cursor, label_length, flags & ITEM_FLAG_CHECKED);
+    cursor += label_length;
+    index++;
   }
-  s_num_items = 0;
+  return index;
+}
 
-  if (s_sections) {
-    free(s_sections);
-    s_sections = NULL;
+// Fletcher-16 over an ITEMS_BATCH blob, see prv_batch_intact().
+static uint16_t prv_batch_checksum(const uint8_t *data, uint16_t length) {
+  uint16_t sum1 = 0;
+  uint16_t sum2 = 0;
+  for (uint16_t i = 0; i < length; i++) {
+    sum1 = (sum1 + data[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
   }
-  s_num_sections = 0;
+  return (sum2 << 8) | sum1;
 }
 
-static void update_count(int count) {
-  if (count < 0) count = 0;
+// The BATCH_CHECK sent with a batch carries the transfer generation in its
+// upper half and the checksum of the blob in its lower half.
+static bool prv_batch_intact(const uint8_t *data, uint16_t length, uint32_t check) {
+  return (check & 0xffff) == prv_batch_checksum(data, length);
+}
 
-  if (s_menu_layer) {
-    layer_remove_from_parent(menu_layer_get_layer(s_menu_layer));
-    menu_layer_destroy(s_menu_layer);
-    s_menu_layer = NULL;
+static bool prv_batch_current(uint32_t check) {
+  uint16_t generation = check >> 16;
+  return generation == 0 || generation == s_generation;
+}
+
+// The phone numbers its transfers and tags list messages with TRANSFER_GEN. A
+// message that starts a list (a setup without LIST_APPEND, a diff, or the
+// resume of the list being received) makes its generation the current one.
+// Parts of a list from any other generation belong to a transfer that was
+// replaced since and are dropped.
+static bool prv_accept_generation(DictionaryIterator *iter) {
+  Tuple *t_generation = dict_find(iter, MESSAGE_KEY_TRANSFER_GEN);
+  if (!t_generation) return true;
+  uint16_t generation = t_generation->value->int32 & 0xffff;
+  Tuple *t_resume = dict_find(iter, MESSAGE_KEY_RESUME_HASH);
+  bool starts = (dict_find(iter, MESSAGE_KEY_ITEMS_COUNT) && !dict_find(iter, MESSAGE_KEY_LIST_APPEND))
+    || dict_find(iter, MESSAGE_KEY_ITEMS_DIFF)
+    || (t_resume && s_list_hash != 0 && (uint32_t)t_resume->value->int32 == s_list_hash);
+  if (starts) {
+    s_generation = generation;
+    return true;
   }
-  dealloc_items();
+  return generation == s_generation;
+}
 
-  if (count > 0) {
-    s_items = calloc(count, sizeof(TodoItem));
-    if (!s_items) {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to allocate memory for items");
-      return;
-    }
+// Number of items from the start of the list that arrived without a gap, as
+// far as the initial window goes. The phone resumes a transfer from there.
+static int prv_received_count(void) {
+  int capacity = item_store_capacity();
+  int count = 0;
+  while (count < capacity) {
+    TodoItem *item = item_store_get(count);
+    if (!item || !(item->flags & ITEM_FLAG_LOADED)) break;
+    count++;
   }
+  return count;
+}
+
+// --- Persistent list cache ---
+//
+// Serialized layout: uint8 title length, title, uint8 dictionary length,
+// dictionary, uint8 1 for a LIST_GLANCE list else 0, uint8 section count,
+// then per section: uint8 title length,
+// title, uint16 item count. After that a uint16 item count, uint16 label bytes
+// per page, uint16 number of stored items and one ITEMS_BATCH style record per
+// stored item, with its label as stored. Only a list that was still arriving
+// when the app closed stores fewer items than it has.
 
-  s_num_items = count;
-  APP_LOG(APP_LOG_LEVEL_INFO, "Received count=%d", count);
+static size_t prv_put_string(uint8_t *out, size_t pos, const char *text) {
+  size_t length = strlen(text);
+  if (length > 255) length = 255;
+  if (out) {
+    out[pos] = length;
+    memcpy(out + pos + 1, text, length);
+  }
+  return pos + 1 + length;
 }
 
-static void add_item(int index, const char *item_text) {
-  if (index < 0 || index >= s_num_items || !item_text) return;
-  TodoItem *item = &s_items[index];
-  free(item->label);
-  int length = strlen(item_text);
-  item->label = calloc(length + 1, sizeof(char));
-  strncpy(item->label, item_text, length);
-  item->checked = false;
+static size_t prv_put_bytes(uint8_t *out, size_t pos, const uint8_t *data, size_t length) {
+  if (out) {
+    out[pos] = length;
+    if (length > 0) memcpy(out + pos + 1, data, length);
+  }
+  return pos + 1 + length;
 }
 
-static int prv_content_height() {
+static size_t prv_put_u16(uint8_t *out, size_t pos, int value) {
+  if (out) {
+    out[pos] = value & 0xff;
+    out[pos + 1] = (value >> 8) & 0xff;
+  }
+  return pos + 2;
+}
+
+// Serialize the current list with its first `num_stored` items into `out`.
+// Pass NULL to only compute the size. Those items must be in memory.
+static size_t prv_serialize_list(uint8_t *out, int num_stored) {
+  int num_sections = item_store_section_count();
+  int num_items = item_store_count();
+  size_t dictionary_length;
+  const uint8_t *dictionary = item_store_dictionary(&dictionary_length);
+  size_t pos = prv_put_string(out, 0, s_menu_title);
+  pos = prv_put_bytes(out, pos, dictionary, dictionary_length);
+  if (out) {
+    out[pos] = s_list_glance;
+    out[pos + 1] = num_sections;
+  }
+  pos += 2;
+  for (int i = 0; i < num_sections; i++) {
+    pos = prv_put_string(out, pos, item_store_section_title(i));
+    pos = prv_put_u16(out, pos, item_store_section_item_count(i));
+  }
+  pos = prv_put_u16(out, pos, num_items);
+  pos = prv_put_u16(out, pos, s_page_bytes);
+  pos = prv_put_u16(out, pos, num_stored);
+  for (int i = 0; i < num_stored; i++) {
+    TodoItem *item = item_store_get(i);
+    if (out) out[pos] = item->flags & ITEM_FLAG_CHECKED;
+    pos = prv_put_string(out, pos + 1, item_store_label(item));
+  }
+  return pos;
+}
+
+static void prv_save_list_cache() {
+  s_list_toggled = false;
+  if (!item_store_fully_resident()) {
+    // Paged lists are too large for persistent storage anyway
+    list_cache_clear();
+    return;
+  }
+  size_t length = prv_serialize_list(NULL, item_store_count());
+  if (length > LIST_CACHE_MAX_SIZE) {
+    list_cache_clear();
+    return;
+  }
+  uint8_t *buffer = malloc(length);
+  if (!buffer) return;
+  prv_serialize_list(buffer, item_store_count());
+  list_cache_write(s_list_hash, buffer, length);
+  free(buffer);
+}
+
+// Keep what arrived of a list the app is closed in the middle of, so the phone
+// can resume the transfer where it stopped next time. Only lists with a hash
+// can be resumed. The cached complete list is replaced either way, it is
+// outdated by now.
+static void prv_save_partial_list() {
+  if (s_list_shown || s_list_hash == 0) return;
+  int received = prv_received_count();
+  if (received == 0) return;
+  size_t length = prv_serialize_list(NULL, received);
+  if (length > LIST_CACHE_MAX_SIZE) return;
+  uint8_t *buffer = malloc(length);
+  if (!buffer) return;
+  prv_serialize_list(buffer, received);
+  if (list_cache_write(s_list_hash, buffer, length)) {
+    APP_LOG(APP_LOG_LEVEL_INFO, "Saved %d of %d items to resume", received, item_store_count());
+  }
+  free(buffer);
+}
+
+static bool prv_restore_list(const uint8_t *data, size_t length) {
+  const uint8_t *cursor = data;
+  const uint8_t *end = data + length;
+#define NEED(n) if (cursor + (n) > end) return false
+
+  NEED(1);
+  size_t title_length = *cursor++;
+  NEED(title_length + 1);
+  size_t copied = title_length < sizeof(s_menu_title) - 1
+    ? title_length
+    : sizeof(s_menu_title) - 1;
+  memcpy(s_menu_title, cursor, copied);
+  s_menu_title[copied] = '\0';
+  cursor += title_length;
+
+  size_t dictionary_length = *cursor++;
+  NEED(dictionary_length + 2);
+  const uint8_t *dictionary = cursor;
+  cursor += dictionary_length;
+  bool list_glance = *cursor++ != 0;
+
+  // Walk sections and items once to validate them and size the label pool
+  int num_sections = *cursor++;
+  const uint8_t *sections = cursor;
+  int title_bytes = 0;
+  for (int i = 0; i < num_sections; i++) {
+    NEED(1);
+    title_bytes += *cursor;
+    cursor += 1 + *cursor;
+    NEED(2);
+    cursor += 2;
+  }
+  NEED(6);
+  int num_items = cursor[0] | (cursor[1] << 8);
+  int max_page_bytes = cursor[2] | (cursor[3] << 8);
+  int num_stored = cursor[4] | (cursor[5] << 8);
+  if (num_stored > num_items) return false;
+  cursor += 6;
+  const uint8_t *items = cursor;
+  int page_bytes = 0;
+  for (int i = 0; i < num_stored; i++) {
+    NEED(2);
+    uint8_t label_length = cursor[1];
+    NEED(2 + label_length);
+    if (i % ITEM_STORE_PAGE_SIZE == 0) page_bytes = 0;
+    page_bytes += label_length;
+    if (page_bytes > max_page_bytes) max_page_bytes = page_bytes;
+    cursor += 2 + label_length;
+  }
+#undef NEED
+
+  update_count(num_items, num_sections, title_bytes, max_page_bytes,
+               dictionary, dictionary_length);
+  s_list_glance = list_glance;
+  for (int i = 0; i < num_sections; i++) {
+    size_t section_title_length = *sections;
+    const uint8_t *count = sections + 1 + section_title_length;
+    item_store_set_section(i, (const char *)sections + 1, section_title_length,
+                           count[0] | (count[1] << 8));
+    sections = count + 2;
+  }
+  for (int i = 0; i < num_stored; i++) {
+    add_item(i, (const char *)items + 2, items[1], items[0] & ITEM_FLAG_CHECKED);
+    items += 2 + items[1];
+  }
+  return true;
+}
+
+// Show the last complete list right away, before the phone is even connected.
+// A list that was still arriving is restored as far as it got but not shown,
+// the hello asks the phone for the rest.
+static void prv_load_list_cache() {
+  uint8_t *data;
+  uint32_t hash;
+  size_t length = list_cache_read(&hash, &data);
+  if (length == 0) return;
+
+  bool restored = prv_restore_list(data, length);
+  free(data);
+  // Toggles made on another list can't be placed on this one
+  if (restored && toggle_journal_list_hash() != hash) toggle_journal_list_replaced(hash);
+  if (restored && item_store_count() > 0 && item_store_loaded_count() < item_store_capacity()) {
+    s_list_hash = hash;
+    s_list_needs_caching = true;
+    APP_LOG(APP_LOG_LEVEL_INFO, "Restored %d of %d items, waiting for the rest",
+            item_store_loaded_count(), item_store_count());
+    if (prv_first_screen_loaded()) prv_show_menu();
+    return;
+  }
+  if (!restored || item_store_count() == 0 || !item_store_fully_resident()) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Discarding invalid list cache");
+    update_count(0, 0, 0, 0, NULL, 0);
+    list_cache_clear();
+    return;
+  }
+
+  s_list_hash = hash;
+  s_list_needs_caching = false;
+  APP_LOG(APP_LOG_LEVEL_INFO, "Restored %d cached items", item_store_count());
+  complete_list_update();
+  telemetry_list_complete(item_store_count());
+  prv_schedule_telemetry();
+}
+
+// Height of the first `num_rows` rows of the list with their headers, counted
+// only as far as the menu is high because that is all the callers need. Rows
+// further down are not measured for it.
+static int prv_rows_height(int num_rows) {
+  int limit = s_menu_bounds.size.h;
   int h = 0;
-  if (s_num_sections == 0) {
-    h += MENU_CELL_BASIC_HEADER_HEIGHT + s_num_items * CELL_HEIGHT;
+  int num_sections = item_store_section_count();
+  if (num_sections == 0) {
+    h += MENU_CELL_BASIC_HEADER_HEIGHT;
+    for (int i = 0; i < num_rows && h < limit; i++) h += prv_row_height(i);
   } else {
-    for (int i = 0; i < s_num_sections; i++) {
-      if (s_sections[i].title[0] != '\0') h += MENU_CELL_BASIC_HEADER_HEIGHT;
-      h += s_sections[i].item_count * CELL_HEIGHT;
+    for (int i = 0; i < num_sections && h < limit; i++) {
+      int first = item_store_global_index(i, 0);
+      if (first >= num_rows) break;
+      if (item_store_section_title(i)[0] != '\0') h += MENU_CELL_BASIC_HEADER_HEIGHT;
+      int count = item_store_section_item_count(i);
+      for (int row = 0; row < count && first + row < num_rows && h < limit; row++) {
+        h += prv_row_height(first + row);
+      }
     }
   }
   return h;
 }
 
-static void complete_list_update() {
-  APP_LOG(APP_LOG_LEVEL_INFO, "Completed list update with %d items", s_num_items);
+static int prv_content_height() {
+  return prv_rows_height(item_store_count());
+}
 
-  if (s_menu_layer) {
-    layer_remove_from_parent(menu_layer_get_layer(s_menu_layer));
-    menu_layer_destroy(s_menu_layer);
-    s_menu_layer = NULL;
-  }
+// True once the rows at the top arrived as far as the menu is high, so the
+// list is usable before the rest of the initial window is in.
+static bool prv_first_screen_loaded(void) {
+  int received = prv_received_count();
+  if (received == 0) return false;
+  return received >= item_store_capacity() || prv_rows_height(received) >= s_menu_bounds.size.h;
+}
+
+// Create the menu for the list in the item store and slide it in. Rows that
+// did not arrive yet show a placeholder until they do.
+static void prv_show_menu() {
+  prv_destroy_menu();
 
   int raw_h = prv_content_height();
   int content_h = raw_h < s_menu_bounds.size.h ? raw_h : s_menu_bounds.size.h;
@@ -238,6 +798,8 @@ static void complete_list_update() {
     .draw_header       = prv_draw_header,
     .draw_row          = prv_draw_row,
     .select_click      = prv_select_click,
+    .select_long_click = prv_select_long_click,
+    .selection_changed = prv_selection_changed,
   });
   menu_layer_set_click_config_onto_window(s_menu_layer, s_window);
 #ifdef PBL_COLOR
@@ -251,18 +813,362 @@ static void complete_list_update() {
                            menu_frame.size.w, menu_frame.size.h);
   layer_set_frame(layer, from_frame);
   layer_add_child(window_get_root_layer(s_window), layer);
+  // The new menu must not cover the overlay
+  if (s_debug_layer) {
+    layer_remove_from_parent(text_layer_get_layer(s_debug_layer));
+    layer_add_child(window_get_root_layer(s_window), text_layer_get_layer(s_debug_layer));
+  }
 
-  PropertyAnimation *prop_anim =
-      property_animation_create_layer_frame(layer, &from_frame, &menu_frame);
-  Animation *anim = (Animation *)prop_anim;
+  s_menu_anim = property_animation_create_layer_frame(layer, &from_frame, &menu_frame);
+  Animation *anim = (Animation *)s_menu_anim;
   animation_set_duration(anim, 300);
   animation_set_curve(anim, AnimationCurveEaseOut);
   animation_set_handlers(anim,
     (AnimationHandlers){.stopped = prv_property_animation_stopped}, NULL);
   animation_schedule(anim);
+  telemetry_first_screen();
+}
+
+static void complete_list_update() {
+  int num_items = item_store_count();
+  APP_LOG(APP_LOG_LEVEL_INFO, "Completed list update with %d items", num_items);
+  if (item_store_loaded_count() > 0) {
+    int list_bytes = (int)(heap_bytes_used() - s_heap_before_list);
+    APP_LOG(APP_LOG_LEVEL_INFO, "List uses %d heap bytes, %d per resident item",
+            list_bytes, list_bytes / item_store_loaded_count());
+  }
+  s_list_shown = true;
+
+  // The menu is up already if the first screen arrived before the rest
+  if (s_menu_layer) {
+    prv_list_changed();
+  } else {
+    prv_show_menu();
+  }
+
+  if (s_list_needs_caching) {
+    s_list_needs_caching = false;
+    prv_save_list_cache();
+  }
+  s_glance_dirty = true;
+}
+
+// Put the open items of a task list on the app glance, if they changed since
+// it was published. Items of pages that are not in memory count as open, the
+// phone only sends open tasks anyway.
+static void prv_publish_glance(void) {
+  if (!s_glance_dirty || !s_list_glance || !s_list_shown) return;
+  s_glance_dirty = false;
+  int open_count = 0;
+  const char *next = NULL;
+  for (int i = 0; i < item_store_count(); i++) {
+    TodoItem *item = item_store_get(i);
+    bool loaded = item && (item->flags & ITEM_FLAG_LOADED);
+    if (loaded && prv_item_checked(item)) continue;
+    open_count++;
+    if (loaded && !next) next = item_store_text(item, s_label_text, sizeof(s_label_text));
+  }
+  glance_publish(open_count, next);
+}
+
+// The list on screen got more or different sections or items.
+static void prv_list_changed() {
+  if (!s_menu_layer) return;
+  int raw_h = prv_content_height();
+  int content_h = raw_h < s_menu_bounds.size.h ? raw_h : s_menu_bounds.size.h;
+  Layer *layer = menu_layer_get_layer(s_menu_layer);
+  GRect frame = layer_get_frame(layer);
+  if (frame.size.h != content_h) {
+    frame.size.h = content_h;
+    layer_set_frame(layer, frame);
+  }
+  menu_layer_reload_data(s_menu_layer);
+}
+
+// Cache the list once all of it has arrived. A list that grew beyond the
+// window never will, prv_save_list_cache() then drops the outdated cache.
+static void prv_maybe_save_list_cache() {
+  if (!s_list_shown || !s_list_needs_caching) return;
+  if (item_store_fully_resident() || item_store_capacity() < item_store_count()) {
+    s_list_needs_caching = false;
+    prv_save_list_cache();
+  }
+}
+
+// --- Diffs ---
+//
+// ITEMS_DIFF turns the (fully resident) list on screen into a new version
+// without retransmitting it. Layout, all integers little endian:
+//   uint16 item count before, uint16 item count after,
+//   uint8 section count, uint16 item count per section,
+// followed by operations in list order. Indexes refer to the list as
+// changed by the operations before.
+//   DIFF_REMOVE: uint16 index, uint16 count
+//   DIFF_INSERT: uint16 index, uint16 id, uint8 flags, uint8 length, label
+//   DIFF_UPDATE: uint16 index, uint8 flags, uint8 length, label
+
+#define DIFF_REMOVE 1
+#define DIFF_INSERT 2
+#define DIFF_UPDATE 3
+
+typedef struct {
+  uint8_t type;
+  int index;
+  int count;        // DIFF_REMOVE
+  int id;           // DIFF_INSERT
+  uint8_t flags;
+  const char *label;
+  uint8_t length;
+} DiffOp;
+
+static int prv_get_u16(const uint8_t *data) {
+  return data[0] | (data[1] << 8);
+}
+
+// Decode the operation at `cursor`, returns the position after it or NULL.
+static const uint8_t *prv_next_diff_op(const uint8_t *cursor, const uint8_t *end, DiffOp *op) {
+  if (cursor + 3 > end) return NULL;
+  op->type = cursor[0];
+  op->index = prv_get_u16(cursor + 1);
+  cursor += 3;
+  if (op->type == DIFF_REMOVE) {
+    if (cursor + 2 > end) return NULL;
+    op->count = prv_get_u16(cursor);
+    return cursor + 2;
+  }
+  if (op->type == DIFF_INSERT) {
+    if (cursor + 2 > end) return NULL;
+    op->id = prv_get_u16(cursor);
+    cursor += 2;
+  } else if (op->type != DIFF_UPDATE) {
+    return NULL;
+  }
+  if (cursor + 2 > end) return NULL;
+  op->flags = cursor[0];
+  op->length = cursor[1];
+  op->label = (const char *)cursor + 2;
+  cursor += 2;
+  return cursor + op->length <= end ? cursor + op->length : NULL;
+}
+
+// Check that the diff fits the list on screen before touching anything.
+static bool prv_validate_diff(const uint8_t *ops, const uint8_t *end, int before, int after) {
+  int count = before;
+  int position = 0;
+  DiffOp op;
+  while (ops < end) {
+    ops = prv_next_diff_op(ops, end, &op);
+    if (!ops || op.index < position) return false;
+    if (op.type == DIFF_REMOVE) {
+      if (op.index + op.count > count) return false;
+      count -= op.count;
+      position = op.index;
+    } else if (op.type == DIFF_INSERT) {
+      if (op.index > count) return false;
+      count++;
+      position = op.index + 1;
+    } else {
+      if (op.index >= count) return false;
+      position = op.index + 1;
+    }
+  }
+  return count == after;
+}
+
+// Apply an ITEMS_DIFF blob. Returns false if it does not fit the list on
+// screen, which then has to be sent in full.
+static bool prv_apply_diff(const uint8_t *data, uint16_t length, int page_bytes) {
+  const uint8_t *end = data + length;
+  if (length < 5) return false;
+  int before = prv_get_u16(data);
+  int after = prv_get_u16(data + 2);
+  int num_sections = data[4];
+  const uint8_t *section_counts = data + 5;
+  const uint8_t *ops = section_counts + 2 * num_sections;
+  if (ops > end
+      || before != item_store_count()
+      || num_sections != item_store_section_count()
+      || !item_store_fully_resident()
+      || !prv_validate_diff(ops, end, before, after)) {
+    return false;
+  }
+
+  // Follow the selected item through the changes
+  int selected = -1;
+  if (s_menu_layer) {
+    MenuIndex index = menu_layer_get_selected_index(s_menu_layer);
+    selected = item_store_global_index(index.section, index.row);
+  }
+  int new_selected = -1;
+
+  if (!item_store_begin_rebuild(after, num_sections, page_bytes)) {
+    status_bar_set_status("Out of memory!");
+    return true;
+  }
+  s_page_bytes = page_bytes;
+  for (int i = 0; i < num_sections; i++) {
+    item_store_set_section_item_count(i, prv_get_u16(section_counts + 2 * i));
+  }
+
+  int src = 0;
+  int dst = 0;
+  DiffOp op;
+  while (ops < end) {
+    ops = prv_next_diff_op(ops, end, &op);
+    // Unchanged items up to the operation
+    while (dst < op.index) {
+      if (src == selected) new_selected = dst;
+      item_store_copy_from_old(src++, dst++);
+    }
+    if (op.type == DIFF_REMOVE) {
+      if (selected >= src && selected < src + op.count) new_selected = dst;
+      src += op.count;
+    } else if (op.type == DIFF_INSERT) {
+      item_store_set(dst++, op.label, op.length, op.flags, op.id);
+    } else {
+      if (src == selected) new_selected = dst;
+      item_store_set(dst++, op.label, op.length, op.flags, item_store_old_id(src++));
+    }
+  }
+  while (src < before) {
+    if (src == selected) new_selected = dst;
+    item_store_copy_from_old(src++, dst++);
+  }
+  // Old and new list are both in memory right now
+  telemetry_sample_heap();
+  item_store_end_rebuild();
+  APP_LOG(APP_LOG_LEVEL_INFO, "Applied diff of %d bytes: %d -> %d items",
+          (int)length, before, after);
+
+  if (!s_list_shown) {
+    if (after > 0) complete_list_update();
+    return true;
+  }
+  prv_list_changed();
+  if (s_menu_layer && after > 0) {
+    if (new_selected < 0 || new_selected >= after) new_selected = after - 1;
+    MenuIndex index;
+    int section, row;
+    item_store_position(new_selected, &section, &row);
+    index.section = section;
+    index.row = row;
+    menu_layer_set_selected_index(s_menu_layer, index, MenuRowAlignNone, false);
+  }
+  return true;
+}
+
+// --- Paging ---
+
+static void prv_page_request_timeout(void *data) {
+  s_page_request_timer = NULL;
+  s_requested_page = -1;
+  prv_request_missing_page();
+}
+
+// Ask the phone for the closest page around the selection that is not in
+// memory. Only one request is in flight at a time, the next one goes out once
+// the page arrived (or the request timed out).
+static void prv_request_missing_page() {
+  if (!s_list_shown || s_requested_page >= 0) return;
+  int page = item_store_missing_page();
+  if (page < 0) return;
+
+  DictionaryIterator *out_iter;
+  if (app_message_outbox_begin(&out_iter) != APP_MSG_OK || out_iter == NULL) {
+    // Outbox busy, try again from outbox_sent_handler
+    return;
+  }
+  dict_write_int(out_iter, MESSAGE_KEY_REQUEST_PAGE, &page, sizeof(page), true);
+  prv_append_telemetry(out_iter);
+  if (app_message_outbox_send() != APP_MSG_OK) return;
+
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Requested page %d", page);
+  telemetry_page_requested();
+  s_requested_page = page;
+  if (s_page_request_timer) app_timer_cancel(s_page_request_timer);
+  s_page_request_timer = app_timer_register(PAGE_REQUEST_TIMEOUT_MS,
+                                            prv_page_request_timeout, NULL);
+}
+
+// The bar counts the items of the first window, which is all the phone sends
+// before the list is shown.
+static void prv_update_progress(void) {
+  if (s_progress_sending) {
+    status_bar_set_progress(item_store_loaded_count(), item_store_capacity());
+  }
+}
+
+// Called after items [first, end) arrived.
+static void prv_items_received(int first, int end) {
+  telemetry_items_received();
+  prv_update_progress();
+  if (!s_drops_reported && item_store_dropped_count() > 0) {
+    s_drops_reported = true;
+    status_bar_set_status("Low memory, items cut");
+  }
+  for (int i = first; i < end; i++) prv_row_height(i);
+  if (!s_list_shown) {
+    // The list is complete with the initial window, the menu shows as soon
+    // as the first screen of it is there
+    if (item_store_loaded_count() >= item_store_capacity() && item_store_count() > 0) {
+      complete_list_update();
+      telemetry_list_complete(item_store_count());
+      prv_schedule_telemetry();
+    } else if (s_menu_layer) {
+      menu_layer_reload_data(s_menu_layer);
+    } else if (prv_first_screen_loaded()) {
+      prv_show_menu();
+    }
+    return;
+  }
+
+  if (s_requested_page >= 0
+      && first <= (s_requested_page + 1) * ITEM_STORE_PAGE_SIZE - 1
+      && end > s_requested_page * ITEM_STORE_PAGE_SIZE) {
+    s_requested_page = -1;
+    if (s_page_request_timer) {
+      app_timer_cancel(s_page_request_timer);
+      s_page_request_timer = NULL;
+    }
+  }
+  if (s_menu_layer) {
+    menu_layer_reload_data(s_menu_layer);
+  }
+  prv_maybe_save_list_cache();
+  prv_request_missing_page();
 }
 
+// Apply a SECTION_HEADERS blob: uint8 index of the first section, then per
+// section uint16 item count (little endian), uint8 title length and the title
+// (UTF-8, not NUL-terminated). Returns false if it names no section of the
+// list, headers past its end are ignored.
+static bool prv_set_sections(const uint8_t *data, uint16_t length) {
+  if (length < 1) return false;
+  int first = data[0];
+  int index = first;
+  const uint8_t *cursor = data + 1;
+  const uint8_t *end = data + length;
+  while (end - cursor >= 3 && index < item_store_section_count()) {
+    size_t title_length = cursor[2];
+    if ((size_t)(end - cursor) < 3 + title_length) break;
+    item_store_set_section(index, (const char *)cursor + 3, title_length, cursor[0] | (cursor[1] << 8));
+    cursor += 3 + title_length;
+    index++;
+  }
+  APP_LOG(APP_LOG_LEVEL_INFO, "Sections %d to %d of %d", first, index - 1, item_store_section_count());
+  return index > first;
+}
+
+static void prv_send_hello(void *data);
+static void prv_schedule_hello(AppMessageResult reason);
+
 static void inbox_received_handler(DictionaryIterator *iter, void *context) {
+  telemetry_message_received((const uint8_t *)iter->end - (const uint8_t *)iter->dictionary);
+  if (!prv_accept_generation(iter)) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Dropping message of an older transfer");
+    return;
+  }
+
   Tuple *t_title = dict_find(iter, MESSAGE_KEY_LIST_TITLE);
   if (t_title) {
     strncpy(s_menu_title, t_title->value->cstring, sizeof(s_menu_title) - 1);
@@ -271,31 +1177,72 @@ static void inbox_received_handler(DictionaryIterator *iter, void *context) {
 
   Tuple *t_count = dict_find(iter, MESSAGE_KEY_ITEMS_COUNT);
   if (t_count) {
-    update_count(t_count->value->int32);
-  }
-
-  Tuple *t_sc = dict_find(iter, MESSAGE_KEY_SECTION_COUNT);
-  if (t_sc) {
-    free(s_sections);
-    s_num_sections = (int)t_sc->value->int32;
-    s_sections = s_num_sections > 0
-      ? calloc(s_num_sections, sizeof(MenuSection))
-      : NULL;
-    APP_LOG(APP_LOG_LEVEL_INFO, "Received section_count=%d", s_num_sections);
-  }
-
-  Tuple *t_si = dict_find(iter, MESSAGE_KEY_SECTION_INDEX);
-  Tuple *t_st = dict_find(iter, MESSAGE_KEY_SECTION_TITLE);
-  Tuple *t_sn = dict_find(iter, MESSAGE_KEY_SECTION_ITEM_COUNT);
-  if (t_si && t_st && t_sn && s_sections) {
-    int idx = (int)t_si->value->int32;
-    if (idx >= 0 && idx < s_num_sections) {
-      strncpy(s_sections[idx].title, t_st->value->cstring,
-              sizeof(s_sections[idx].title) - 1);
-      s_sections[idx].title[sizeof(s_sections[idx].title) - 1] = '\0';
-      s_sections[idx].item_count = (int)t_sn->value->int32;
-      APP_LOG(APP_LOG_LEVEL_INFO, "Section %d: '%s' (%d items)",
-              idx, s_sections[idx].title, s_sections[idx].item_count);
+    int count = t_count->value->int32;
+    Tuple *t_sc = dict_find(iter, MESSAGE_KEY_SECTION_COUNT);
+    Tuple *t_page_bytes = dict_find(iter, MESSAGE_KEY_ITEMS_PAGE_BYTES);
+    Tuple *t_title_bytes = dict_find(iter, MESSAGE_KEY_SECTION_TITLE_BYTES);
+    int num_sections = t_sc ? (int)t_sc->value->int32 : 0;
+    int title_bytes = t_title_bytes
+      ? (int)t_title_bytes->value->int32
+      : num_sections * DEFAULT_TITLE_BYTES;
+    int page_bytes = t_page_bytes
+      ? (int)t_page_bytes->value->int32
+      : ITEM_STORE_PAGE_SIZE * DEFAULT_LABEL_BYTES;
+    bool append = dict_find(iter, MESSAGE_KEY_LIST_APPEND) != NULL;
+    if (append) {
+      grow_count(count, num_sections, title_bytes, page_bytes);
+    } else {
+      // The dictionary comes with the first setup message of a list only
+      Tuple *t_dict = dict_find(iter, MESSAGE_KEY_LABEL_DICT);
+      telemetry_list_started();
+      update_count(count, num_sections, title_bytes, page_bytes,
+                   t_dict ? t_dict->value->data : NULL, t_dict ? t_dict->length : 0);
+      s_list_glance = dict_find(iter, MESSAGE_KEY_LIST_GLANCE) != NULL;
+    }
+
+    // Only the complete list carries a hash, partial ones are not cached
+    Tuple *t_hash = dict_find(iter, MESSAGE_KEY_LIST_HASH);
+    s_list_hash = t_hash ? (uint32_t)t_hash->value->int32 : 0;
+    s_list_needs_caching = t_hash != NULL;
+    if (append) {
+      toggle_journal_list_changed(s_list_hash);
+    } else {
+      toggle_journal_list_replaced(s_list_hash);
+    }
+    if (item_store_count() == 0) {
+      list_cache_clear();
+    }
+  }
+
+  Tuple *t_headers = dict_find(iter, MESSAGE_KEY_SECTION_HEADERS);
+  if (t_headers && prv_set_sections(t_headers->value->data, t_headers->length) && s_list_shown) {
+    prv_list_changed();
+    prv_maybe_save_list_cache();
+  }
+
+  Tuple *t_diff = dict_find(iter, MESSAGE_KEY_ITEMS_DIFF);
+  if (t_diff) {
+    Tuple *t_page_bytes = dict_find(iter, MESSAGE_KEY_ITEMS_PAGE_BYTES);
+    Tuple *t_hash = dict_find(iter, MESSAGE_KEY_LIST_HASH);
+    telemetry_list_started();
+    if (prv_apply_diff(t_diff->value->data, t_diff->length,
+                       t_page_bytes ? (int)t_page_bytes->value->int32 : 0)) {
+      // The diff may turn the list into a task list or the other way round
+      s_list_glance = dict_find(iter, MESSAGE_KEY_LIST_GLANCE) != NULL;
+      s_list_hash = t_hash ? (uint32_t)t_hash->value->int32 : 0;
+      s_list_needs_caching = t_hash != NULL;
+      toggle_journal_list_changed(s_list_hash);
+      prv_maybe_save_list_cache();
+      telemetry_list_complete(item_store_count());
+      prv_schedule_telemetry();
+      s_glance_dirty = true;
+    } else {
+      // Out of step with the phone: forget our list hash and say hello again,
+      // the phone then sends the whole list
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Diff does not match the list, asking for all of it");
+      s_list_hash = 0;
+      s_hello_attempts = 0;
+      prv_send_hello(NULL);
     }
   }
 
@@ -303,12 +1250,43 @@ static void inbox_received_handler(DictionaryIterator *iter, void *context) {
   Tuple *t_item  = dict_find(iter, MESSAGE_KEY_ITEMS_ITEM);
   if (t_index && t_item) {
     int index = t_index->value->int32;
-    add_item(index, t_item->value->cstring);
+    add_item(index, t_item->value->cstring, strlen(t_item->value->cstring), false);
     APP_LOG(APP_LOG_LEVEL_INFO, "Received item %d: %s", index, t_item->value->cstring);
-    if (index == s_num_items - 1) {
-      complete_list_update();
+    prv_items_received(index, index + 1);
+  }
+
+  Tuple *t_batch = dict_find(iter, MESSAGE_KEY_ITEMS_BATCH);
+  Tuple *t_check = dict_find(iter, MESSAGE_KEY_BATCH_CHECK);
+  if (t_batch && t_check && !prv_batch_current((uint32_t)t_check->value->int32)) {
+    // Left over from a transfer that was replaced since
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Ignoring batch of an older transfer");
+    t_batch = NULL;
+  } else if (t_batch && t_check
+             && !prv_batch_intact(t_batch->value->data, t_batch->length,
+                                  (uint32_t)t_check->value->int32)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Batch checksum mismatch, dropping %d bytes",
+            (int)t_batch->length);
+    telemetry_message_dropped();
+    t_batch = NULL;
+    // Pages are asked for again when their request times out. While the
+    // first window is arriving, the hello tells the phone where to resume.
+    if (!s_list_shown) {
+      s_hello_attempts = 0;
+      prv_send_hello(NULL);
     }
   }
+  if (t_batch && t_batch->length >= 2) {
+    int first = t_batch->value->data[0] | (t_batch->value->data[1] << 8);
+    int end = prv_receive_batch(t_batch->value->data, t_batch->length);
+    APP_LOG(APP_LOG_LEVEL_INFO, "Received batch of %d bytes, items %d to %d",
+            (int)t_batch->length, first, end - 1);
+    prv_items_received(first, end);
+  }
+
+  Tuple *t_glance_refresh = dict_find(iter, MESSAGE_KEY_CONFIG_GLANCE_REFRESH);
+  if (t_glance_refresh) {
+    glance_set_refresh_enabled(t_glance_refresh->value->int32 != 0);
+  }
 
   Tuple *t_status = dict_find(iter, MESSAGE_KEY_SET_STATUS);
   if (t_status) {
@@ -317,20 +1295,154 @@ static void inbox_received_handler(DictionaryIterator *iter, void *context) {
 
   Tuple *t_progressing = dict_find(iter, MESSAGE_KEY_SET_PROGRESSING);
   if (t_progressing) {
-    status_bar_set_progressing(t_progressing->value->int32 != 0);
+    int phase = (int)t_progressing->value->int32;
+    s_phone_busy = phase != 0;
+    s_progress_sending = phase == PROGRESS_SENDING;
+    if (s_progress_sending) {
+      prv_update_progress();
+    } else {
+      status_bar_set_progress(0, 0);
+    }
+    status_bar_set_progressing(phase != 0);
   }
+
+  telemetry_sample_heap();
+  prv_update_debug_overlay();
+  if (s_refresh_timer) app_timer_reschedule(s_refresh_timer, REFRESH_IDLE_MS);
 }
 
 static void inbox_dropped_handler(AppMessageResult reason, void *context) {
   APP_LOG(APP_LOG_LEVEL_ERROR, "Message dropped: %d", (int)reason);
+  telemetry_message_dropped();
+  prv_update_debug_overlay();
+}
+
+static void outbox_sent_handler(DictionaryIterator *iter, void *context) {
+  if (dict_find(iter, MESSAGE_KEY_ITEM_TOGGLES)) {
+    toggle_journal_acked();
+    if (s_toggles_delayed && toggle_journal_unsent() == 0) {
+      s_toggles_delayed = false;
+      status_bar_set_status("");
+    }
+  }
+  prv_request_missing_page();
+  prv_send_toggles();
+  prv_send_telemetry();
 }
 
 static void outbox_failed_handler(DictionaryIterator *iter,
                                   AppMessageResult reason, void *context) {
   APP_LOG(APP_LOG_LEVEL_ERROR, "Outbox send failed: %d", (int)reason);
+  telemetry_outbox_failed();
+  prv_update_debug_overlay();
+  if (dict_find(iter, MESSAGE_KEY_WATCH_INBOX_SIZE)) {
+    // PebbleKit JS is usually not running yet when the app starts, retry quietly
+    prv_schedule_hello(reason);
+    return;
+  }
+  if (dict_find(iter, MESSAGE_KEY_ITEM_TOGGLES)) {
+    // They stay in the journal. Without a connection they go out after the
+    // hello once the phone is back, otherwise after a while.
+    toggle_journal_failed();
+    if (connection_service_peek_pebble_app_connection() && !s_toggle_timer) {
+      s_toggle_timer = app_timer_register(TOGGLE_RETRY_MS, prv_toggle_timer_fired, NULL);
+    }
+    s_toggles_delayed = true;
+    status_bar_set_status("Offline, will sync");
+    return;
+  }
   status_bar_set_status("Cannot reach phone!");
 }
 
+static void prv_hello_timer_fired(void *data) {
+  s_hello_timer = NULL;
+  prv_send_hello(NULL);
+}
+
+// Try the hello again after it failed for `reason`. A busy outbox frees up
+// quickly; without a connection there is no point before the phone is back
+// (see prv_connection_changed()). Anything else backs off exponentially, with
+// jitter so retries do not keep colliding with the phone's own sends.
+static void prv_schedule_hello(AppMessageResult reason) {
+  if (s_hello_attempts >= HELLO_MAX_ATTEMPTS || s_hello_timer) return;
+  if (reason == APP_MSG_NOT_CONNECTED && !connection_service_peek_pebble_app_connection()) return;
+
+  uint32_t delay = HELLO_BUSY_RETRY_MS;
+  if (reason != APP_MSG_BUSY) {
+    int doublings = s_hello_attempts > 4 ? 3 : s_hello_attempts - 1;
+    delay = HELLO_RETRY_MS << (doublings > 0 ? doublings : 0);
+    if (delay > HELLO_RETRY_MAX_MS) delay = HELLO_RETRY_MAX_MS;
+    delay = delay / 2 + rand() % (delay / 2 + 1);
+  }
+  s_hello_timer = app_timer_register(delay, prv_hello_timer_fired, NULL);
+}
+
+// Tell the companion how large our inbox is so it can size ITEMS_BATCH messages,
+// which list we are already showing so it can skip an identical transfer, and
+// how far a list we are still receiving got so it can resume from there.
+static void prv_send_hello(void *data) {
+  if (s_hello_timer) {
+    app_timer_cancel(s_hello_timer);
+    s_hello_timer = NULL;
+  }
+  DictionaryIterator *out_iter;
+  s_hello_attempts++;
+  AppMessageResult res = app_message_outbox_begin(&out_iter);
+  if (res != APP_MSG_OK || out_iter == NULL) {
+    prv_schedule_hello(res);
+    return;
+  }
+  int inbox_size = (int)s_inbox_size;
+  dict_write_int(out_iter, MESSAGE_KEY_WATCH_INBOX_SIZE, &inbox_size, sizeof(inbox_size), true);
+  int32_t list_hash = s_list_shown ? (int32_t)s_list_hash : 0;
+  dict_write_int(out_iter, MESSAGE_KEY_CACHED_LIST_HASH, &list_hash, sizeof(list_hash), true);
+  int received = s_list_shown || s_list_hash == 0 ? 0 : prv_received_count();
+  if (received > 0) {
+    int32_t resume_hash = (int32_t)s_list_hash;
+    dict_write_int(out_iter, MESSAGE_KEY_RESUME_HASH, &resume_hash, sizeof(resume_hash), true);
+    dict_write_int(out_iter, MESSAGE_KEY_RESUME_INDEX, &received, sizeof(received), true);
+  }
+  int page_size = ITEM_STORE_PAGE_SIZE;
+  dict_write_int(out_iter, MESSAGE_KEY_WATCH_PAGE_SIZE, &page_size, sizeof(page_size), true);
+  int window_pages = ITEM_STORE_WINDOW_PAGES;
+  dict_write_int(out_iter, MESSAGE_KEY_WATCH_WINDOW_PAGES, &window_pages, sizeof(window_pages), true);
+  // What the heap allows right now, so the phone can cap the list to it
+  int pool_budget = item_store_pool_budget();
+  dict_write_int(out_iter, MESSAGE_KEY_WATCH_POOL_BUDGET, &pool_budget, sizeof(pool_budget), true);
+  int heap_budget = item_store_heap_budget();
+  dict_write_int(out_iter, MESSAGE_KEY_WATCH_HEAP_BUDGET, &heap_budget, sizeof(heap_budget), true);
+  app_message_outbox_send();
+}
+
+// Say hello again when the phone is back: a transfer the disconnect cut off
+// then resumes from what we report.
+static void prv_connection_changed(bool connected) {
+  if (!connected) return;
+  s_hello_attempts = 0;
+  prv_send_hello(NULL);
+}
+
+// A refresh launch is done once the phone has nothing more to send: the list
+// arrived, or was unchanged, and the glance is published.
+static void prv_refresh_timer_fired(void *data) {
+  s_refresh_timer = NULL;
+  if (s_phone_busy && s_refresh_waits < REFRESH_MAX_WAITS) {
+    s_refresh_waits++;
+    s_refresh_timer = app_timer_register(REFRESH_IDLE_MS, prv_refresh_timer_fired, NULL);
+    return;
+  }
+  APP_LOG(APP_LOG_LEVEL_INFO, "Refresh done, quitting");
+  prv_publish_glance();
+  window_stack_pop_all(false);
+}
+
+// The user picked the app up while it refreshed, it stays open.
+static void prv_stop_refresh(void) {
+  if (s_refresh_timer) app_timer_cancel(s_refresh_timer);
+  s_refresh_timer = NULL;
+  s_refresh_launch = false;
+}
+
 static void prv_window_load(Window *window) {
   Layer *window_layer = window_get_root_layer(window);
   GRect bounds = layer_get_bounds(window_layer);
@@ -341,36 +1453,77 @@ static void prv_window_load(Window *window) {
   GRect bar_bounds = layer_get_bounds(status_bar_get_layer());
   s_menu_bounds = GRect(0, bar_bounds.size.h, bounds.size.w,
                         bounds.size.h - bar_bounds.size.h);
+
+  prv_load_list_cache();
 }
 
 static void prv_window_unload(Window *window) {
-  if (s_menu_layer) {
-    menu_layer_destroy(s_menu_layer);
-    s_menu_layer = NULL;
-  }
+  if (s_debug_layer) prv_toggle_debug_overlay();
+  prv_destroy_menu();
   status_bar_deinit();
 }
 
 static void prv_init(void) {
+  s_refresh_launch = glance_refresh_launch();
+  if (s_refresh_launch) {
+    s_refresh_waits = 0;
+    s_refresh_timer = app_timer_register(REFRESH_START_MS, prv_refresh_timer_fired, NULL);
+  }
+  telemetry_init();
+  toggle_journal_init();
+  s_checked_icon = gbitmap_create_with_resource(RESOURCE_ID_CHECK_MARK);
+
   s_window = window_create();
   window_set_window_handlers(s_window, (WindowHandlers){
     .load   = prv_window_load,
     .unload = prv_window_unload,
   });
   window_stack_push(s_window, true);
+  // Loading the window restored the cached list, which is what the glance
+  // was published with when it was saved
+  s_refresh_hash = s_list_hash;
+  s_glance_dirty = false;
 
   app_message_register_inbox_received(inbox_received_handler);
   app_message_register_inbox_dropped(inbox_dropped_handler);
+  app_message_register_outbox_sent(outbox_sent_handler);
   app_message_register_outbox_failed(outbox_failed_handler);
-  app_message_open(1024, 64);
-
-  s_checked_icon = gbitmap_create_with_resource(RESOURCE_ID_CHECK_MARK);
+  s_inbox_size = app_message_inbox_size_maximum();
+  if (s_inbox_size > INBOX_SIZE_LIMIT) s_inbox_size = INBOX_SIZE_LIMIT;
+  app_message_open(s_inbox_size, OUTBOX_SIZE);
+  APP_LOG(APP_LOG_LEVEL_INFO, "Opened inbox with %d bytes", (int)s_inbox_size);
+  connection_service_subscribe((ConnectionHandlers){
+    .pebble_app_connection_handler = prv_connection_changed,
+  });
+  prv_send_hello(NULL);
 }
 
 static void prv_deinit(void) {
+  connection_service_unsubscribe();
+  if (s_hello_timer) app_timer_cancel(s_hello_timer);
+  s_hello_timer = NULL;
+  if (s_toggle_timer) app_timer_cancel(s_toggle_timer);
+  s_toggle_timer = NULL;
+  if (s_telemetry_timer) app_timer_cancel(s_telemetry_timer);
+  s_telemetry_timer = NULL;
+  prv_publish_glance();
+  bool refresh = s_list_glance && !(s_refresh_launch && s_list_hash == s_refresh_hash);
+  prv_stop_refresh();
+  if (refresh) {
+    glance_schedule_refresh();
+  } else {
+    glance_cancel_refresh();
+  }
   gbitmap_destroy(s_checked_icon);
   window_destroy(s_window);
-  dealloc_items();
+  prv_save_partial_list();
+  if (s_list_toggled && s_list_shown && s_list_hash != 0) prv_save_list_cache();
+  // The next run numbers the items by position, as the restored list and a
+  // phone sending it afresh do
+  if (s_list_shown && toggle_journal_list_hash() == s_list_hash) {
+    toggle_journal_map_ids(prv_index_of_id);
+  }
+  item_store_deinit();
 }
 
 int main(void) {
@@ -378,4 +1531,5 @@ int main(void) {
   APP_LOG(APP_LOG_LEVEL_DEBUG, "Done initializing, pushed window: %p", s_window);
   app_event_loop();
   prv_deinit();
+  return 0;
 }
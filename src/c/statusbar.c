@@ -15,57 +15,71 @@ static bool s_status_visible = false;
 // Animation duration (ms)
 #define STATUS_ANIM_DURATION 200
 
+// The progress bar along the bottom of the status bar. With a known total it
+// is filled up to done / total and only redrawn when that changes. Without one
+// a segment sweeps across, driven by a single looping animation that lives for
+// as long as the indeterminate phase does.
+#define PROGRESS_HEIGHT 2
+#define PROGRESS_SWEEP_MS 1000
+
 static Layer *s_progress_layer = NULL;
-static PropertyAnimation *s_progress_anim = NULL;
-bool s_progressing = false;
+static Animation *s_progress_anim = NULL;
+static AnimationProgress s_progress_sweep = 0;
+static bool s_progressing = false;
+static int s_progress_done = 0;
+static int s_progress_total = 0;
 
 static void prv_anim_stopped(Animation *animation, bool finished, void *context);
 static void prv_animate_layer_to(Layer *layer, GRect to_frame, uint32_t delay_ms);
-static void start_progress_anim();
 
 static void draw_progress_layer(Layer *layer, GContext *ctx) {
-  // Example progress drawing (replace with actual progress logic)
+  if (!s_progressing)
+    return;
+  GRect bounds = layer_get_bounds(layer);
+  GRect bar;
+  if (s_progress_total > 0) {
+    int done = s_progress_done < s_progress_total ? s_progress_done : s_progress_total;
+    bar = GRect(0, 0, bounds.size.w * done / s_progress_total, bounds.size.h);
+  } else {
+    // Sweeps in from the left and out to the right
+    int width = bounds.size.w / 3;
+    int x = -width + (int)((bounds.size.w + width) * s_progress_sweep / ANIMATION_NORMALIZED_MAX);
+    bar = GRect(x, 0, width, bounds.size.h);
+  }
   graphics_context_set_fill_color(ctx, PBL_IF_COLOR_ELSE(GColorOrange, GColorWhite));
-  graphics_fill_rect(ctx, layer_get_bounds(layer), 0, GCornerNone);
+  graphics_fill_rect(ctx, bar, 0, GCornerNone);
 }
 
-static void finish_progress_anim(Animation *animation, bool finished, void *context) {
-  if (finished && s_progressing) {
-    start_progress_anim();
-  }
-  else {
-    if (s_progress_anim) {
-      property_animation_destroy(s_progress_anim);
-      s_progress_anim = NULL;
-    }
-  }
+static void prv_progress_anim_update(Animation *animation, const AnimationProgress progress) {
+  s_progress_sweep = progress;
+  layer_mark_dirty(s_progress_layer);
 }
 
-static void start_progress_anim() {
-  if (!s_progress_layer)
-    return;
-
-  // Cancel previous animation if running
+static void prv_progress_anim_stopped(Animation *animation, bool finished, void *context) {
   if (s_progress_anim) {
-    property_animation_destroy(s_progress_anim);
+    animation_destroy(s_progress_anim);
     s_progress_anim = NULL;
   }
+}
 
-  GRect bar_bounds = layer_get_bounds(status_bar_layer_get_layer(s_status_bar_layer));
-  GRect from = GRect(-bar_bounds.size.w / 3, bar_bounds.size.h - 4, bar_bounds.size.w / 3, 4);
-  GRect to = GRect(bar_bounds.size.w, bar_bounds.size.h - 4, bar_bounds.size.w / 4, 4);
-
-  s_progress_anim = property_animation_create_layer_frame(s_progress_layer, &from, &to);
-  animation_set_duration((Animation *)s_progress_anim, 1000);
-  animation_set_curve((Animation *)s_progress_anim, AnimationCurveEaseInOut);
-  
-  // Repeat indefinitely if still progressing
-  AnimationHandlers handlers = {
-    .stopped = finish_progress_anim
-  };
-  animation_set_handlers((Animation *)s_progress_anim, handlers, NULL);
-  
-  animation_schedule((Animation *)s_progress_anim);
+// Run the sweep while progressing without a total, stop it otherwise.
+static void prv_update_progress_anim(void) {
+  bool sweeping = s_progressing && s_progress_total <= 0;
+  if (sweeping && !s_progress_anim && s_progress_layer) {
+    static const AnimationImplementation implementation = {
+      .update = prv_progress_anim_update,
+    };
+    s_progress_anim = animation_create();
+    animation_set_implementation(s_progress_anim, &implementation);
+    animation_set_duration(s_progress_anim, PROGRESS_SWEEP_MS);
+    animation_set_curve(s_progress_anim, AnimationCurveEaseInOut);
+    animation_set_play_count(s_progress_anim, ANIMATION_PLAY_COUNT_INFINITE);
+    animation_set_handlers(s_progress_anim, (AnimationHandlers){ .stopped = prv_progress_anim_stopped }, NULL);
+    animation_schedule(s_progress_anim);
+  } else if (!sweeping && s_progress_anim) {
+    // The stopped handler destroys it
+    animation_unschedule(s_progress_anim);
+  }
 }
 
 void status_bar_init(Window *window) {
@@ -95,7 +109,7 @@ void status_bar_init(Window *window) {
 
   layer_add_child(window_layer, text_layer_get_layer(s_status_layer));
 
-  s_progress_layer = layer_create(GRect(-bounds.size.w / 3, bounds.size.h - 2, bounds.size.w / 3, 2));
+  s_progress_layer = layer_create(GRect(0, bounds.size.h - PROGRESS_HEIGHT, bounds.size.w, PROGRESS_HEIGHT));
   layer_set_update_proc(s_progress_layer, draw_progress_layer);
   layer_add_child(window_layer, s_progress_layer);
 }
@@ -115,8 +129,7 @@ void status_bar_deinit(void) {
     s_status_bar_layer = NULL;
   }
   if (s_progress_anim) {
-    property_animation_destroy(s_progress_anim);
-    s_progress_anim = NULL;
+    animation_unschedule(s_progress_anim);
   }
   if (s_progress_layer) {
     layer_destroy(s_progress_layer);
@@ -180,12 +193,30 @@ static void prv_anim_stopped(Animation *animation, bool finished, void *context)
   }
 }
 
-void status_bar_set_progressing(bool progressing)
-{
-  if (progressing && !s_progress_anim) {
-    start_progress_anim();
-  }
+void status_bar_set_progressing(bool progressing) {
+  if (progressing == s_progressing)
+    return;
   s_progressing = progressing;
+  if (!progressing) {
+    s_progress_total = 0;
+  }
+  prv_update_progress_anim();
+  if (s_progress_layer) {
+    layer_mark_dirty(s_progress_layer);
+  }
+}
+
+void status_bar_set_progress(int done, int total) {
+  if (total < 0)
+    total = 0;
+  if (done == s_progress_done && total == s_progress_total)
+    return;
+  s_progress_done = done;
+  s_progress_total = total;
+  prv_update_progress_anim();
+  if (s_progress_layer && s_progressing) {
+    layer_mark_dirty(s_progress_layer);
+  }
 }
 
 Layer *status_bar_get_layer() {
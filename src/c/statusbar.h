@@ -15,6 +15,12 @@ void status_bar_deinit(void);
 // strings. If passed NULL or an empty string, the status becomes invisible.
 void status_bar_set_status(const char *text);
 
+// Show or hide the progress bar. It sweeps back and forth until
+// status_bar_set_progress() gives it a total. Hiding it forgets the total.
 void status_bar_set_progressing(bool progressing);
 
+// Fill the progress bar up to done / total, or go back to sweeping if the
+// total is 0 (not known).
+void status_bar_set_progress(int done, int total);
+
 Layer *status_bar_get_layer();
\ No newline at end of file
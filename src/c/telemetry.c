@@ -0,0 +1,143 @@
+#include <pebble.h>
+#include <string.h>
+
+#include "telemetry.h"
+
+// Not measured (yet)
+#define NO_TIME UINT32_MAX
+
+static uint32_t s_list_start = 0;
+static bool s_timing = false;
+static bool s_first_item_seen = false;
+static uint32_t s_first_item_ms = NO_TIME;
+static bool s_first_screen_seen = false;
+static uint32_t s_first_screen_ms = NO_TIME;
+static uint32_t s_list_ms = NO_TIME;
+static int s_num_items = 0;
+static bool s_pending = false;
+
+static uint32_t s_messages_received = 0;
+static uint32_t s_bytes_received = 0;
+static uint32_t s_messages_dropped = 0;
+static uint32_t s_outbox_failures = 0;
+static uint32_t s_pages_requested = 0;
+static size_t s_heap_peak = 0;
+
+// Milliseconds on a wrapping clock, only differences are meaningful
+static uint32_t prv_now_ms(void) {
+  time_t seconds;
+  uint16_t ms;
+  time_ms(&seconds, &ms);
+  return (uint32_t)seconds * 1000 + ms;
+}
+
+void telemetry_init(void) {
+  // The first list is timed from app start
+  s_list_start = prv_now_ms();
+  s_timing = true;
+  s_first_item_seen = false;
+  s_first_screen_seen = false;
+  telemetry_sample_heap();
+}
+
+void telemetry_list_started(void) {
+  // A list that replaces one still arriving keeps the earlier start
+  if (s_timing) return;
+  s_list_start = prv_now_ms();
+  s_timing = true;
+  s_first_item_seen = false;
+  s_first_screen_seen = false;
+}
+
+void telemetry_items_received(void) {
+  if (!s_timing || s_first_item_seen) return;
+  s_first_item_seen = true;
+  s_first_item_ms = prv_now_ms() - s_list_start;
+}
+
+void telemetry_first_screen(void) {
+  if (!s_timing || s_first_screen_seen) return;
+  s_first_screen_seen = true;
+  s_first_screen_ms = prv_now_ms() - s_list_start;
+  APP_LOG(APP_LOG_LEVEL_INFO, "First screen after %d ms", (int)s_first_screen_ms);
+}
+
+void telemetry_list_complete(int num_items) {
+  if (!s_timing) return;
+  telemetry_items_received();
+  telemetry_first_screen();
+  s_timing = false;
+  s_list_ms = prv_now_ms() - s_list_start;
+  s_num_items = num_items;
+  s_pending = true;
+  telemetry_sample_heap();
+  APP_LOG(APP_LOG_LEVEL_INFO, "List of %d items: first item after %d ms, complete after %d ms",
+          num_items, (int)s_first_item_ms, (int)s_list_ms);
+}
+
+void telemetry_message_received(size_t bytes) {
+  s_messages_received++;
+  s_bytes_received += bytes;
+}
+
+void telemetry_message_dropped(void) {
+  s_messages_dropped++;
+}
+
+void telemetry_outbox_failed(void) {
+  s_outbox_failures++;
+}
+
+void telemetry_page_requested(void) {
+  s_pages_requested++;
+}
+
+void telemetry_sample_heap(void) {
+  size_t used = heap_bytes_used();
+  if (used > s_heap_peak) s_heap_peak = used;
+}
+
+bool telemetry_pending(void) {
+  return s_pending;
+}
+
+static uint8_t *prv_put(uint8_t *out, uint32_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) out[i] = (value >> (8 * i)) & 0xff;
+  return out + bytes;
+}
+
+static uint32_t prv_u16(uint32_t value) {
+  return value < UINT16_MAX ? value : UINT16_MAX;
+}
+
+void telemetry_serialize(uint8_t *out) {
+  out = prv_put(out, TELEMETRY_VERSION, 1);
+  out = prv_put(out, s_first_item_ms, 4);
+  out = prv_put(out, s_list_ms, 4);
+  out = prv_put(out, prv_u16(s_num_items), 2);
+  out = prv_put(out, prv_u16(s_messages_received), 2);
+  out = prv_put(out, s_bytes_received, 4);
+  out = prv_put(out, prv_u16(s_messages_dropped), 2);
+  out = prv_put(out, prv_u16(s_outbox_failures), 2);
+  out = prv_put(out, prv_u16(s_pages_requested), 2);
+  out = prv_put(out, (uint32_t)s_heap_peak, 4);
+  prv_put(out, s_first_screen_ms, 4);
+  s_pending = false;
+}
+
+void telemetry_format(char *buffer, size_t size) {
+  char first_item[12] = "-";
+  char first_screen[12] = "-";
+  char list[12] = "-";
+  if (s_first_item_ms != NO_TIME) snprintf(first_item, sizeof(first_item), "%d ms", (int)s_first_item_ms);
+  if (s_first_screen_ms != NO_TIME) {
+    snprintf(first_screen, sizeof(first_screen), "%d ms", (int)s_first_screen_ms);
+  }
+  if (s_list_ms != NO_TIME) snprintf(list, sizeof(list), "%d ms", (int)s_list_ms);
+  snprintf(buffer, size,
+           "First item: %s\nFirst screen: %s\nList: %s (%d items)\nReceived: %d msgs, %d B\n"
+           "Dropped: %d  Out failed: %d\nPages requested: %d\nHeap: %d B, peak %d B",
+           first_item, first_screen, list, s_num_items, (int)s_messages_received, (int)s_bytes_received,
+           (int)s_messages_dropped, (int)s_outbox_failures, (int)s_pages_requested,
+           (int)heap_bytes_used(), (int)s_heap_peak);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <pebble.h>
+
+// Counters and timings of how lists reach the watch, for the debug overlay and
+// for the TELEMETRY message sent back to the companion.
+//
+// Times are measured from the moment a list was asked for: app start for the
+// first list, the setup message (or diff) from the phone for later ones.
+
+// Layout of the TELEMETRY blob, all integers little endian:
+//   uint8 version, uint32 first item ms, uint32 list ms, uint16 items,
+//   uint16 messages received, uint32 bytes received, uint16 messages dropped,
+//   uint16 outbox failures, uint16 pages requested, uint32 heap peak,
+//   uint32 first screen ms
+#define TELEMETRY_VERSION 2
+#define TELEMETRY_SIZE 31
+
+void telemetry_init(void);
+
+// The phone started sending a new list.
+void telemetry_list_started(void);
+
+// Items of the list arrived, the first call after telemetry_list_started()
+// takes the time to first item.
+void telemetry_items_received(void);
+
+// The first screen of the list is shown, takes the time to first usable
+// screen. Only the first call per list counts.
+void telemetry_first_screen(void);
+
+// The list is on screen, takes the time to complete list and makes the
+// telemetry pending for the phone.
+void telemetry_list_complete(int num_items);
+
+void telemetry_message_received(size_t bytes);
+void telemetry_message_dropped(void);
+void telemetry_outbox_failed(void);
+void telemetry_page_requested(void);
+
+// Update the heap high-water mark.
+void telemetry_sample_heap(void);
+
+// True if there is a telemetry message the phone has not been sent yet.
+bool telemetry_pending(void);
+
+// Write the TELEMETRY blob to `out` (TELEMETRY_SIZE bytes) and clear the
+// pending flag.
+void telemetry_serialize(uint8_t *out);
+
+// Human readable summary for the debug overlay.
+void telemetry_format(char *buffer, size_t size);
@@ -0,0 +1,177 @@
+#include <pebble.h>
+#include <string.h>
+
+#include "toggle_journal.h"
+
+// Persist key of the journal, kept clear of the list cache's keys
+#define TOGGLE_JOURNAL_KEY     90
+#define TOGGLE_JOURNAL_VERSION 2
+// Version, count and list hash
+#define TOGGLE_JOURNAL_HEADER  6
+
+typedef struct {
+  uint16_t id;
+  // State the user left the item in
+  bool checked;
+  // In flight, and the state that was sent
+  bool sending;
+  bool sent_checked;
+} JournalEntry;
+
+static JournalEntry s_entries[TOGGLE_JOURNAL_MAX];
+static int s_count = 0;
+static bool s_in_flight = false;
+static uint32_t s_list_hash = 0;
+
+// Stored as a version byte, a count byte and the list hash (little endian),
+// followed by the entries in the format they are sent in. Whether they were
+// in flight is not kept: what did not get acknowledged goes out again.
+static void prv_save(void) {
+  if (s_count == 0) {
+    persist_delete(TOGGLE_JOURNAL_KEY);
+    return;
+  }
+  uint8_t data[TOGGLE_JOURNAL_HEADER + TOGGLE_JOURNAL_MAX * TOGGLE_JOURNAL_ENTRY_SIZE];
+  data[0] = TOGGLE_JOURNAL_VERSION;
+  data[1] = s_count;
+  for (int i = 0; i < 4; i++) data[2 + i] = s_list_hash >> (8 * i);
+  size_t pos = TOGGLE_JOURNAL_HEADER;
+  for (int i = 0; i < s_count; i++) {
+    data[pos++] = s_entries[i].id & 0xff;
+    data[pos++] = s_entries[i].id >> 8;
+    data[pos++] = s_entries[i].checked ? 1 : 0;
+  }
+  persist_write_data(TOGGLE_JOURNAL_KEY, data, pos);
+}
+
+void toggle_journal_init(void) {
+  s_count = 0;
+  s_in_flight = false;
+  s_list_hash = 0;
+  uint8_t data[TOGGLE_JOURNAL_HEADER + TOGGLE_JOURNAL_MAX * TOGGLE_JOURNAL_ENTRY_SIZE];
+  int length = persist_read_data(TOGGLE_JOURNAL_KEY, data, sizeof(data));
+  if (length < TOGGLE_JOURNAL_HEADER || data[0] != TOGGLE_JOURNAL_VERSION
+      || data[1] > TOGGLE_JOURNAL_MAX
+      || length != TOGGLE_JOURNAL_HEADER + data[1] * TOGGLE_JOURNAL_ENTRY_SIZE) {
+    persist_delete(TOGGLE_JOURNAL_KEY);
+    return;
+  }
+  uint32_t hash = data[2] | (data[3] << 8) | (data[4] << 16) | ((uint32_t)data[5] << 24);
+  if (hash == 0) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Dropping %d toggles of an unfinished list", data[1]);
+    persist_delete(TOGGLE_JOURNAL_KEY);
+    return;
+  }
+  for (int i = 0; i < data[1]; i++) {
+    const uint8_t *entry = data + TOGGLE_JOURNAL_HEADER + i * TOGGLE_JOURNAL_ENTRY_SIZE;
+    s_entries[i] = (JournalEntry){ .id = entry[0] | (entry[1] << 8), .checked = entry[2] != 0 };
+  }
+  s_count = data[1];
+  s_list_hash = hash;
+  APP_LOG(APP_LOG_LEVEL_INFO, "%d toggles still to send", s_count);
+}
+
+uint32_t toggle_journal_list_hash(void) {
+  return s_list_hash;
+}
+
+void toggle_journal_list_replaced(uint32_t hash) {
+  if (s_count > 0) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Dropping %d toggles of the previous list", s_count);
+  }
+  // Entries in flight are dropped as well, their acknowledgement has nothing
+  // left to remove
+  s_count = 0;
+  s_list_hash = hash;
+  prv_save();
+}
+
+void toggle_journal_list_changed(uint32_t hash) {
+  if (hash == s_list_hash) return;
+  s_list_hash = hash;
+  prv_save();
+}
+
+static void prv_remove(int index) {
+  memmove(&s_entries[index], &s_entries[index + 1], (s_count - index - 1) * sizeof(JournalEntry));
+  s_count--;
+}
+
+bool toggle_journal_record(uint16_t id, bool checked) {
+  for (int i = 0; i < s_count; i++) {
+    if (s_entries[i].id != id) continue;
+    if (!s_entries[i].sending) {
+      // Toggled back before the phone heard of it
+      prv_remove(i);
+    } else {
+      s_entries[i].checked = checked;
+    }
+    prv_save();
+    return true;
+  }
+  if (s_count >= TOGGLE_JOURNAL_MAX) return false;
+  s_entries[s_count++] = (JournalEntry){ .id = id, .checked = checked };
+  prv_save();
+  return true;
+}
+
+void toggle_journal_map_ids(int (*map)(uint16_t id)) {
+  for (int i = s_count - 1; i >= 0; i--) {
+    int id = map(s_entries[i].id);
+    if (id < 0) {
+      prv_remove(i);
+    } else {
+      s_entries[i].id = id;
+    }
+  }
+  prv_save();
+}
+
+int toggle_journal_unsent(void) {
+  int count = 0;
+  for (int i = 0; i < s_count; i++) {
+    if (!s_entries[i].sending) count++;
+  }
+  return count;
+}
+
+bool toggle_journal_in_flight(void) {
+  return s_in_flight;
+}
+
+size_t toggle_journal_take(uint8_t *out, int max_entries) {
+  size_t pos = 0;
+  for (int i = 0; i < s_count && max_entries > 0; i++) {
+    JournalEntry *entry = &s_entries[i];
+    if (entry->sending) continue;
+    out[pos++] = entry->id & 0xff;
+    out[pos++] = entry->id >> 8;
+    out[pos++] = entry->checked ? 1 : 0;
+    entry->sending = true;
+    entry->sent_checked = entry->checked;
+    max_entries--;
+  }
+  s_in_flight = pos > 0;
+  return pos;
+}
+
+void toggle_journal_acked(void) {
+  for (int i = s_count - 1; i >= 0; i--) {
+    JournalEntry *entry = &s_entries[i];
+    if (!entry->sending) continue;
+    if (entry->checked == entry->sent_checked) {
+      prv_remove(i);
+    } else {
+      entry->sending = false;
+    }
+  }
+  s_in_flight = false;
+  prv_save();
+}
+
+void toggle_journal_failed(void) {
+  for (int i = 0; i < s_count; i++) {
+    s_entries[i].sending = false;
+  }
+  s_in_flight = false;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <pebble.h>
+
+// Toggles the user made on the watch that the phone has not acknowledged yet.
+// They are kept in persistent storage, so neither a busy outbox nor a missing
+// connection nor closing the app loses them. Toggling an item again before
+// its entry went out merges into that entry.
+//
+// Item ids only mean something within the list they were handed out for, so
+// the journal remembers the hash of that list and sends it along as
+// TOGGLES_LIST_HASH. Entries go out as an ITEM_TOGGLES blob of
+// TOGGLE_JOURNAL_ENTRY_SIZE bytes each: uint16 item id (little endian), uint8 1
+// if checked, 0 if not.
+#define TOGGLE_JOURNAL_MAX 32
+#define TOGGLE_JOURNAL_ENTRY_SIZE 3
+
+// Load the entries a previous run did not get out. Those made on a list that
+// had no hash yet are dropped, nobody could tell which list they belong to.
+void toggle_journal_init(void);
+
+// Hash of the list the entries were recorded against, 0 while it has none.
+uint32_t toggle_journal_list_hash(void);
+
+// A new list replaced the one on the watch, its items have new ids. Entries
+// are dropped and new ones are recorded against `hash`.
+void toggle_journal_list_replaced(uint32_t hash);
+
+// The list changed to `hash` but its items kept their ids (a diff, or more
+// items appended): entries now refer to it.
+void toggle_journal_list_changed(uint32_t hash);
+
+// Give every entry the id `map` returns for it, dropping those it returns -1
+// for. Used before the list's ids change under the journal.
+void toggle_journal_map_ids(int (*map)(uint16_t id));
+
+// Item `id` was toggled to `checked`. Returns false if the journal is full.
+bool toggle_journal_record(uint16_t id, bool checked);
+
+// Number of entries waiting to be sent, not counting those in flight.
+int toggle_journal_unsent(void);
+
+// True while a message with entries waits for the phone's acknowledgement.
+bool toggle_journal_in_flight(void);
+
+// Write up to `max_entries` unsent entries to `out` and mark them in flight.
+// Returns the number of bytes written.
+size_t toggle_journal_take(uint8_t *out, int max_entries);
+
+// The phone acknowledged the entries in flight: they are dropped, unless the
+// item was toggled again since, then that state goes out next.
+void toggle_journal_acked(void);
+
+// The entries in flight did not reach the phone and go out again.
+void toggle_journal_failed(void);
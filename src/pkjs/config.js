@@ -1,5 +1,5 @@
 // Clay configuration for the Nextcloud checklist app.
-// Fields: CONFIG_WEB_DAV_URL, CONFIG_USER, CONFIG_APP_PASSWORD
+// Fields: CONFIG_WEB_DAV_URL, CONFIG_USER, CONFIG_APP_PASSWORD, CONFIG_GLANCE_REFRESH
 
 module.exports = [
   {
@@ -24,6 +24,13 @@ module.exports = [
           "type": "password"
         }
       },
+      {
+        "type": "toggle",
+        "messageKey": "CONFIG_GLANCE_REFRESH",
+        "label": "Refresh the app glance",
+        "description": "Wake the app every two hours to fetch the task list, so the launcher shows what is open. Uses some battery.",
+        "defaultValue": false
+      },
       {
         "type": "submit",
         "defaultValue": "Save Settings"
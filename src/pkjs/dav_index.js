@@ -0,0 +1,207 @@
+const multistatus = require('./multistatus');
+const trace = require('./trace');
+
+// Phone-side index of the markdown files below the configured folder.
+//
+// Every collection is listed on its own with a Depth: 1 PROPFIND; one
+// Depth: infinity request over a large tree is slow and some servers refuse
+// it. Listings are kept in localStorage together with the collection's ETag.
+// Servers like Nextcloud change a collection's ETag whenever anything below
+// it changes, so a refresh only lists the collections whose ETag differs
+// from the stored one and takes unchanged subtrees from the index as they
+// are. Collections without an ETag are always listed again.
+
+const STORAGE_PREFIX = 'DAV_INDEX:';
+// Collections listed at the same time
+const CONCURRENCY = 3;
+
+const PROPFIND_BODY = '<?xml version="1.0" encoding="utf-8"?><propfind xmlns="DAV:"><prop>' +
+  '<resourcetype/><getetag/><getlastmodified/></prop></propfind>';
+
+// Stored per root URL:
+//   { collections: { path: { etag, files: [{ href, etag, lastModified }], dirs: [path] } } }
+function load(rootUrl) {
+  try {
+    let index = JSON.parse(localStorage.getItem(STORAGE_PREFIX + rootUrl) || 'null');
+    return index && index.collections ? index : null;
+  } catch (ex) {
+    console.log('Dropping unreadable folder index for ' + rootUrl);
+    return null;
+  }
+}
+
+function save(rootUrl, index) {
+  try {
+    localStorage.setItem(STORAGE_PREFIX + rootUrl, JSON.stringify(index));
+  } catch (ex) {
+    console.log('Could not store folder index: ' + ex);
+  }
+}
+
+function originOf(url) {
+  let m = url.match(/^https?:\/\/[^\/]+/);
+  return m ? m[0] : '';
+}
+
+// Path part of an href, which servers send either as a path or a full URL.
+function pathOf(href) {
+  return href.replace(/^https?:\/\/[^\/]+/, '');
+}
+
+function withSlash(path) {
+  return path.endsWith('/') ? path : path + '/';
+}
+
+function samePath(a, b) {
+  try {
+    return decodeURIComponent(withSlash(a)) === decodeURIComponent(withSlash(b));
+  } catch (ex) {
+    return withSlash(a) === withSlash(b);
+  }
+}
+
+// The markdown files reachable from the root as { rel, etag, lastModified },
+// `rel` relative to the root (still URL encoded), most recently modified first.
+function filesOf(collections, rootPath) {
+  let files = [];
+  let seen = {};
+  function walk(path) {
+    let entry = collections[path];
+    if (!entry || seen[path]) return;
+    seen[path] = true;
+    entry.files.forEach(function (file) {
+      let rel = file.href.startsWith(rootPath) ? file.href.slice(rootPath.length) : file.href;
+      files.push({ rel: rel, etag: file.etag || null, lastModified: file.lastModified });
+    });
+    entry.dirs.forEach(walk);
+  }
+  walk(rootPath);
+  files.sort(function (a, b) { return b.lastModified - a.lastModified; });
+  return files;
+}
+
+// Files of the stored index, or null if there is none yet.
+function cachedFiles(rootUrl) {
+  let index = load(rootUrl);
+  return index ? filesOf(index.collections, withSlash(pathOf(rootUrl))) : null;
+}
+
+// List one collection. Calls onDone(error, responses); the responses are
+// parsed as they arrive.
+function propfind(url, user, pass, onDone) {
+  let responses = [];
+  let parser = multistatus.createParser(function (response) { responses.push(response); });
+  let consumed = 0;
+  let request = new XMLHttpRequest();
+  let done = trace.httpStarted();
+
+  function feed(text) {
+    if (!text || text.length <= consumed) return;
+    trace.parse(function () { parser.feed(text.slice(consumed)); });
+    consumed = text.length;
+  }
+
+  request.onprogress = function () {
+    if (this.status === 207) feed(this.responseText);
+  };
+  request.onload = function () {
+    done((this.responseText || '').length);
+    if (this.status !== 207) {
+      onDone('List err: ' + this.status, null);
+      return;
+    }
+    feed(this.responseText);
+    parser.end();
+    onDone(null, responses);
+  };
+  request.onerror = function () {
+    done(0);
+    onDone('Network error!', null);
+  };
+
+  request.open('PROPFIND', url, true, user, pass);
+  request.setRequestHeader('Depth', '1');
+  request.setRequestHeader('Content-Type', 'application/xml; charset=utf-8');
+  request.send(PROPFIND_BODY);
+}
+
+// Bring the index of `rootUrl` up to date. Calls onDone(error, files) with
+// the files as returned by cachedFiles(); on error the stored index is kept.
+function refresh(rootUrl, user, pass, onDone) {
+  let origin = originOf(rootUrl);
+  let rootPath = withSlash(pathOf(rootUrl));
+  let old = (load(rootUrl) || { collections: {} }).collections;
+  let fresh = {};
+  let queued = {};
+  let pending = [];
+  let running = 0;
+  let listed = 0;
+  let failed = false;
+
+  function enqueue(path) {
+    if (queued[path]) return;
+    queued[path] = true;
+    pending.push(path);
+  }
+
+  // Take an unchanged collection and everything below it from the old index
+  function keep(path) {
+    let entry = old[path];
+    if (!entry || fresh[path]) return;
+    queued[path] = true;
+    fresh[path] = entry;
+    entry.dirs.forEach(function (dir) {
+      if (old[dir]) keep(dir);
+      else enqueue(dir);
+    });
+  }
+
+  function next() {
+    if (failed) return;
+    while (running < CONCURRENCY && pending.length > 0) list(pending.shift());
+    if (running === 0 && pending.length === 0) {
+      console.log('Folder index: listed ' + listed + ' of ' + Object.keys(fresh).length + ' collections');
+      save(rootUrl, { collections: fresh });
+      onDone(null, filesOf(fresh, rootPath));
+    }
+  }
+
+  function list(path) {
+    running++;
+    listed++;
+    propfind(origin + path, user, pass, function (error, responses) {
+      running--;
+      if (failed) return;
+      if (error) {
+        failed = true;
+        onDone(error, null);
+        return;
+      }
+
+      let entry = { etag: null, files: [], dirs: [] };
+      responses.forEach(function (response) {
+        let href = pathOf(response.href);
+        if (samePath(href, path)) {
+          entry.etag = response.etag;
+        } else if (response.collection) {
+          let dir = withSlash(href);
+          entry.dirs.push(dir);
+          if (response.etag && old[dir] && old[dir].etag === response.etag) keep(dir);
+          else enqueue(dir);
+        } else if (/\.md$/i.test(href)) {
+          entry.files.push({ href: href, etag: response.etag, lastModified: response.lastModified });
+        }
+      });
+      fresh[path] = entry;
+      next();
+    });
+  }
+
+  enqueue(rootPath);
+  next();
+}
+
+module.exports = {
+  cachedFiles: cachedFiles,
+  refresh: refresh,
+};
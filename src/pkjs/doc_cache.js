@@ -0,0 +1,124 @@
+// Phone-side cache of downloaded markdown documents.
+//
+// Each document's body is kept in localStorage together with the ETag and
+// Last-Modified value the server sent for it. On startup the cached body is
+// shown right away and then revalidated with a conditional GET, so an
+// unchanged file costs a single 304 response instead of a full download.
+
+const trace = require('./trace');
+
+const STORAGE_PREFIX = 'DOC_CACHE:';
+const INDEX_KEY = 'DOC_CACHE_INDEX';
+// localStorage is small on some phones, keep only the most recent documents
+// and skip very large ones.
+const MAX_DOCUMENTS = 10;
+const MAX_BODY_LENGTH = 256 * 1024;
+
+function loadIndex() {
+  try {
+    return JSON.parse(localStorage.getItem(INDEX_KEY) || '[]');
+  } catch (ex) {
+    return [];
+  }
+}
+
+function saveIndex(index) {
+  localStorage.setItem(INDEX_KEY, JSON.stringify(index));
+}
+
+function remove(url) {
+  localStorage.removeItem(STORAGE_PREFIX + url);
+  saveIndex(loadIndex().filter(function (u) { return u !== url; }));
+}
+
+// Returns { body, etag, lastModified, storedAt } or null.
+function get(url) {
+  try {
+    let entry = JSON.parse(localStorage.getItem(STORAGE_PREFIX + url) || 'null');
+    return entry && typeof entry.body === 'string' ? entry : null;
+  } catch (ex) {
+    console.log('Dropping unreadable cache entry for ' + url);
+    remove(url);
+    return null;
+  }
+}
+
+function put(url, body, etag, lastModified) {
+  if (body.length > MAX_BODY_LENGTH) {
+    remove(url);
+    return;
+  }
+
+  // Most recently stored first, evict from the end
+  let index = loadIndex().filter(function (u) { return u !== url; });
+  index.unshift(url);
+  index.slice(MAX_DOCUMENTS).forEach(function (old) {
+    localStorage.removeItem(STORAGE_PREFIX + old);
+  });
+  index = index.slice(0, MAX_DOCUMENTS);
+
+  let entry = { body: body, etag: etag || null, lastModified: lastModified || null, storedAt: Date.now() };
+  try {
+    localStorage.setItem(STORAGE_PREFIX + url, JSON.stringify(entry));
+    saveIndex(index);
+  } catch (ex) {
+    console.log('Could not cache ' + url + ': ' + ex);
+    remove(url);
+  }
+}
+
+// GET `url`, conditional on the cached version if there is one. Calls
+// onDone(result, body, status) with result being
+//  - 'unchanged' the cached body is still current (body is the cached one)
+//  - 'changed'   a new body was downloaded and cached
+//  - 'error'     the request failed, status is the HTTP status or 0
+function revalidate(url, username, password, onDone) {
+  let cached = get(url);
+  let request = new XMLHttpRequest();
+  let done = trace.httpStarted();
+
+  request.onload = function () {
+    done((this.responseText || '').length);
+    if (this.status === 304 && cached) {
+      console.log('Not modified: ' + url);
+      onDone('unchanged', cached.body, this.status);
+    } else if (this.status >= 200 && this.status < 300) {
+      let body = this.responseText || '';
+      put(url, body, this.getResponseHeader('ETag'), this.getResponseHeader('Last-Modified'));
+      // Servers without validators answer 200 every time
+      onDone(cached && cached.body === body ? 'unchanged' : 'changed', body, this.status);
+    } else {
+      console.log('Error reading ' + url + ': ' + this.status + ' ' + this.responseText);
+      onDone('error', null, this.status);
+    }
+  };
+
+  request.onerror = function () {
+    done(0);
+    console.log('Request failed: ' + url);
+    onDone('error', null, 0);
+  };
+
+  request.open('GET', url, true, username, password);
+  if (cached && cached.etag) {
+    request.setRequestHeader('If-None-Match', cached.etag);
+  }
+  if (cached && cached.lastModified) {
+    request.setRequestHeader('If-Modified-Since', cached.lastModified);
+  }
+  request.send();
+}
+
+// Record the body we uploaded ourselves, so the next start does not download
+// it again. `etag` is whatever the PUT response carried, if anything.
+function updateAfterUpload(url, body, etag) {
+  put(url, body, etag, null);
+}
+
+module.exports = {
+  get: get,
+  put: put,
+  remove: remove,
+  revalidate: revalidate,
+  updateAfterUpload: updateAfterUpload,
+};
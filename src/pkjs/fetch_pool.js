@@ -0,0 +1,51 @@
+// Runs a number of asynchronous jobs (downloads) in parallel and hands their
+// results on strictly in job order: job 2 is delivered as soon as jobs 0 and 1
+// are, no matter which finished first. At most `limit` jobs are running or
+// waiting for delivery at any time, which also bounds the buffered results.
+//
+//   run(count, limit,
+//       function start(index, done) { ... done(result); },
+//       function deliver(index, result) { ... },
+//       function finished() { ... });
+
+function run(count, limit, start, deliver, finished) {
+  let results = new Array(count);
+  let completed = new Array(count).fill(false);
+  let nextToStart = 0;
+  let nextToDeliver = 0;
+
+  function startMore() {
+    while (nextToStart < count && nextToStart - nextToDeliver < limit) {
+      let index = nextToStart++;
+      start(index, function (result) {
+        results[index] = result;
+        completed[index] = true;
+        deliverReady();
+      });
+    }
+  }
+
+  function deliverReady() {
+    while (nextToDeliver < count && completed[nextToDeliver]) {
+      let index = nextToDeliver++;
+      deliver(index, results[index]);
+      results[index] = null;
+    }
+    if (nextToDeliver === count) {
+      if (finished) finished();
+      finished = null;
+      return;
+    }
+    startMore();
+  }
+
+  if (count === 0) {
+    if (finished) finished();
+    return;
+  }
+  startMore();
+}
+
+module.exports = {
+  run: run,
+};
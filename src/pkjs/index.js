@@ -1,22 +1,57 @@
 var keys = require('message_keys'); // generated at build time from package.json
+const transfer = require('./transfer');
+const docCache = require('./doc_cache');
+const fetchPool = require('./fetch_pool');
+const writeBack = require('./write_back');
+const markdown = require('./markdown');
+const davIndex = require('./dav_index');
+const taskIndex = require('./task_index');
+const trace = require('./trace');
+
+// Files downloaded in parallel when several are selected
+const FETCH_CONCURRENCY = 3;
+// Rows of the file picker before the files: Load, All open tasks
+const PICKER_ACTIONS = 2;
+
+// SET_PROGRESSING values, what the phone is busy with. While it sends a list
+// the watch fills its progress bar as the items arrive, a setup message says
+// so itself. Downloads and uploads only get the indeterminate bar.
+const PROGRESS_BUSY = 1;
+const PROGRESS_DOWNLOAD = 2;
+const PROGRESS_SENDING = 3;
 
 // Persist the most recently loaded document here so it's accessible
 // throughout this module (file). It's set after a successful GET.
-let documentLines = [];
+let documentText = '';
 let checklistItems = [];
 let listTitle = 'Checklist';
+// Status to show once a transfer finished, e.g. that the list may be stale
+let idleStatus = '';
+// Sends the list shown last again, in case the watch lost it
+let resendList = null;
+// When sending the current list to the watch started, for the trace
+let sendStart = 0;
+// Whether a list reached the watch yet. Toggles arriving before are kept in
+// pendingToggles, their ids only mean something once the list is there.
+let listReady = false;
+let pendingToggles = [];
+// Transfer generation of the load under way (see transfer.begin()). Callbacks
+// of an older load check it and stop.
+let generation = 0;
 
 // Folder-mode state
 let appMode = 'checklist';     // 'file-picker' | 'checklist'
-let foundFiles = [];            // relative paths discovered by PROPFIND
+let folderFiles = [];           // { rel, etag, lastModified } from the folder index
+let foundFiles = [];            // relative paths from the folder index
 let selectedFiles = new Set(); // indices into foundFiles that are checked
-let fileData = [];              // [{ url, lines }] for multi-file checklist mode
+let fileData = [];              // [{ url, text }] for multi-file checklist mode
 
 function resetState() {
-  documentLines = [];
+  documentText = '';
   checklistItems = [];
   listTitle = 'Checklist';
   appMode = 'checklist';
+  folderFiles = [];
   foundFiles = [];
   selectedFiles = new Set();
   fileData = [];
@@ -61,11 +96,13 @@ Pebble.addEventListener('webviewclosed', function (e) {
   storeSetting("CONFIG_WEB_DAV_URL");
   storeSetting("CONFIG_USER");
   storeSetting("CONFIG_APP_PASSWORD");
+  if (settings.CONFIG_GLANCE_REFRESH) sendGlanceRefresh(settings.CONFIG_GLANCE_REFRESH.value);
 
   main()
 });
 
 function main() {
+    generation = transfer.begin();
     loadSettings();
     if (!webdavUrl || !username || !appPassword) {
       console.log("No configuration - aborting!");
@@ -80,118 +117,114 @@ function main() {
     }
 }
 
+// Show the cached copy of the document straight away (if there is one), then
+// check with the server whether it is still current.
 function loadDocument() {
-  // Create a new web request
-  let request = new XMLHttpRequest();
-
-  request.onload = function () {
-    console.log("Request finished");
-    if (this.status >= 200 && this.status < 300) {
-      // SUCCESS! The file content is in request.responseText
-      // Persist the raw document so other functions in this file can access it.
-      documentLines = splitDocumentIntoLines(this.responseText || '');
-      checklistItems = ExtractItemsFromLines(documentLines);
-      listTitle = webdavUrl.split('/').pop() || 'Checklist';
-
-      sendItemsToWatch();
+  let gen = generation;
+  trace.begin('document');
+  let cached = docCache.get(webdavUrl);
+  if (cached) {
+    console.log('Showing cached document while revalidating');
+    showDocument(cached.body);
+  }
 
-      if (checklistItems.length === 0) {
-        console.log('No unchecked checklist items found.');
-        setStatus('All done!');
-      } else {
-        console.log('Unchecked items:');
-        checklistItems.forEach((it, idx) => console.log(`${idx + 1}: ${it}`));
-      }
+  docCache.revalidate(webdavUrl, username, appPassword, function (result, body, status) {
+    if (!transfer.isCurrent(gen)) return;
+    if (result === 'changed') {
+      showDocument(body);
+    } else if (result === 'unchanged') {
+      if (!cached) showDocument(body);
+      else setStatus(checklistItems.length === 0 ? 'All done!' : '');
+    } else if (cached) {
+      // Keep showing the cached list, it is better than nothing
+      idleStatus = status ? 'Load error: ' + status : 'Offline';
+      setStatus(idleStatus);
     } else {
-      // FAILED
-      console.log('Error reading file: ' + this.status + ' ' + this.responseText);
-      setStatus('Load error: ' + this.status);
+      setStatus(status ? 'Load error: ' + status : 'Network error!');
       resetState();
       sendItemsToWatch();
     }
-  };
+  });
+  console.log('Sent request');
+  setStatus('', PROGRESS_DOWNLOAD);
+}
 
-  request.onerror = function () {
-    console.log('Request failed!');
-    setStatus('Network error!');
-    resetState();
-    sendItemsToWatch();
-  };
+function showDocument(body) {
+  idleStatus = '';
+  // Persist the raw document so other functions in this file can access it.
+  documentText = body || '';
+  checklistItems = extractItems(documentText);
+  listTitle = webdavUrl.split('/').pop() || 'Checklist';
 
-  request.open('GET', webdavUrl, true, username, appPassword);
-  request.send();
-  console.log('Sent request');
-  setStatus('', true);
+  sendItemsToWatch();
+
+  if (checklistItems.length === 0) {
+    console.log('No unchecked checklist items found.');
+    setStatus('All done!');
+  } else {
+    console.log('Unchecked items:');
+    checklistItems.forEach((it, idx) => console.log(`${idx + 1}: ${it}`));
+  }
 }
 
+// Show the file picker from the stored folder index straight away (if there
+// is one), then bring the index up to date (see dav_index.js) and show the
+// picker again if the files changed.
 function listFolder() {
-  // Extract just the path portion of the URL so we can strip it from hrefs later.
-  // e.g. "https://host/remote.php/dav/files/user/folder/" -> "/remote.php/dav/files/user/folder/"
-  let folderPath = webdavUrl.replace(/^https?:\/\/[^\/]+/, '');
-  if (!folderPath.endsWith('/')) folderPath += '/';
-
-  let request = new XMLHttpRequest();
-
-  request.onload = function () {
-    console.log("PROPFIND status: " + this.status);
-    if (this.status === 207) {
-      // Split on <response> elements (namespace prefix varies) to correlate
-      // href and getlastmodified within the same entry
-      let blocks = this.responseText.split(/<[a-zA-Z0-9]*:?response[^>]*>/i).slice(1);
-      let files = [];
-
-      blocks.forEach(function (block) {
-        let hrefMatch = block.match(/<[a-zA-Z0-9]*:?href[^>]*>([^<]+)<\/[a-zA-Z0-9]*:?href>/i);
-        let modMatch  = block.match(/<[a-zA-Z0-9]*:?getlastmodified[^>]*>([^<]+)<\/[a-zA-Z0-9]*:?getlastmodified>/i);
-        if (!hrefMatch) return;
-
-        let href = hrefMatch[1].trim();
-        if (!href.endsWith('.md')) return;
-
-        let rel = href.startsWith(folderPath) ? href.slice(folderPath.length) : href;
-        let lastModified = modMatch ? new Date(modMatch[1].trim()).getTime() : 0;
-        files.push({ rel: rel, lastModified: lastModified });
-      });
+  let gen = generation;
+  trace.begin('folder');
+  let cached = davIndex.cachedFiles(webdavUrl);
+  if (cached) {
+    console.log('Showing cached folder index while refreshing');
+    showFilePicker(cached);
+  }
 
-      // Most recently modified first
-      files.sort(function (a, b) { return b.lastModified - a.lastModified; });
-      let relPaths = files.map(function (f) { return f.rel; });
-
-      console.log("Found " + relPaths.length + " markdown file(s):");
-      relPaths.forEach(function (f) { console.log(" - " + f); });
-
-      // Show the first few elements only.
-      // Everything else is too slow to upload to the watch and probably pointless anyway.
-      foundFiles = relPaths.slice(0, 30);
-      selectedFiles = new Set();
-      appMode = 'file-picker';
-
-      checklistItems = [{ name: 'Load', line: 0, checked: false }]
-        .concat(foundFiles.map(function (rel) {
-          return { name: decodeURIComponent(rel), line: 0, checked: false };
-        }));
-      // Unnamed section for the Load action, named section for the file list
-      let pickerSections = [
-        { title: '', item_count: 1 },
-        { title: 'Select files', item_count: foundFiles.length },
-      ];
-      sendMultiSectionToWatch(pickerSections, checklistItems);
+  davIndex.refresh(webdavUrl, username, appPassword, function (error, files) {
+    if (!transfer.isCurrent(gen)) return;
+    if (error) {
+      console.log('Listing folder failed: ' + error);
+      setStatus(error);
+      return;
+    }
+    if (!cached || JSON.stringify(files) !== JSON.stringify(cached)) {
+      showFilePicker(files);
     } else {
-      console.log("PROPFIND failed with status: " + this.status + " " + this.responseText);
+      setStatus('');
     }
-  };
+  });
+  console.log("Listing folder: " + webdavUrl);
+  setStatus('', PROGRESS_DOWNLOAD);
+}
 
-  request.onerror = function () {
-    console.log("PROPFIND request failed (network error)");
-    setStatus('Network error!');
-  };
+// `files` are { rel, etag, lastModified }, most recently modified first.
+function showFilePicker(files) {
+  let relPaths = files.map(function (f) { return f.rel; });
+  folderFiles = files;
+  console.log("Found " + relPaths.length + " markdown file(s)");
 
-  request.open('PROPFIND', webdavUrl, true, username, appPassword);
-  request.setRequestHeader('Depth', 'infinity');
-  request.setRequestHeader('Content-Type', 'application/xml; charset=utf-8');
-  request.send('<?xml version="1.0" encoding="utf-8"?><propfind xmlns="DAV:"><prop><resourcetype/><getcontenttype/><getlastmodified/></prop></propfind>');
-  console.log("Sent PROPFIND to: " + webdavUrl);
-  setStatus('', true);
+  // Keep what was selected in a previous version of the picker
+  let selectedPaths = [...selectedFiles].map(function (fileIdx) { return foundFiles[fileIdx]; });
+  foundFiles = relPaths;
+  selectedFiles = new Set();
+  selectedPaths.forEach(function (rel) {
+    let fileIdx = foundFiles.indexOf(rel);
+    if (fileIdx >= 0) selectedFiles.add(fileIdx);
+  });
+  appMode = 'file-picker';
+  idleStatus = '';
+
+  checklistItems = [
+    { name: 'Load', offset: -1, checked: false },
+    { name: 'All open tasks', offset: -1, checked: false },
+  ].concat(foundFiles.map(function (rel, fileIdx) {
+    return { name: decodeURIComponent(rel), offset: -1, checked: selectedFiles.has(fileIdx) };
+  }));
+  // Unnamed section for the actions, named section for the file list
+  let pickerSections = [
+    { title: '', item_count: PICKER_ACTIONS },
+    { title: 'Select files', item_count: foundFiles.length },
+  ];
+  sendMultiSectionToWatch(pickerSections, checklistItems);
 }
 
 Pebble.addEventListener('ready',
@@ -200,82 +233,126 @@ Pebble.addEventListener('ready',
   }
 );
 
-function splitDocumentIntoLines(doc) {
-  return doc.split(/\r?[\n]/);
+// Extract only the unchecked items (lines starting with: - [ ] ). Each item
+// remembers the offset of its checkbox in the document (see markdown.js).
+function extractItems(text) {
+  return trace.parse(() => markdown.scanItems(text)).map(item => {
+    return {
+      name: item.name,
+      offset: item.offset,
+      checked: false,
+    };
+  });
 }
 
-const ITEM_REGEX = /^\s*-\s\[\s\]\s*(.*)$/;
-
-// Parse the file and extract only unchecked items (lines starting with: - [ ] )
-// Split into lines and capture the item text after the '- [ ]' prefix
-function ExtractItemsFromLines(lines) {
-  let uncheckedItems = lines
-    .map((line, line_index) => {
-
-      const m = line.match(ITEM_REGEX);
-      return m ? { match: m[1].trim(), line: line_index } : null;
-    })
-    .filter(Boolean) // remove nulls/empty
-    .map(item => {
-      return {
-        name: item.match,
-        line: item.line,
-        checked: false,
-      };
-    });
+// Status for a list cut to `kept` of its `total` items, empty if all fit.
+function fitStatus(kept, total) {
+  return kept < total ? 'Only ' + kept + ' of ' + total + ' items fit' : '';
+}
 
-  return uncheckedItems;
+// What of a list the watch has room for: { sections, items, status }, with a
+// status saying so if anything was left out.
+function fitToWatch(sections, items) {
+  let fit = transfer.fitList(sections, items.length);
+  if (fit.items === items.length && fit.sections === sections.length) {
+    return { sections: sections, items: items, status: '' };
+  }
+  console.log('Watch has room for ' + fit.items + ' of ' + items.length + ' items');
+  return { sections: sections.slice(0, fit.sections), items: items.slice(0, fit.items),
+           status: fitStatus(fit.items, items.length) };
 }
 
-// Send items to the watch one-by-one using numeric keys.
-// We use keys: count, index, and item (string)
-// This is robust against AppMessage size limits and lets the C side
-// assemble items deterministically.
+// Send the list to the watch: first the total count and title once, then the
+// items themselves, packed into as few messages as the watch inbox allows
+// (see transfer.js). Nothing is sent if the watch already shows this exact
+// list from its cache, only the changes if it shows an older version, and
+// only the rest if it has the beginning of it from an interrupted transfer.
 function sendItemsToWatch() {
-  // First send the total count once. On success, stream items one-by-one.
-  let countPayload = {};
-  countPayload[keys.ITEMS_COUNT] = checklistItems.length;
-  countPayload[keys.LIST_TITLE] = listTitle;
-
-  Pebble.sendAppMessage(countPayload,
-    function () {
-      if (checklistItems.length > 0) {
-        sendNextItem(checklistItems, 0);
-      }
-    },
-    function (err) {
-      console.log('Send count failed: ' + JSON.stringify(err));
-      // retry the whole sequence after a short delay
-      setTimeout(function () { sendItemsToWatch(); }, 500);
+  let allItems = checklistItems;
+  // A document that failed to load is not worth a glance
+  let glance = documentText !== '';
+  let gen = generation;
+  resendList = sendItemsToWatch;
+
+  transfer.whenWatchReady(function () {
+    if (!transfer.isCurrent(gen)) return;
+    // Only known once the watch said how much memory it has
+    let fitted = fitToWatch([], allItems);
+    let items = fitted.items;
+    let hash = transfer.listHash(listTitle, [], items);
+    let shape = { title: listTitle, sections: [] };
+    sendStart = Date.now();
+    if (transfer.watchHasList(hash)) {
+      console.log('Watch already shows this list, skipping transfer');
+      transfer.prepareList(items, false, hash);
+      transfer.setWatchListHash(hash, shape);
+      listOnWatch();
+      if (items.length > 0) setStatus(idleStatus || fitted.status);
+      return;
     }
-  );
-}
 
-function sendNextItem(items, index) {
-  console.log(`Sending item at index ${index}`);
+    let diff = transfer.diffList(listTitle, [], items, hash);
+    if (diff) {
+      if (glance) diff[keys.LIST_GLANCE] = 1;
+      transfer.sendMessage(diff, 'list diff', function () {
+        listOnWatch();
+        if (items.length > 0) setStatus(idleStatus || fitted.status);
+      });
+      return;
+    }
 
-  if (index >= items.length) {
-    // We're done here...
-    setStatus('');
-    return;
-  }
+    let resumeAt = transfer.resumeIndex(hash);
+    let prepared = transfer.prepareList(items, false, hash);
+    let itemsSent = function () {
+      transfer.setWatchListHash(hash, shape);
+      listOnWatch();
+      setStatus(idleStatus || fitted.status);
+    };
+    if (resumeAt > 0) {
+      console.log('Watch has ' + resumeAt + ' items of this list, sending the rest');
+      sendResume(hash);
+      transfer.sendNewItems(resumeAt, itemsSent);
+      return;
+    }
+
+    let countPayload = {};
+    countPayload[keys.ITEMS_COUNT] = items.length;
+    countPayload[keys.LIST_TITLE] = listTitle;
+    countPayload[keys.LIST_HASH] = hash;
+    countPayload[keys.ITEMS_PAGE_BYTES] = prepared.pageBytes;
+    if (prepared.dict) countPayload[keys.LABEL_DICT] = prepared.dict;
+    if (glance) countPayload[keys.LIST_GLANCE] = 1;
+    if (items.length === 0) {
+      transfer.sendMessage(countPayload, 'list setup', function () {
+        transfer.setWatchListHash(hash, shape);
+        listOnWatch();
+      });
+      return;
+    }
+    // Queued with the items, so a failed send only repeats itself
+    countPayload[keys.SET_PROGRESSING] = PROGRESS_SENDING;
+    transfer.sendMessage(countPayload, 'list setup');
+    transfer.sendItems(itemsSent);
+  });
+}
 
+// Tell the watch the rest of the list it is receiving follows, in this
+// transfer's generation.
+function sendResume(hash) {
   let payload = {};
-  payload[keys.ITEMS_INDEX] = index;
-  payload[keys.ITEMS_ITEM] = items[index].name;
-  console.log(`Sending ${index} - ${items[index].name}`);
+  payload[keys.RESUME_HASH] = hash;
+  payload[keys.SET_PROGRESSING] = PROGRESS_SENDING;
+  transfer.sendMessage(payload, 'resume');
+}
 
-  Pebble.sendAppMessage(payload,
-    () => {
-      console.log('')
-      sendNextItem(items, index + 1);
-    },
-    (err) => {
-      console.log('Send failed for index ' + index + ': ' + JSON.stringify(err));
-      // retry this item after a short delay
-      setTimeout(function () { sendNextItem(items, index); }, 500);
-    }
-  );
+// The list sent last is on the watch now, toggles made on it before can be
+// applied.
+function listOnWatch() {
+  trace.listSent(Date.now() - sendStart);
+  listReady = true;
+  let toggles = pendingToggles;
+  pendingToggles = [];
+  toggles.forEach(applyToggle);
 }
 
 function setItemCheckedState(index, checked) {
@@ -285,127 +362,405 @@ function setItemCheckedState(index, checked) {
   }
 
   let item = checklistItems[index];
+  // Multi-file mode: only the owning file is touched and uploaded
+  let url = typeof item.fileIndex !== 'undefined' ? fileData[item.fileIndex].url : webdavUrl;
+  let text = textForUrl(url);
+  if (text === null && typeof item.fileIndex !== 'undefined' && fileData[item.fileIndex]) {
+    loadFileText(item.fileIndex, function () { setItemCheckedState(index, checked); });
+    return;
+  }
+  if (text === null) {
+    console.log('Document not loaded: ' + url);
+    return;
+  }
+  let edit = { offset: item.offset, name: item.name, checked: checked };
+  let updated = writeBack.applyEdit(text, edit);
+  if (updated === null) {
+    console.log('Item not found in document: ' + item.name);
+    return;
+  }
+  // Only the checkbox character changed, so all other offsets still hold
+  setTextForUrl(url, updated);
   item.checked = checked;
+  item.offset = edit.offset;
+  writeBack.queueEdit(url, edit);
+}
 
-  if (typeof item.fileIndex !== 'undefined') {
-    // Multi-file mode: update the owning file's lines and upload only that file
-    let file = fileData[item.fileIndex];
-    let line = file.lines[item.line];
-    file.lines[item.line] = checked
-      ? line.replace('- [ ]', '- [x]')
-      : line.replace('- [x]', '- [ ]');
-    uploadFile(file.url, file.lines.join('\n'));
-  } else {
-    // Single-file mode
-    let line = documentLines[item.line];
-    documentLines[item.line] = checked
-      ? line.replace('- [ ]', '- [x]')
-      : line.replace('- [x]', '- [ ]');
-    uploadFile(webdavUrl, documentLines.join('\n'));
+// Files of the task list are only downloaded once one of their items is
+// checked off; toggles until then wait for it.
+function loadFileText(fileIndex, onLoaded) {
+  let file = fileData[fileIndex];
+  if (file.waiting) {
+    file.waiting.push(onLoaded);
+    return;
   }
+  file.waiting = [onLoaded];
+  docCache.revalidate(file.url, username, appPassword, function (result, body, status) {
+    let waiting = file.waiting;
+    file.waiting = null;
+    // Another list replaced this one meanwhile
+    if (fileData[fileIndex] !== file) return;
+    if (result === 'error') {
+      setStatus(status ? 'Load error: ' + status : 'Network error!');
+      return;
+    }
+    file.text = body;
+    waiting.forEach(function (callback) { callback(); });
+  });
 }
 
-function uploadFile(url, content) {
-  let request = new XMLHttpRequest();
-  request.onload = function () {
-    if (this.status >= 200 && this.status < 300) {
-      console.log('Successfully updated: ' + url);
-      setStatus('');
-    } else {
-      console.log('Error updating file: ' + this.status);
-      setStatus('Upload err: ' + this.status);
-    }
-  };
-  request.onerror = function () {
-    setStatus('Upload error!');
-  };
-  request.open('PUT', url, true, username, appPassword);
-  request.setRequestHeader('Content-Type', 'text/markdown');
-  request.send(content);
-  setStatus('', true);
+// Index into fileData of the document at `url`, -1 for the single document
+// of checklist mode, or null if it is not loaded.
+function fileIndexForUrl(url) {
+  if (fileData.length === 0) {
+    return url === webdavUrl ? -1 : null;
+  }
+  let fileIndex = fileData.findIndex(function (f) { return f && f.url === url; });
+  return fileIndex >= 0 ? fileIndex : null;
+}
+
+function textForUrl(url) {
+  let fileIndex = fileIndexForUrl(url);
+  if (fileIndex === null) return null;
+  return fileIndex < 0 ? documentText : fileData[fileIndex].text;
 }
 
+function setTextForUrl(url, text) {
+  let fileIndex = fileIndexForUrl(url);
+  if (fileIndex === null) return;
+  if (fileIndex < 0) documentText = text;
+  else fileData[fileIndex].text = text;
+}
+
+// The server had a newer version of a document, which write_back merged our
+// edits into. Point the items at their new offsets.
+function rebaseDocument(url, text) {
+  let fileIndex = fileIndexForUrl(url);
+  if (fileIndex === null) return;
+  setTextForUrl(url, text);
+
+  let scanned = markdown.scanItems(text, true);
+  checklistItems.forEach(function (item) {
+    let itemFile = typeof item.fileIndex !== 'undefined' ? item.fileIndex : -1;
+    if (itemFile !== fileIndex) return;
+    item.offset = markdown.findItem(text, item.name, item.offset, scanned);
+  });
+}
+
+writeBack.init({
+  credentials: function () { return { username: username, password: appPassword }; },
+  getText: textForUrl,
+  rebase: rebaseDocument,
+  setStatus: setStatus,
+});
+
+// Download the selected files in parallel. Each file becomes a section of the
+// list, sent to the watch as soon as it and all files before it are in, so the
+// first one can be read while the rest are still loading. Files that fail to
+// load show up as an error section. If every file is cached the whole list is
+// shown right away instead, and only sent again if something changed.
 function loadSelectedFiles() {
   let fileIndices = [...selectedFiles];
   if (fileIndices.length === 0) {
     setStatus('No files!');
     return;
   }
+  // The picker list may still be streaming, it stops here
+  let gen = generation = transfer.begin();
+  trace.begin('files');
+
+  setStatus('', PROGRESS_DOWNLOAD);
+  let urls = fileIndices.map(function (fileIdx) { return webdavUrl + foundFiles[fileIdx]; });
+  let cachedBodies = urls.map(function (url) {
+    let cached = docCache.get(url);
+    return cached ? cached.body : null;
+  });
+  let shownFromCache = cachedBodies.every(function (body) { return body !== null; });
+  if (shownFromCache) {
+    console.log('Showing cached files while revalidating');
+    showSelectedFiles(fileIndices, cachedBodies);
+  }
+
+  let bodies = [];
+  let changed = false;
+  let errorStatus = '';
+  let stream = { sections: [], items: [], files: [], total: 0 };
+
+  function fetchFile(pos, done) {
+    // Files not requested yet when a newer load began are skipped
+    if (!transfer.isCurrent(gen)) {
+      done({ result: 'stale' });
+      return;
+    }
+    docCache.revalidate(urls[pos], username, appPassword, function (result, body, status) {
+      done({ result: result, body: body, status: status });
+    });
+  }
+
+  function fileLoaded(pos, file) {
+    if (!transfer.isCurrent(gen)) return;
+    let body = file.body;
+    let failure = '';
+    if (file.result === 'error') {
+      errorStatus = file.status ? 'Load error: ' + file.status : 'Network error!';
+      failure = file.status ? String(file.status) : 'offline';
+      body = cachedBodies[pos];
+    } else {
+      if (file.result === 'changed') changed = true;
+      let cached = docCache.get(urls[pos]);
+      taskIndex.update(webdavUrl, foundFiles[fileIndices[pos]], cached && cached.etag, body);
+    }
+    bodies[pos] = body;
+    if (!shownFromCache) {
+      let file = parseSelectedFile(fileIndices[pos], pos, body, failure);
+      streamSection(stream, file, pos === fileIndices.length - 1);
+    }
+  }
 
-  setStatus('', true);
+  function allLoaded() {
+    if (!transfer.isCurrent(gen)) return;
+    if (shownFromCache && changed) showSelectedFiles(fileIndices, bodies);
+    idleStatus = errorStatus;
+    // Otherwise the status is cleared once the list is on the watch
+    if (shownFromCache && !changed) {
+      setStatus(errorStatus || (checklistItems.length === 0 ? 'All done!' : ''));
+    }
+  }
+
+  let start = function () {
+    if (!transfer.isCurrent(gen)) return;
+    fetchPool.run(urls.length, FETCH_CONCURRENCY, fetchFile, fileLoaded, allLoaded);
+  };
+  // Streaming needs the watch's geometry before the first section goes out
+  if (shownFromCache) start();
+  else transfer.whenWatchReady(start);
+}
+
+// All open tasks of the folder in one list, a section per file that has any.
+// Shown from the task index straight away if it knows anything, then the
+// files whose ETag changed since they were indexed are downloaded and the list
+// is sent again if their tasks changed. With a fresh index nothing is
+// requested at all.
+function showAllTasks() {
+  let gen = generation = transfer.begin();
+  trace.begin('tasks');
+  let files = folderFiles;
+  let stale = taskIndex.staleFiles(webdavUrl, files);
+  console.log('All open tasks: ' + stale.length + ' of ' + files.length + ' file(s) to read');
+  if (stale.length < files.length || stale.length === 0) showTaskList(files);
+  if (stale.length === 0) return;
+
+  setStatus('', PROGRESS_DOWNLOAD);
+  taskIndex.refresh(webdavUrl, stale, username, appPassword, function (error, changed) {
+    if (!transfer.isCurrent(gen)) return;
+    if (changed > 0 || stale.length === files.length) {
+      showTaskList(files);
+      idleStatus = error || '';
+      if (error && checklistItems.length === 0) setStatus(error);
+    } else {
+      setStatus(error || (checklistItems.length === 0 ? 'All done!' : ''));
+    }
+  });
+}
+
+// Send what the task index has for `files`. The files themselves are only
+// downloaded when an item of them is checked off, see loadFileText().
+function showTaskList(files) {
+  idleStatus = '';
   fileData = [];
   checklistItems = [];
   let sections = [];
 
-  function fetchNext(pos) {
-    if (pos >= fileIndices.length) {
-      appMode = 'checklist';
-      if (checklistItems.length === 0) {
-        setStatus('All done!');
-      }
-      sendMultiSectionToWatch(sections, checklistItems);
-      return;
-    }
+  taskIndex.lookup(webdavUrl, files).forEach(function (file) {
+    if (file.items.length === 0) return;
+    let pos = fileData.length;
+    fileData.push({ url: webdavUrl + file.rel, text: null });
+    let title = decodeURIComponent(file.rel).replace(/\.md$/i, '');
+    sections.push({ title: title, item_count: file.items.length });
+    checklistItems = checklistItems.concat(file.items.map(function (item) {
+      return { name: item.name, offset: item.offset, checked: false, fileIndex: pos };
+    }));
+  });
 
-    let relPath = foundFiles[fileIndices[pos]];
-    let url = webdavUrl + relPath;
-    let request = new XMLHttpRequest();
-
-    request.onload = function () {
-      if (this.status >= 200 && this.status < 300) {
-        let lines = splitDocumentIntoLines(this.responseText || '');
-        let items = ExtractItemsFromLines(lines).map(function (item) {
-          return { name: item.name, line: item.line, checked: false, fileIndex: pos };
-        });
-        fileData.push({ url: url, lines: lines });
-        sections.push({ title: decodeURIComponent(relPath).replace(/\.md$/i, ''), item_count: items.length });
-        for (let i = 0; i < items.length; i++) checklistItems.push(items[i]);
-        fetchNext(pos + 1);
-      } else {
-        console.log('Error fetching ' + url + ': ' + this.status);
-        setStatus('Load error: ' + this.status);
-      }
+  appMode = 'checklist';
+  if (checklistItems.length === 0) {
+    setStatus('All done!');
+  }
+  sendMultiSectionToWatch(sections, checklistItems);
+}
+
+// Turn a downloaded file into a section. `body` is null if it failed to load,
+// `failure` then says why.
+function parseSelectedFile(fileIdx, pos, body, failure) {
+  let relPath = foundFiles[fileIdx];
+  let title = decodeURIComponent(relPath).replace(/\.md$/i, '');
+  if (body === null || body === undefined) {
+    return {
+      section: { title: '[' + (failure || 'error') + '] ' + title, item_count: 0 },
+      items: [],
+      file: null,
     };
-    request.onerror = function () { setStatus('Network error!'); };
-    request.open('GET', url, true, username, appPassword);
-    request.send();
   }
 
-  fetchNext(0);
+  let items = extractItems(body).map(function (item) {
+    item.fileIndex = pos;
+    return item;
+  });
+  return {
+    section: { title: title, item_count: items.length },
+    items: items,
+    file: { url: webdavUrl + relPath, text: body },
+  };
 }
 
-function sendMultiSectionToWatch(sections, items) {
-  let setupPayload = {};
-  setupPayload[keys.ITEMS_COUNT] = items.length;
-  setupPayload[keys.SECTION_COUNT] = sections.length;
-
-  Pebble.sendAppMessage(setupPayload,
-    function () { sendNextSection(sections, items, 0); },
-    function (err) {
-      console.log('Setup send failed: ' + JSON.stringify(err));
-      setTimeout(function () { sendMultiSectionToWatch(sections, items); }, 500);
-    }
-  );
+function showSelectedFiles(fileIndices, bodies) {
+  idleStatus = '';
+  fileData = [];
+  checklistItems = [];
+  let sections = [];
+
+  fileIndices.forEach(function (fileIdx, pos) {
+    let file = parseSelectedFile(fileIdx, pos, bodies[pos], '');
+    fileData.push(file.file);
+    sections.push(file.section);
+    checklistItems = checklistItems.concat(file.items);
+  });
+
+  appMode = 'checklist';
+  if (checklistItems.length === 0) {
+    setStatus('All done!');
+  }
+  sendMultiSectionToWatch(sections, checklistItems);
 }
 
-function sendNextSection(sections, items, index) {
-  if (index >= sections.length) {
-    if (items.length > 0) sendNextItem(items, 0);
+// Add one more file's section to the list on the watch. The first section
+// starts a new list, later ones grow it (LIST_APPEND). Only the final setup
+// message carries the list hash, so the watch caches just the complete list.
+function streamSection(stream, file, last) {
+  let first = stream.items.length;
+  let index = stream.sections.length;
+  // Files the watch has no room for are left out, the last one still ends the
+  // list. Items keep pointing at their file by position.
+  let fits = index === 0 ||
+    transfer.fitList(stream.sections.concat([file.section]), first + file.items.length).sections > index;
+  stream.total += file.items.length;
+  stream.files = stream.files.concat([file.file]);
+  if (fits) {
+    stream.sections = stream.sections.concat([file.section]);
+    stream.items = stream.items.concat(file.items);
+  } else if (!last) {
     return;
   }
 
-  let payload = {};
-  payload[keys.SECTION_INDEX] = index;
-  payload[keys.SECTION_TITLE] = sections[index].title;
-  payload[keys.SECTION_ITEM_COUNT] = sections[index].item_count;
+  // Items can be toggled as soon as they are on the watch
+  appMode = 'checklist';
+  idleStatus = '';
+  checklistItems = stream.items;
+  fileData = stream.files;
 
-  Pebble.sendAppMessage(payload,
-    function () { sendNextSection(sections, items, index + 1); },
-    function (err) {
-      console.log('Section send failed: ' + JSON.stringify(err));
-      setTimeout(function () { sendNextSection(sections, items, index); }, 500);
+  if (index === 0) sendStart = Date.now();
+  let prepared = index === 0
+    ? transfer.prepareList(stream.items, !last)
+    : transfer.extendList(stream.items);
+  let hash = transfer.listHash('', stream.sections, stream.items);
+
+  let setupPayload = {};
+  setupPayload[keys.ITEMS_COUNT] = stream.items.length;
+  setupPayload[keys.SECTION_COUNT] = stream.sections.length;
+  setupPayload[keys.SECTION_TITLE_BYTES] = transfer.sectionTitleBytes(stream.sections);
+  setupPayload[keys.ITEMS_PAGE_BYTES] = prepared.pageBytes;
+  if (prepared.dict) setupPayload[keys.LABEL_DICT] = prepared.dict;
+  if (index > 0) setupPayload[keys.LIST_APPEND] = 1;
+  else setupPayload[keys.LIST_GLANCE] = 1;
+  if (last) setupPayload[keys.LIST_HASH] = hash;
+  setupPayload[keys.SET_PROGRESSING] = PROGRESS_SENDING;
+  // The new file's section header goes with the setup
+  let headers = fits ? transfer.addSectionHeaders(setupPayload, stream.sections, index) : [];
+  transfer.sendMessage(setupPayload, 'list setup');
+  headers.forEach(function (payload) { transfer.sendMessage(payload, 'section headers'); });
+
+  if (last) {
+    resendList = function () { sendMultiSectionToWatch(stream.sections, stream.items); };
+  }
+  transfer.sendNewItems(first, function () {
+    if (!last) return;
+    transfer.setWatchListHash(hash, { title: '', sections: stream.sections });
+    listOnWatch();
+    let status = idleStatus || fitStatus(stream.items.length, stream.total);
+    setStatus(stream.items.length === 0 ? 'All done!' : status);
+  });
+}
+
+function sendMultiSectionToWatch(allSections, allItems) {
+  // Task lists go on the app glance, the file picker does not
+  let glance = appMode === 'checklist';
+  let gen = generation;
+  resendList = function () { sendMultiSectionToWatch(allSections, allItems); };
+
+  transfer.whenWatchReady(function () {
+    if (!transfer.isCurrent(gen)) return;
+    let fitted = fitToWatch(allSections, allItems);
+    let sections = fitted.sections;
+    let items = fitted.items;
+    let hash = transfer.listHash('', sections, items);
+    sendStart = Date.now();
+    if (transfer.watchHasList(hash)) {
+      console.log('Watch already shows this list, skipping transfer');
+      transfer.prepareList(items, false, hash);
+      transfer.setWatchListHash(hash, { title: '', sections: sections });
+      listOnWatch();
+      if (items.length > 0) setStatus(idleStatus || fitted.status);
+      return;
     }
-  );
+
+    let diff = transfer.diffList('', sections, items, hash);
+    if (diff) {
+      if (glance) diff[keys.LIST_GLANCE] = 1;
+      transfer.sendMessage(diff, 'list diff', function () {
+        listOnWatch();
+        if (items.length > 0) setStatus(idleStatus || fitted.status);
+      });
+      return;
+    }
+
+    let shape = { title: '', sections: sections };
+    let resumeAt = transfer.resumeIndex(hash);
+    let prepared = transfer.prepareList(items, false, hash);
+    let itemsSent = function () {
+      transfer.setWatchListHash(hash, shape);
+      listOnWatch();
+      setStatus(idleStatus || fitted.status);
+    };
+    if (resumeAt > 0) {
+      // The sections went out before the first item did
+      console.log('Watch has ' + resumeAt + ' items of this list, sending the rest');
+      sendResume(hash);
+      transfer.sendNewItems(resumeAt, itemsSent);
+      return;
+    }
+
+    let setupPayload = {};
+    setupPayload[keys.ITEMS_COUNT] = items.length;
+    setupPayload[keys.SECTION_COUNT] = sections.length;
+    setupPayload[keys.SECTION_TITLE_BYTES] = transfer.sectionTitleBytes(sections);
+    setupPayload[keys.LIST_HASH] = hash;
+    setupPayload[keys.ITEMS_PAGE_BYTES] = prepared.pageBytes;
+    if (prepared.dict) setupPayload[keys.LABEL_DICT] = prepared.dict;
+    if (glance) setupPayload[keys.LIST_GLANCE] = 1;
+    setupPayload[keys.SET_PROGRESSING] = PROGRESS_SENDING;
+    // All section headers go with the setup, as far as they fit
+    let headers = transfer.addSectionHeaders(setupPayload, sections, 0);
+    transfer.sendMessage(setupPayload, 'list setup');
+    headers.forEach(function (payload) { transfer.sendMessage(payload, 'section headers'); });
+    if (items.length === 0) {
+      transfer.whenSent(function () {
+        transfer.setWatchListHash(hash, shape);
+        listOnWatch();
+      });
+      return;
+    }
+    transfer.sendItems(itemsSent);
+  });
 }
 
 // Listen for messages from the watch (item actions) and log them.
@@ -420,52 +775,124 @@ Pebble.addEventListener('appmessage', function (e) {
       return null;
     };
 
+    // Comes on its own or along with other messages, which are handled as usual
+    let telemetry = retrieve("TELEMETRY");
+    if (telemetry != null) trace.watchTelemetry(telemetry);
+
+    let inboxSize = retrieve("WATCH_INBOX_SIZE");
+    if (inboxSize != null) {
+      let resumeHash = retrieve("RESUME_HASH");
+      let lost = transfer.setWatchInfo(inboxSize, retrieve("CACHED_LIST_HASH") || 0, {
+        pageSize: retrieve("WATCH_PAGE_SIZE"),
+        windowPages: retrieve("WATCH_WINDOW_PAGES"),
+        poolBudget: retrieve("WATCH_POOL_BUDGET"),
+        heapBudget: retrieve("WATCH_HEAP_BUDGET"),
+      }, resumeHash == null ? null : { hash: resumeHash, index: retrieve("RESUME_INDEX") || 0 });
+      if (lost && resendList) {
+        console.log('Watch lost the list, sending it again');
+        resendList();
+      }
+      return;
+    }
+
+    let requestedPage = retrieve("REQUEST_PAGE");
+    if (requestedPage != null) {
+      console.log('Watch requested page ' + requestedPage);
+      transfer.sendPage(requestedPage);
+      return;
+    }
+
+    let toggles = decodeToggles(retrieve("ITEM_TOGGLES"), retrieve("TOGGLES_LIST_HASH") || 0);
+    // Sent right away by older watch apps, about the list on screen
     let checked = retrieve("ITEM_CHECKED");
     let unchecked = retrieve("ITEM_UNCHECKED");
+    if (checked != null) toggles.push({ id: checked, checked: true });
+    if (unchecked != null) toggles.push({ id: unchecked, checked: false });
+    if (toggles.length === 0) {
+      console.log('Received unknown appmessage payload:', payload);
+      return;
+    }
+    if (!listReady) {
+      // Left in the watch's journal from before the app (re)started
+      console.log('Keeping ' + toggles.length + ' toggle(s) until the list is loaded');
+      pendingToggles = pendingToggles.concat(toggles);
+      return;
+    }
+    toggles.forEach(applyToggle);
+  } catch (ex) {
+    console.log('Error handling appmessage: ' + ex);
+  }
+});
 
-    if (appMode === 'file-picker') {
-      let idx = checked != null ? checked : unchecked;
-      let isChecked = checked != null;
-      if (idx === null) return;
 
-      if (idx === 0) {
-        // "→ Load" pressed
-        console.log('Load pressed with ' + selectedFiles.size + ' file(s) selected');
-        loadSelectedFiles();
-      } else {
-        // Toggle file selection (idx 1..N maps to foundFiles[idx-1])
-        let fileIdx = idx - 1;
-        if (isChecked) {
-          selectedFiles.add(fileIdx);
-          console.log('Selected file: ' + foundFiles[fileIdx]);
-        } else {
-          selectedFiles.delete(fileIdx);
-          console.log('Deselected file: ' + foundFiles[fileIdx]);
-        }
-      }
+// ITEM_TOGGLES from the watch's journal: uint16 item id, uint8 1 if checked.
+// `listHash` is the TOGGLES_LIST_HASH of the list they were made on.
+function decodeToggles(bytes, listHash) {
+  let toggles = [];
+  if (!bytes) return toggles;
+  for (let pos = 0; pos + 3 <= bytes.length; pos += 3) {
+    toggles.push({ id: bytes[pos] | (bytes[pos + 1] << 8), checked: bytes[pos + 2] !== 0,
+                   listHash: listHash });
+  }
+  return toggles;
+}
+
+// The watch names items by id, which may differ from their index once the
+// list was changed by a diff. Ids of a list that has been replaced since
+// (another file, the picker, the same file sent afresh) name other items or
+// none, such toggles are dropped.
+function applyToggle(toggle) {
+  if ('listHash' in toggle && !transfer.idsValidFor(toggle.listHash)) {
+    console.log('Dropping toggle of item ' + toggle.id + ', it was made on another list');
+    return;
+  }
+  let idx = transfer.indexOfId(toggle.id);
+  if (appMode === 'file-picker') {
+    if (idx < 0) return;
+
+    if (idx === 0) {
+      // "→ Load" pressed
+      console.log('Load pressed with ' + selectedFiles.size + ' file(s) selected');
+      loadSelectedFiles();
+    } else if (idx === 1) {
+      console.log('All open tasks pressed');
+      showAllTasks();
     } else {
-      if (checked != null) {
-        console.log('Received item CHECKED from watch: index=', checked);
-        setItemCheckedState(checked, true);
-      } else if (unchecked != null) {
-        console.log('Received item UNCHECKED from watch: index=', unchecked);
-        setItemCheckedState(unchecked, false);
+      // Toggle file selection (rows from PICKER_ACTIONS on are foundFiles)
+      let fileIdx = idx - PICKER_ACTIONS;
+      checklistItems[idx].checked = toggle.checked;
+      if (toggle.checked) {
+        selectedFiles.add(fileIdx);
+        console.log('Selected file: ' + foundFiles[fileIdx]);
       } else {
-        console.log('Received unknown appmessage payload:', payload);
+        selectedFiles.delete(fileIdx);
+        console.log('Deselected file: ' + foundFiles[fileIdx]);
       }
     }
-  } catch (ex) {
-    console.log('Error handling appmessage: ' + ex);
+  } else {
+    console.log('Received item ' + (toggle.checked ? 'CHECKED' : 'UNCHECKED') + ' from watch: index=', idx);
+    setItemCheckedState(idx, toggle.checked);
   }
-});
+}
 
+// The watch keeps the glance refresh setting itself, it schedules the
+// refreshes.
+function sendGlanceRefresh(enabled) {
+  let payload = {};
+  payload[keys.CONFIG_GLANCE_REFRESH] = enabled ? 1 : 0;
+  Pebble.sendAppMessage(payload,
+    function () { },
+    function (err) { console.log('Glance setting send failed: ' + JSON.stringify(err)); }
+  );
+}
 
 // Send a short status message to the watch. Kept short to fit the UI.
+// `progressing` is true (busy) or one of the PROGRESS_ values.
 function setStatus(text, progressing = false) {
   try {
     var payload = {};
     payload[keys.SET_STATUS] = text || '';
-    payload[keys.SET_PROGRESSING] = progressing ? 1 : 0;
+    payload[keys.SET_PROGRESSING] = progressing === true ? PROGRESS_BUSY : (progressing || 0);
 
     Pebble.sendAppMessage(payload,
       function () { },
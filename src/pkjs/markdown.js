@@ -0,0 +1,72 @@
+// Finds checklist items in a markdown document in a single pass, without
+// splitting it into lines.
+//
+// Documents are kept as their original text. An item is located by the offset
+// of its checkbox mark (the character between the brackets of "- [ ]"), so
+// checking or unchecking it replaces exactly that character: every other
+// offset stays valid and the file keeps its line endings (LF or CRLF).
+
+function isBlank(c) {
+  return c === ' ' || c === '\t';
+}
+
+// Parse text[start, end) as a checklist item: optional indentation, "- [ ]"
+// or "- [x]", then the label. Returns { name, offset, checked } or null.
+function itemAt(text, start, end) {
+  let i = start;
+  while (i < end && isBlank(text[i])) i++;
+  if (i + 5 > end || text[i] !== '-' || !isBlank(text[i + 1])
+      || text[i + 2] !== '[' || text[i + 4] !== ']') {
+    return null;
+  }
+  let mark = text[i + 3];
+  let checked = mark === 'x' || mark === 'X';
+  if (!checked && !isBlank(mark)) return null;
+  // trim() also drops the \r of CRLF lines
+  return { name: text.slice(i + 5, end).trim(), offset: i + 3, checked: checked };
+}
+
+// All unchecked items of a document, or all items if `includeChecked`.
+function scanItems(text, includeChecked) {
+  let items = [];
+  let start = 0;
+  while (start < text.length) {
+    let end = text.indexOf('\n', start);
+    if (end < 0) end = text.length;
+    let item = itemAt(text, start, end);
+    if (item && (includeChecked || !item.checked)) items.push(item);
+    start = end + 1;
+  }
+  return items;
+}
+
+// Offset of the checkbox of item `name`: `hint` (its last known offset) if
+// the item is still there, otherwise the closest item with the same name, or
+// -1 if it is gone. Pass `scanned` (scanItems(text, true)) when looking up
+// many items in the same text.
+function findItem(text, name, hint, scanned) {
+  if (hint >= 0 && hint < text.length) {
+    let start = hint > 0 ? text.lastIndexOf('\n', hint - 1) + 1 : 0;
+    let end = text.indexOf('\n', hint);
+    let item = itemAt(text, start, end < 0 ? text.length : end);
+    if (item && item.offset === hint && item.name === name) return hint;
+  }
+
+  let best = -1;
+  (scanned || scanItems(text, true)).forEach(function (item) {
+    if (item.name !== name) return;
+    if (best < 0 || Math.abs(item.offset - hint) < Math.abs(best - hint)) best = item.offset;
+  });
+  return best;
+}
+
+// The text with the checkbox at `offset` set or cleared.
+function setChecked(text, offset, checked) {
+  return text.slice(0, offset) + (checked ? 'x' : ' ') + text.slice(offset + 1);
+}
+
+module.exports = {
+  scanItems: scanItems,
+  findItem: findItem,
+  setChecked: setChecked,
+};
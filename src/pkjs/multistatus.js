@@ -0,0 +1,120 @@
+// Streaming parser for WebDAV multistatus (PROPFIND) responses.
+//
+// The XML is consumed chunk by chunk as it arrives and never split or matched
+// as a whole. Only what the directory index needs is extracted; for each
+// <response> element the callback gets
+//   { href, etag, lastModified, collection }
+// Namespace prefixes are ignored (everything of interest is in DAV:).
+//
+//   let parser = multistatus.createParser(function (response) { ... });
+//   parser.feed(chunk); ... parser.end();
+
+const ENTITIES = { amp: '&', lt: '<', gt: '>', quot: '"', apos: "'" };
+
+function decodeEntities(text) {
+  return text.replace(/&(#x[0-9a-fA-F]+|#[0-9]+|[a-z]+);/g, function (match, name) {
+    if (name[0] === '#') {
+      let code = name[1] === 'x' ? parseInt(name.slice(2), 16) : parseInt(name.slice(1), 10);
+      return String.fromCodePoint(code);
+    }
+    return ENTITIES[name] || match;
+  });
+}
+
+function localName(tag) {
+  let end = tag.search(/[\s\/]/);
+  let name = end < 0 ? tag : tag.slice(0, end);
+  return name.slice(name.indexOf(':') + 1).toLowerCase();
+}
+
+function createParser(onResponse) {
+  let buffer = '';
+  let text = '';
+  let response = null;
+
+  function open(name) {
+    text = '';
+    if (name === 'response') {
+      response = { href: '', etag: null, lastModified: 0, collection: false };
+    } else if (name === 'collection' && response) {
+      response.collection = true;
+    }
+  }
+
+  function close(name) {
+    if (!response) return;
+    let value = decodeEntities(text).trim();
+    if (name === 'href') {
+      response.href = value;
+    } else if (name === 'getetag') {
+      response.etag = value || null;
+    } else if (name === 'getlastmodified') {
+      response.lastModified = value ? new Date(value).getTime() || 0 : 0;
+    } else if (name === 'response') {
+      onResponse(response);
+      response = null;
+    }
+    text = '';
+  }
+
+  // Handle everything complete in the buffer, keep an unfinished tag for
+  // the next chunk.
+  function parse() {
+    let pos = 0;
+    while (pos < buffer.length) {
+      let lt = buffer.indexOf('<', pos);
+      if (lt < 0) {
+        text += buffer.slice(pos);
+        pos = buffer.length;
+        break;
+      }
+      text += buffer.slice(pos, lt);
+      pos = lt;
+
+      let end;
+      if (buffer.startsWith('<!--', lt)) {
+        end = buffer.indexOf('-->', lt);
+        if (end < 0) break;
+        pos = end + 3;
+        continue;
+      }
+      if (buffer.startsWith('<![CDATA[', lt)) {
+        end = buffer.indexOf(']]>', lt);
+        if (end < 0) break;
+        // Raw text, escape it so decodeEntities() leaves it alone
+        text += buffer.slice(lt + 9, end).replace(/&/g, '&amp;');
+        pos = end + 3;
+        continue;
+      }
+      end = buffer.indexOf('>', lt);
+      if (end < 0) break;
+      let tag = buffer.slice(lt + 1, end);
+      pos = end + 1;
+
+      if (tag[0] === '?' || tag[0] === '!') continue;
+      if (tag[0] === '/') {
+        close(localName(tag.slice(1)));
+      } else {
+        let name = localName(tag);
+        open(name);
+        if (tag[tag.length - 1] === '/') close(name);
+      }
+    }
+    buffer = buffer.slice(pos);
+  }
+
+  return {
+    feed: function (chunk) {
+      buffer += chunk;
+      parse();
+    },
+    end: function () {
+      parse();
+      buffer = '';
+    },
+  };
+}
+
+module.exports = {
+  createParser: createParser,
+};
@@ -0,0 +1,120 @@
+const docCache = require('./doc_cache');
+const fetchPool = require('./fetch_pool');
+const markdown = require('./markdown');
+const trace = require('./trace');
+
+// Phone-side index of the open tasks in every markdown file below the
+// configured folder, for the "All open tasks" list.
+//
+// Each file's unchecked items are kept in localStorage with the ETag the
+// file had when they were read. The folder index (dav_index.js) knows every
+// file's current ETag, so only files whose ETag differs are downloaded and
+// parsed again; if none does, the list needs no request at all. Files the
+// server sends no ETag for are always read again (a conditional GET through
+// doc_cache.js, so mostly a 304).
+
+const STORAGE_PREFIX = 'TASK_INDEX:';
+// Files downloaded at the same time
+const CONCURRENCY = 3;
+
+// Stored per root URL:
+//   { files: { rel: { etag, items: [{ name, offset }] } } }
+function load(rootUrl) {
+  try {
+    let index = JSON.parse(localStorage.getItem(STORAGE_PREFIX + rootUrl) || 'null');
+    return index && index.files ? index : { files: {} };
+  } catch (ex) {
+    console.log('Dropping unreadable task index for ' + rootUrl);
+    return { files: {} };
+  }
+}
+
+function save(rootUrl, index) {
+  try {
+    localStorage.setItem(STORAGE_PREFIX + rootUrl, JSON.stringify(index));
+  } catch (ex) {
+    console.log('Could not store task index: ' + ex);
+  }
+}
+
+function isFresh(entry, file) {
+  return !!(entry && file.etag && entry.etag === file.etag);
+}
+
+// Files of `files` (as listed by dav_index.js) the index has no current
+// tasks for.
+function staleFiles(rootUrl, files) {
+  let index = load(rootUrl);
+  return files.filter(function (file) { return !isFresh(index.files[file.rel], file); });
+}
+
+// The open tasks of `files` as far as the index knows them, in the same
+// order: { rel, items: [{ name, offset }], fresh }. Files that are gone from
+// the folder are dropped from the index.
+function lookup(rootUrl, files) {
+  let index = load(rootUrl);
+  let kept = {};
+  let result = files.map(function (file) {
+    let entry = index.files[file.rel];
+    if (entry) kept[file.rel] = entry;
+    return { rel: file.rel, items: entry ? entry.items : [], fresh: isFresh(entry, file) };
+  });
+  if (Object.keys(kept).length !== Object.keys(index.files).length) save(rootUrl, { files: kept });
+  return result;
+}
+
+function tasksOf(body) {
+  return trace.parse(function () {
+    return markdown.scanItems(body).map(function (item) {
+      return { name: item.name, offset: item.offset };
+    });
+  });
+}
+
+// Record the open tasks of file `rel`, read from `body` which had ETag `etag`.
+function update(rootUrl, rel, etag, body) {
+  let index = load(rootUrl);
+  index.files[rel] = { etag: etag || null, items: tasksOf(body) };
+  save(rootUrl, index);
+}
+
+// Download the `files` the index is stale for and record their tasks. Calls
+// onDone(error, changed) once all are done; `changed` is the number of files
+// whose tasks differ from what the index had. Files that fail to load keep
+// their old entry and make `error` the last failure.
+function refresh(rootUrl, files, user, pass, onDone) {
+  let index = load(rootUrl);
+  let error = null;
+  let changed = 0;
+
+  function fetchFile(pos, done) {
+    docCache.revalidate(rootUrl + files[pos].rel, user, pass, function (result, body, status) {
+      done({ result: result, body: body, status: status });
+    });
+  }
+
+  function fileLoaded(pos, loaded) {
+    let file = files[pos];
+    if (loaded.result === 'error') {
+      error = loaded.status ? 'Load error: ' + loaded.status : 'Network error!';
+      return;
+    }
+    let items = tasksOf(loaded.body);
+    let old = index.files[file.rel];
+    if (!old || JSON.stringify(old.items) !== JSON.stringify(items)) changed++;
+    index.files[file.rel] = { etag: file.etag || null, items: items };
+  }
+
+  fetchPool.run(files.length, CONCURRENCY, fetchFile, fileLoaded, function () {
+    save(rootUrl, index);
+    console.log('Task index: read ' + files.length + ' file(s), ' + changed + ' changed');
+    onDone(error, changed);
+  });
+}
+
+module.exports = {
+  staleFiles: staleFiles,
+  lookup: lookup,
+  update: update,
+  refresh: refresh,
+};
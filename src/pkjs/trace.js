@@ -0,0 +1,130 @@
+// Timings of the companion's part in getting a list onto the watch, logged
+// together with the TELEMETRY the watch sends back so one line covers the
+// whole pipeline:
+//
+//   Trace document: http 1/1 req 2.7 KB 412 ms, parse 3 ms, send 806 ms |
+//   watch: first item 1210 ms, first screen 1212 ms, list 1260 ms, 80 items, ...
+//
+// begin() starts a new trace when a list is requested, HTTP requests and
+// parsing add to it until the next begin(). listSent() logs it whenever a list
+// (say the cached one, then the downloaded one) reached the watch. The watch's
+// telemetry arrives later (with the next toggle or page request) and is
+// paired with the list sent last.
+
+// TELEMETRY blob layout, see telemetry.h on the watch
+const TELEMETRY_VERSION = 2;
+const TELEMETRY_SIZE = 31;
+const NO_TIME = 0xffffffff;
+
+let current = null;
+let sent = null;
+
+function newTrace(name) {
+  return { name: name, start: Date.now(), requests: 0, responses: 0, httpBytes: 0,
+           httpStart: 0, httpEnd: 0, parseMs: 0, sendMs: 0 };
+}
+
+function begin(name) {
+  current = newTrace(name);
+}
+
+function trace() {
+  if (!current) current = newTrace('list');
+  return current;
+}
+
+// Call when a request goes out, and the returned function once it completed.
+function httpStarted() {
+  let t = trace();
+  let start = Date.now();
+  if (t.requests === 0) t.httpStart = start;
+  t.requests++;
+  return function (bytes) {
+    // Requests overlap, so the span from the first to the last one counts
+    t.httpEnd = Math.max(t.httpEnd, Date.now());
+    t.responses++;
+    t.httpBytes += bytes || 0;
+  };
+}
+
+// Run fn() and count its time as parsing.
+function parse(fn) {
+  let start = Date.now();
+  let result = fn();
+  trace().parseMs += Date.now() - start;
+  return result;
+}
+
+function kb(bytes) {
+  return (bytes / 1024).toFixed(1) + ' KB';
+}
+
+function describe(t) {
+  let http = 'no http';
+  if (t.requests > 0) {
+    http = 'http ' + t.responses + '/' + t.requests + ' req ' + kb(t.httpBytes) +
+      (t.responses > 0 ? ' ' + (t.httpEnd - t.httpStart) + ' ms' : '');
+  }
+  return 'Trace ' + t.name + ': ' + http + ', parse ' + t.parseMs + ' ms, send ' + t.sendMs + ' ms';
+}
+
+// The watch acknowledged a list of the current trace, `sendMs` after we
+// started sending it.
+function listSent(sendMs) {
+  sent = Object.assign({}, trace(), { sendMs: sendMs });
+  console.log(describe(sent) + ', total ' + (Date.now() - sent.start) + ' ms');
+}
+
+function u16(bytes, pos) {
+  return bytes[pos] | (bytes[pos + 1] << 8);
+}
+
+function u32(bytes, pos) {
+  return (bytes[pos] | (bytes[pos + 1] << 8) | (bytes[pos + 2] << 16) | (bytes[pos + 3] << 24)) >>> 0;
+}
+
+// Decode a TELEMETRY blob, or return null if it is not one we know.
+function decodeTelemetry(bytes) {
+  if (!bytes || bytes.length < TELEMETRY_SIZE || bytes[0] !== TELEMETRY_VERSION) return null;
+  let time = function (pos) {
+    let ms = u32(bytes, pos);
+    return ms === NO_TIME ? null : ms;
+  };
+  return {
+    firstItemMs: time(1),
+    listMs: time(5),
+    items: u16(bytes, 9),
+    messages: u16(bytes, 11),
+    bytes: u32(bytes, 13),
+    dropped: u16(bytes, 17),
+    outboxFailures: u16(bytes, 19),
+    pagesRequested: u16(bytes, 21),
+    heapPeak: u32(bytes, 23),
+    firstScreenMs: time(27),
+  };
+}
+
+// Log the watch's telemetry next to our own timings of the same list.
+function watchTelemetry(bytes) {
+  let w = decodeTelemetry(bytes);
+  if (!w) {
+    console.log('Unknown telemetry from watch');
+    return null;
+  }
+  let ms = function (value) { return value === null ? '-' : value + ' ms'; };
+  console.log((sent ? describe(sent) : 'Trace: no list sent') + ' | watch: first item ' +
+              ms(w.firstItemMs) + ', first screen ' + ms(w.firstScreenMs) + ', list ' + ms(w.listMs) +
+              ', ' + w.items + ' items, ' + w.messages + ' msgs ' + kb(w.bytes) + ', ' + w.dropped + ' dropped, ' +
+              w.outboxFailures + ' outbox failed, ' + w.pagesRequested + ' pages requested, heap peak ' +
+              kb(w.heapPeak));
+  return w;
+}
+
+module.exports = {
+  begin: begin,
+  httpStarted: httpStarted,
+  parse: parse,
+  listSent: listSent,
+  decodeTelemetry: decodeTelemetry,
+  watchTelemetry: watchTelemetry,
+};
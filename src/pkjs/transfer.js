@@ -0,0 +1,978 @@
+var keys = require('message_keys'); // generated at build time from package.json
+
+// Streams checklist items to the watch.
+//
+// The watch keeps items in pages of `watchPageSize` and only holds a window of
+// `watchWindowPages` pages in memory. Initially the first window is sent, the
+// first screen of it ahead, any further page is sent when the watch asks for
+// it with REQUEST_PAGE. Labels are truncated where needed so every page fits
+// the watch's label pool.
+//
+// Two protocols exist:
+//  - 'batch'  packs as many items as fit into the watch inbox into a single
+//             ITEMS_BATCH message (the default).
+//  - 'single' sends one ITEMS_INDEX/ITEMS_ITEM pair per message. It is kept
+//             around so both can be compared (see test/pkjs/bench-transfer.js).
+//
+// Once the watch shows a list, a changed version of it (same title and
+// sections) can be sent as an ITEMS_DIFF instead, see diffList(). Items carry
+// ids so toggles from the watch keep pointing at the right item while the
+// list changes underneath; after a full transfer an item's id is its index.
+//
+// Transfers are numbered: begin() starts a new generation and drops whatever
+// older ones still have queued. Every list message is tagged with its
+// generation (TRANSFER_GEN, or in the BATCH_CHECK of an ITEMS_BATCH), so the
+// watch drops anything of an older transfer that still reaches it. The
+// BATCH_CHECK also holds a Fletcher-16 checksum of the batch. The watch
+// reports in its hello how many items of a list it received without a gap
+// (RESUME_HASH, RESUME_INDEX), after a reconnect, a rejected batch or an app
+// restart, and the transfer continues from there instead of from the start.
+//
+// The hello also says how much heap a list may take on the watch
+// (WATCH_HEAP_BUDGET). Lists that would not fit are cut to what does, see
+// fitList(), rather than being refused by the watch.
+//
+// Labels go out in a compact encoding: prepareList() picks the words a list
+// repeats most ("Buy ", "#project", dates) into a dictionary of up to 31
+// entries that the list setup carries as LABEL_DICT, and bytes 0x01 to 0x1f
+// of a label stand for them. The watch keeps labels encoded and expands them
+// only to draw them. A list the dictionary would not make smaller is sent
+// raw, as is everything with setLabelEncoding('raw').
+
+// Dictionary overhead of an AppMessage: 1 byte tuple count, plus 7 bytes
+// (key, type, length) per tuple.
+const DICT_HEADER_SIZE = 1;
+const TUPLE_HEADER_SIZE = 7;
+// Record header: uint8 flags, uint8 label length.
+const RECORD_HEADER_SIZE = 2;
+const MAX_LABEL_BYTES = 255;
+// SECTION_HEADERS: uint8 index of the first section, then per section uint16
+// item count, uint8 title length and the title.
+const SECTION_HEADERS_HEADER_SIZE = 1;
+const SECTION_HEADER_SIZE = 3;
+
+// Label dictionary, see item_store.h: entry i is written as byte
+// DICT_FIRST_CODE + i, the entries go out as (uint8 length, bytes) records.
+const DICT_FIRST_CODE = 0x01;
+const DICT_MAX_ENTRIES = 31;
+const DICT_MAX_BYTES = 255;
+// Words shorter than this do not save anything worth a code
+const DICT_MIN_ENTRY = 3;
+const DICT_MAX_ENTRY = 16;
+
+const ITEM_FLAG_CHECKED = 0x01;
+
+// ITEMS_DIFF operations, see prv_apply_diff() on the watch
+const DIFF_REMOVE = 1;
+const DIFF_INSERT = 2;
+const DIFF_UPDATE = 3;
+// Larger changes (old x new items after trimming the common start and end)
+// are sent in full rather than diffed.
+const MAX_DIFF_CELLS = 40000;
+const MAX_ITEM_ID = 0xffff;
+// Hashes a list's ids are remembered under, one per diff (see idsValidFor())
+const MAX_ID_HASHES = 8;
+
+// Failed sends are retried with exponential backoff and jitter. PebbleKit JS
+// only passes on a description of the watch's AppMessageResult, so the reason
+// is guessed from it: a busy watch is tried again soon, a lost connection
+// much later, anything else (mostly timeouts) in between.
+const RETRY_BASE_MS = { busy: 100, timeout: 500, disconnected: 2000 };
+const RETRY_MAX_MS = 16000;
+
+// Watch heap per section and per resident item and page, see item_store.c.
+// Section titles take their length plus a terminator on top.
+const WATCH_SECTION_BYTES = 8;
+// The watch cuts section titles to this many bytes
+const WATCH_SECTION_TITLE_MAX = 63;
+const WATCH_ITEM_BYTES = 6;
+const WATCH_SLOT_BYTES = 4;
+
+// The rows a watch screen shows at most. The top of a new list goes out in a
+// message of its own, so the watch shows it without waiting for the rest of
+// the initial window (the larger the inbox, the longer that would take).
+const FIRST_SCREEN_ITEMS = 10;
+
+// How long to hold a transfer back while waiting for the watch hello.
+const WATCH_HELLO_TIMEOUT_MS = 2000;
+
+// The watch announces its real inbox size and list geometry in its hello
+// message once it is running. Until then assume the most constrained watch.
+let watchInboxSize = 1024;
+let watchPageSize = 32;
+let watchWindowPages = 3;
+let watchPoolBudget = 3072;
+// Heap a whole list may take on the watch, 0 if it did not say
+let watchHeapBudget = 0;
+// Hash of the list the watch shows (restored from its cache or sent by us).
+let watchListHash = 0;
+// How far the watch got with a list it is still receiving: { hash, index }
+let watchResume = null;
+let watchHelloReceived = false;
+let helloWaiters = [];
+let protocol = 'batch';
+let labelEncoding = 'compact';
+
+// The list currently on the watch: items, their ids and encoded labels, the
+// label dictionary (or null), the label bytes a page may use and the largest
+// page so far. Once the watch confirmed it, also its hash and shape
+// ({ title, sections }). `idHashes` are the hashes the watch may have recorded
+// toggles of these ids against.
+let list = newList(0);
+// Pending messages, sent strictly one after the other
+let queue = [];
+let sending = false;
+// Set while a failed message waits for its retry
+let retryTimer = null;
+// Generation of the current transfer, 1 to 0xffff (0 means untagged)
+let generation = 1;
+
+function setWatchInboxSize(size) {
+  if (size > 0) {
+    watchInboxSize = size;
+    console.log('Watch inbox size: ' + size);
+  }
+}
+
+// `sendingHash` is the hash of the list while it is being sent, 0 for lists
+// that get one only once complete.
+function newList(capacity, sendingHash) {
+  return { items: [], ids: [], labels: [], dict: null, capacity: capacity, pageBytes: 0,
+           nextId: 0, hash: 0, shape: null, sendingHash: sendingHash || 0,
+           idHashes: [sendingHash || 0] };
+}
+
+// Drop all queued messages except one that is on its way to the watch.
+function dropQueued() {
+  if (retryTimer) {
+    clearTimeout(retryTimer);
+    retryTimer = null;
+    sending = false;
+  }
+  queue = sending ? queue.slice(0, 1) : [];
+}
+
+// Start a new transfer generation. Messages older transfers still have
+// queued are dropped, and their callbacks never run. Returns the generation,
+// see isCurrent().
+function begin() {
+  generation = generation % 0xffff + 1;
+  dropQueued();
+  return generation;
+}
+
+// False once a newer transfer began, so chains of an older one (HTTP
+// callbacks, waits for the watch) can stop.
+function isCurrent(gen) {
+  return gen === generation;
+}
+
+// Called with the contents of the watch hello message. `resume` is how far the
+// watch got with a list it is still receiving ({ hash, index }) or null. A
+// transfer of that list that is under way continues from there. Returns true
+// if the watch said hello before and no longer shows the list we sent it (it
+// rejected a diff or lost part of the list), so the list has to be sent again.
+function setWatchInfo(inboxSize, listHash, geometry, resume) {
+  let lost = watchHelloReceived && list.hash !== 0 && (listHash | 0) !== list.hash;
+  watchResume = resume && resume.index > 0 ? { hash: resume.hash | 0, index: resume.index } : null;
+  if (watchResume && list.sendingHash === watchResume.hash && list.hash === 0) {
+    resumeFrom(watchResume.index);
+    watchResume = null;
+    lost = false;
+  }
+  setWatchInboxSize(inboxSize);
+  if (geometry && geometry.pageSize > 0) {
+    watchPageSize = geometry.pageSize;
+    watchWindowPages = geometry.windowPages;
+    watchPoolBudget = geometry.poolBudget;
+    watchHeapBudget = geometry.heapBudget || 0;
+  }
+  watchListHash = listHash | 0;
+  watchHelloReceived = true;
+  let waiters = helloWaiters;
+  helloWaiters = [];
+  waiters.forEach(function (waiter) {
+    clearTimeout(waiter.timer);
+    waiter.callback();
+  });
+  return lost;
+}
+
+// Run callback once the watch hello has arrived, or after a short timeout if
+// it never does (we then simply transfer everything).
+function whenWatchReady(callback) {
+  if (watchHelloReceived) {
+    callback();
+    return;
+  }
+  let waiter = { callback: callback };
+  waiter.timer = setTimeout(function () {
+    helloWaiters = helloWaiters.filter(function (w) { return w !== waiter; });
+    callback();
+  }, WATCH_HELLO_TIMEOUT_MS);
+  helloWaiters.push(waiter);
+}
+
+// FNV-1a hash over everything the watch stores of a list, as a signed int32
+// because that is what AppMessage integers carry.
+function listHash(title, sections, items) {
+  let hash = 0x811c9dc5;
+  function feed(text) {
+    for (let i = 0; i < text.length; i++) {
+      hash ^= text.charCodeAt(i);
+      hash = Math.imul(hash, 0x01000193);
+    }
+    hash ^= 0x1f;
+    hash = Math.imul(hash, 0x01000193);
+  }
+  feed(title || '');
+  sections.forEach(function (section) { feed(section.title + '\x1e' + section.item_count); });
+  items.forEach(function (item) { feed((item.checked ? 'x' : ' ') + item.name); });
+  // 0 means "no list" on the watch
+  return (hash | 0) || 1;
+}
+
+function watchHasList(hash) {
+  return watchListHash === hash;
+}
+
+// Number of items of the list hashing to `hash` the watch already has, from
+// the hello. Only used once: the watch moves on as soon as we send more.
+function resumeIndex(hash) {
+  if (!watchResume || watchResume.hash !== hash) return 0;
+  let index = watchResume.index;
+  watchResume = null;
+  return index;
+}
+
+// The watch acknowledged the list prepared last, which hashes to `hash` and
+// has the given shape ({ title, sections }).
+function setWatchListHash(hash, shape) {
+  watchListHash = hash;
+  list.hash = hash;
+  list.shape = shape || null;
+  if (list.idHashes.indexOf(hash) < 0) list.idHashes.push(hash);
+}
+
+// Index of the item the watch knows by `id`, or -1 if it is gone.
+function indexOfId(id) {
+  return list.ids.indexOf(id);
+}
+
+// Whether ids the watch recorded toggles of against the list hashing to
+// `hash` (0 while a streamed list has none yet) are ids of the list prepared
+// last. Diffs and appended items keep ids, a new list hands out new ones.
+function idsValidFor(hash) {
+  return list.idHashes.indexOf(hash | 0) >= 0;
+}
+
+function setProtocol(name) {
+  protocol = name;
+}
+
+// 'compact' (the default) or 'raw', so both can be compared.
+function setLabelEncoding(name) {
+  labelEncoding = name;
+}
+
+// PebbleKit JS has no TextEncoder, so encode to UTF-8 by hand.
+function encodeUtf8(str) {
+  let bytes = [];
+  for (let i = 0; i < str.length; i++) {
+    let code = str.codePointAt(i);
+    if (code > 0xffff) i++; // skip the low surrogate
+    if (code < 0x80) {
+      bytes.push(code);
+    } else if (code < 0x800) {
+      bytes.push(0xc0 | (code >> 6), 0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+      bytes.push(0xe0 | (code >> 12), 0x80 | ((code >> 6) & 0x3f), 0x80 | (code & 0x3f));
+    } else {
+      bytes.push(0xf0 | (code >> 18), 0x80 | ((code >> 12) & 0x3f),
+                 0x80 | ((code >> 6) & 0x3f), 0x80 | (code & 0x3f));
+    }
+  }
+  return bytes;
+}
+
+// Cut a UTF-8 byte array to at most `max` bytes without splitting a character.
+function truncateUtf8(bytes, max) {
+  if (bytes.length <= max) return bytes;
+  let end = max;
+  while (end > 0 && (bytes[end] & 0xc0) === 0x80) end--;
+  return bytes.slice(0, end);
+}
+
+function rawLabel(item) {
+  return truncateUtf8(encodeUtf8(item.name || ''), MAX_LABEL_BYTES);
+}
+
+// Calls visit(start, end) for every word of `label` with the space after it.
+function forEachWord(label, visit) {
+  let start = 0;
+  for (let i = 0; i <= label.length; i++) {
+    if (i < label.length && label[i] !== 0x20) continue;
+    visit(start, Math.min(label.length, i + 1));
+    start = i + 1;
+  }
+}
+
+// Dictionary of the words that save the most bytes over all `labels`, or
+// null if none does: { entries, byFirst, bytes }. `byFirst` maps a first
+// byte to the entries starting with it, longest first; `bytes` is LABEL_DICT.
+function buildDictionary(labels) {
+  let counts = new Map();
+  labels.forEach(function (label) {
+    forEachWord(label, function (start, end) {
+      if (end - start < DICT_MIN_ENTRY || end - start > DICT_MAX_ENTRY) return;
+      let word = String.fromCharCode.apply(null, label.slice(start, end));
+      counts.set(word, (counts.get(word) || 0) + 1);
+    });
+  });
+  // Every use saves all but one byte, the entry itself costs its length + 1
+  let candidates = [];
+  counts.forEach(function (count, word) {
+    let saving = count * (word.length - 1) - (word.length + 1);
+    if (saving > 0) candidates.push({ word: word, saving: saving });
+  });
+  candidates.sort(function (a, b) {
+    return b.saving - a.saving || (a.word < b.word ? -1 : a.word > b.word ? 1 : 0);
+  });
+
+  let dict = { entries: [], byFirst: {}, bytes: [] };
+  candidates.forEach(function (candidate) {
+    let word = candidate.word;
+    if (dict.entries.length === DICT_MAX_ENTRIES || dict.bytes.length + 1 + word.length > DICT_MAX_BYTES) {
+      return;
+    }
+    let entry = [];
+    for (let i = 0; i < word.length; i++) entry.push(word.charCodeAt(i));
+    let code = dict.entries.length;
+    dict.entries.push(entry);
+    (dict.byFirst[entry[0]] = dict.byFirst[entry[0]] || []).push(code);
+    dict.bytes.push(entry.length);
+    dict.bytes = dict.bytes.concat(entry);
+  });
+  Object.keys(dict.byFirst).forEach(function (first) {
+    dict.byFirst[first].sort(function (a, b) { return dict.entries[b].length - dict.entries[a].length; });
+  });
+  return dict.entries.length > 0 ? dict : null;
+}
+
+function matchesAt(label, pos, entry) {
+  if (pos + entry.length > label.length) return false;
+  for (let i = 0; i < entry.length; i++) {
+    if (label[pos + i] !== entry[i]) return false;
+  }
+  return true;
+}
+
+// Replace the words of `label` that are in `dict` by their codes. Bytes that
+// would read as codes (control characters) become spaces.
+function compressLabel(label, dict) {
+  let out = [];
+  let pos = 0;
+  while (pos < label.length) {
+    let codes = pos === 0 || label[pos - 1] === 0x20 ? dict.byFirst[label[pos]] : null;
+    let code = codes ? codes.find(function (c) { return matchesAt(label, pos, dict.entries[c]); }) : undefined;
+    if (code !== undefined) {
+      out.push(DICT_FIRST_CODE + code);
+      pos += dict.entries[code].length;
+    } else {
+      out.push(label[pos] < 0x20 ? 0x20 : label[pos]);
+      pos++;
+    }
+  }
+  return out;
+}
+
+// The dictionary to send `items` with, or null if they go out raw because it
+// would not save more than it costs itself.
+function chooseDictionary(items) {
+  // ITEMS_ITEM sends names as they are
+  if (labelEncoding !== 'compact' || protocol === 'single') return null;
+  let labels = items.map(rawLabel);
+  let dict = buildDictionary(labels);
+  if (!dict) return null;
+  let saved = labels.reduce(function (sum, label) {
+    return sum + label.length - compressLabel(label, dict).length;
+  }, 0);
+  return saved > dict.bytes.length + TUPLE_HEADER_SIZE ? dict : null;
+}
+
+function encodeLabel(item, dict) {
+  let label = rawLabel(item);
+  return dict ? compressLabel(label, dict) : label;
+}
+
+// Label bytes one page may use on the watch. Mirrors item_store_init(). A list
+// that will still grow has to assume the window is full.
+function pageLabelCapacity(numItems, growing) {
+  let numPages = Math.ceil(numItems / watchPageSize);
+  let slots = growing ? watchWindowPages : Math.max(1, Math.min(numPages, watchWindowPages));
+  let pool = Math.min(Math.floor(watchPoolBudget / slots), 0xffff);
+  return Math.max(0, pool - watchPageSize); // one NUL terminator per label
+}
+
+function align4(size) {
+  return (size + 3) & ~3;
+}
+
+function titleBytes(section) {
+  return Math.min(encodeUtf8(section.title || '').length, WATCH_SECTION_TITLE_MAX);
+}
+
+// SECTION_TITLE_BYTES of a list in `sections`: what their titles take on the
+// watch, without terminators.
+function sectionTitleBytes(sections) {
+  return sections.reduce(function (sum, section) { return sum + titleBytes(section); }, 0);
+}
+
+// Bytes `payload` takes in the watch inbox, as sent by sendMessage().
+function messageSize(payload) {
+  let size = DICT_HEADER_SIZE;
+  Object.keys(payload).forEach(function (key) {
+    let value = payload[key];
+    size += TUPLE_HEADER_SIZE;
+    if (typeof value === 'number') size += 4;
+    else if (typeof value === 'string') size += encodeUtf8(value).length + 1;
+    else size += value.length;
+  });
+  if (!(keys.TRANSFER_GEN in payload)) size += TUPLE_HEADER_SIZE + 4;
+  return size;
+}
+
+// Put the headers of `sections` from `first` on into the list setup
+// `payload` as one SECTION_HEADERS blob, titles cut to what the watch keeps.
+// Headers that do not fit next to the rest of the setup go into as few
+// messages as needed, which are returned to be sent right after it.
+function addSectionHeaders(payload, sections, first) {
+  let messages = [];
+  let blob = null;
+  let room = watchInboxSize - messageSize(payload) - TUPLE_HEADER_SIZE;
+  for (let index = first; index < sections.length; index++) {
+    let section = sections[index];
+    let title = truncateUtf8(encodeUtf8(section.title || ''), WATCH_SECTION_TITLE_MAX);
+    let size = SECTION_HEADER_SIZE + title.length;
+    if (!blob || blob.length + size > room) {
+      if (blob || SECTION_HEADERS_HEADER_SIZE + size > room) {
+        // Only the generation goes with the headers
+        payload = {};
+        messages.push(payload);
+        room = watchInboxSize - DICT_HEADER_SIZE - 2 * TUPLE_HEADER_SIZE - 4;
+      }
+      blob = [index];
+      payload[keys.SECTION_HEADERS] = blob;
+    }
+    blob.push(section.item_count & 0xff, section.item_count >> 8, title.length);
+    for (let i = 0; i < title.length; i++) blob.push(title[i]);
+  }
+  return messages;
+}
+
+// Watch heap a list takes with empty labels. Mirrors item_store_init(), with
+// room for the largest dictionary.
+function listBaseSize(numItems, numSections, numTitleBytes) {
+  let numPages = Math.ceil(numItems / watchPageSize);
+  let slots = Math.min(numPages, watchWindowPages);
+  let dictSize = labelEncoding === 'compact' ? align4(DICT_MAX_BYTES) : 0;
+  let titlesSize = numSections > 0 ? align4(numTitleBytes + numSections) : 0;
+  return align4(numSections * WATCH_SECTION_BYTES) + titlesSize + align4(numPages) +
+    align4(slots * WATCH_SLOT_BYTES) + slots * watchPageSize * (WATCH_ITEM_BYTES + 1) + dictSize;
+}
+
+// How much of a list the watch has room for: { sections, items } to keep of
+// `sections` and `numItems`. Lists in sections lose whole sections from the
+// end, others items. Labels are cut to make the rest fit.
+function fitList(sections, numItems) {
+  let fits = function (items, secs, titles) {
+    return items <= MAX_ITEM_ID + 1 &&
+      (!watchHeapBudget || listBaseSize(items, secs, titles) <= watchHeapBudget);
+  };
+  if (fits(numItems, sections.length, sectionTitleBytes(sections))) {
+    return { sections: sections.length, items: numItems };
+  }
+
+  if (sections.length > 0) {
+    let items = 0;
+    let titles = 0;
+    let kept = 0;
+    while (kept < sections.length &&
+           fits(items + sections[kept].item_count, kept + 1, titles + titleBytes(sections[kept]))) {
+      items += sections[kept].item_count;
+      titles += titleBytes(sections[kept]);
+      kept++;
+    }
+    return { sections: kept, items: items };
+  }
+
+  let low = 0;
+  let high = numItems;
+  while (low < high) {
+    let mid = Math.ceil((low + high) / 2);
+    if (fits(mid, 0, 0)) low = mid;
+    else high = mid - 1;
+  }
+  return { sections: 0, items: low };
+}
+
+function totalLength(labels) {
+  return labels.reduce(function (sum, label) { return sum + label.length; }, 0);
+}
+
+// Shorten the longest labels of a page until the page fits `capacity` bytes.
+function fitPage(labels, capacity) {
+  if (totalLength(labels) <= capacity) return labels;
+
+  // Largest per-label limit that still fits
+  let low = 0;
+  let high = MAX_LABEL_BYTES;
+  while (low < high) {
+    let mid = Math.ceil((low + high) / 2);
+    let size = labels.reduce(function (sum, label) { return sum + Math.min(label.length, mid); }, 0);
+    if (size <= capacity) low = mid;
+    else high = mid - 1;
+  }
+  return labels.map(function (label) { return truncateUtf8(label, low); });
+}
+
+// Encode the labels of a new list so every page fits the watch. Pass
+// `growing` if more items will be added with extendList(), and the list's
+// `hash` if it is sent with one, so a transfer that is cut off can resume.
+// Returns the label bytes of the largest page (`pageBytes`), which the watch
+// sizes its pools by, and the LABEL_DICT to send with the list (`dict`, null
+// for raw labels). Items added later share the dictionary of the first ones.
+function prepareList(items, growing, hash) {
+  list = newList(pageLabelCapacity(items.length, growing), hash);
+  list.dict = chooseDictionary(items);
+  // Whatever the watch showed is about to be replaced
+  watchListHash = 0;
+  // Pages of the previous list are of no use any more
+  dropQueued();
+  let prepared = extendList(items);
+  prepared.dict = list.dict ? list.dict.bytes : null;
+  return prepared;
+}
+
+// `items` is the list so far plus new items at the end. Labels already sent
+// stay as they are, new ones share what is left of their page.
+function extendList(items) {
+  let first = list.labels.length;
+  while (first < items.length) {
+    let pageStart = first - first % watchPageSize;
+    let end = Math.min(items.length, pageStart + watchPageSize);
+    let used = totalLength(list.labels.slice(pageStart, first));
+    let page = fitPage(items.slice(first, end).map(function (item) { return encodeLabel(item, list.dict); }),
+                       list.capacity - used);
+    list.labels = list.labels.concat(page);
+    list.pageBytes = Math.max(list.pageBytes, used + totalLength(page));
+    first = end;
+  }
+  while (list.ids.length < items.length) list.ids.push(list.nextId++);
+  list.items = items;
+  return { pageBytes: list.pageBytes };
+}
+
+// Encode the labels of a complete list page by page, like prepareList().
+function fitLabels(items, capacity, dict) {
+  let labels = [];
+  let pageBytes = 0;
+  for (let first = 0; first < items.length; first += watchPageSize) {
+    let page = fitPage(items.slice(first, first + watchPageSize).map(function (item) {
+      return encodeLabel(item, dict);
+    }), capacity);
+    labels = labels.concat(page);
+    pageBytes = Math.max(pageBytes, totalLength(page));
+  }
+  return { labels: labels, pageBytes: pageBytes };
+}
+
+function sameLabel(a, b) {
+  return a.length === b.length && a.every(function (byte, i) { return byte === b[i]; });
+}
+
+// Items are matched by file and text; their checked state and (truncated)
+// label may change without losing their id.
+function itemKey(item) {
+  return (item.fileIndex !== undefined ? item.fileIndex : '') + '\x1f' + item.name;
+}
+
+// Edit script turning old into new: a list of ['keep', oldIndex, newIndex],
+// ['remove', oldIndex] and ['insert', newIndex] steps in list order, or null
+// if the lists differ too much to be worth it.
+function editScript(oldKeys, newKeys) {
+  let start = 0;
+  while (start < oldKeys.length && start < newKeys.length && oldKeys[start] === newKeys[start]) start++;
+  let oldEnd = oldKeys.length;
+  let newEnd = newKeys.length;
+  while (oldEnd > start && newEnd > start && oldKeys[oldEnd - 1] === newKeys[newEnd - 1]) {
+    oldEnd--;
+    newEnd--;
+  }
+  let rows = oldEnd - start;
+  let cols = newEnd - start;
+  if (rows * cols > MAX_DIFF_CELLS) return null;
+
+  // lcs[i * (cols + 1) + j]: longest common subsequence of the middle parts
+  // from old item start + i and new item start + j on
+  let lcs = new Uint16Array((rows + 1) * (cols + 1));
+  for (let i = rows - 1; i >= 0; i--) {
+    for (let j = cols - 1; j >= 0; j--) {
+      lcs[i * (cols + 1) + j] = oldKeys[start + i] === newKeys[start + j]
+        ? lcs[(i + 1) * (cols + 1) + j + 1] + 1
+        : Math.max(lcs[(i + 1) * (cols + 1) + j], lcs[i * (cols + 1) + j + 1]);
+    }
+  }
+
+  let steps = [];
+  for (let i = 0; i < start; i++) steps.push(['keep', i, i]);
+  let i = 0;
+  let j = 0;
+  while (i < rows || j < cols) {
+    if (i < rows && j < cols && oldKeys[start + i] === newKeys[start + j]) {
+      steps.push(['keep', start + i++, start + j++]);
+    } else if (j >= cols || (i < rows && lcs[(i + 1) * (cols + 1) + j] >= lcs[i * (cols + 1) + j + 1])) {
+      steps.push(['remove', start + i++]);
+    } else {
+      steps.push(['insert', start + j++]);
+    }
+  }
+  for (let k = 0; k < oldKeys.length - oldEnd; k++) steps.push(['keep', oldEnd + k, newEnd + k]);
+  return steps;
+}
+
+function pushU16(bytes, value) {
+  bytes.push(value & 0xff, (value >> 8) & 0xff);
+}
+
+function pushRecord(bytes, item, label) {
+  bytes.push(item.checked ? ITEM_FLAG_CHECKED : 0, label.length);
+  for (let i = 0; i < label.length; i++) bytes.push(label[i]);
+}
+
+// Build an ITEMS_DIFF message that turns the list on the watch into `items`,
+// or return null if a full transfer is needed: the watch shows something else,
+// either list does not fit into the watch's window at once, the title or
+// section titles changed, or the diff would not fit into one message. On
+// success the new list replaces the prepared one, with `hash` as its hash.
+function diffList(title, sections, items, hash) {
+  let shape = list.shape;
+  let window = watchPageSize * watchWindowPages;
+  if (!list.hash || list.hash !== watchListHash || !shape
+      || list.items.length > window || items.length > window
+      || shape.title !== title || shape.sections.length !== sections.length
+      || sections.some(function (section, i) { return section.title !== shape.sections[i].title; })) {
+    return null;
+  }
+
+  let steps = editScript(list.items.map(itemKey), items.map(itemKey));
+  if (!steps) return null;
+
+  let capacity = pageLabelCapacity(items.length, false);
+  // The watch keeps the dictionary the list came with
+  let fitted = fitLabels(items, capacity, list.dict);
+  let ids = [];
+  let nextId = list.nextId;
+  let blob = [];
+  pushU16(blob, list.items.length);
+  pushU16(blob, items.length);
+  blob.push(sections.length);
+  sections.forEach(function (section) { pushU16(blob, section.item_count); });
+
+  // Positions are in the list as changed so far, i.e. the new index
+  let position = 0;
+  // Where the count of the current run of removals is, or -1
+  let countAt = -1;
+  steps.forEach(function (step) {
+    if (step[0] === 'remove') {
+      if (countAt < 0) {
+        blob.push(DIFF_REMOVE);
+        pushU16(blob, position);
+        countAt = blob.length;
+        pushU16(blob, 0);
+      }
+      let count = blob[countAt] + (blob[countAt + 1] << 8) + 1;
+      blob[countAt] = count & 0xff;
+      blob[countAt + 1] = count >> 8;
+      return;
+    }
+    countAt = -1;
+    if (step[0] === 'insert') {
+      let index = step[1];
+      blob.push(DIFF_INSERT);
+      pushU16(blob, position);
+      pushU16(blob, nextId);
+      pushRecord(blob, items[index], fitted.labels[index]);
+      ids.push(nextId++);
+    } else {
+      let oldIndex = step[1];
+      let index = step[2];
+      let oldItem = list.items[oldIndex];
+      if (!!oldItem.checked !== !!items[index].checked
+          || !sameLabel(list.labels[oldIndex], fitted.labels[index])) {
+        blob.push(DIFF_UPDATE);
+        pushU16(blob, position);
+        pushRecord(blob, items[index], fitted.labels[index]);
+      }
+      ids.push(list.ids[oldIndex]);
+    }
+    position++;
+  });
+  if (nextId > MAX_ITEM_ID) return null;
+
+  // The diff shares its message with the hash and page size (two int32s)
+  if (blob.length > watchInboxSize - DICT_HEADER_SIZE - 3 * TUPLE_HEADER_SIZE - 2 * 4) return null;
+
+  dropQueued();
+  list = { items: items, ids: ids, labels: fitted.labels, dict: list.dict, capacity: capacity,
+           pageBytes: fitted.pageBytes, nextId: nextId, hash: hash,
+           shape: { title: title, sections: sections }, sendingHash: hash,
+           idHashes: list.idHashes.concat([hash]).slice(-MAX_ID_HASHES) };
+  // Messages are delivered in order, anything after this already refers to
+  // the new list
+  watchListHash = hash;
+
+  let payload = {};
+  payload[keys.ITEMS_DIFF] = blob;
+  payload[keys.LIST_HASH] = hash;
+  payload[keys.ITEMS_PAGE_BYTES] = fitted.pageBytes;
+  return payload;
+}
+
+// Largest ITEMS_BATCH blob that still fits the watch inbox next to its
+// BATCH_CHECK.
+function batchCapacity() {
+  return watchInboxSize - DICT_HEADER_SIZE - 2 * TUPLE_HEADER_SIZE - 4;
+}
+
+// Fletcher-16, as prv_batch_checksum() on the watch.
+function checksum(bytes) {
+  let sum1 = 0;
+  let sum2 = 0;
+  for (let i = 0; i < bytes.length; i++) {
+    sum1 = (sum1 + bytes[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return (sum2 << 8) | sum1;
+}
+
+function batchCheck(batch) {
+  return ((generation << 16) | checksum(batch)) | 0;
+}
+
+// Split the items in [first, end) into ITEMS_BATCH blobs. Each blob starts
+// with the uint16 index of its first item, followed by a (flags, length, label
+// bytes) record per item.
+function packBatches(first, end) {
+  let capacity = batchCapacity();
+  let batches = [];
+  let current = null;
+
+  for (let index = first; index < end; index++) {
+    let label = list.labels[index];
+    let recordSize = RECORD_HEADER_SIZE + label.length;
+    if (!current || current.length + recordSize > capacity) {
+      current = [index & 0xff, (index >> 8) & 0xff];
+      batches.push(current);
+    }
+    current.push(list.items[index].checked ? ITEM_FLAG_CHECKED : 0, label.length);
+    for (let i = 0; i < label.length; i++) current.push(label[i]);
+  }
+
+  return batches;
+}
+
+function buildMessages(first, end) {
+  if (protocol === 'single') {
+    let messages = [];
+    for (let index = first; index < end; index++) {
+      let payload = {};
+      payload[keys.ITEMS_INDEX] = index;
+      payload[keys.ITEMS_ITEM] = list.items[index].name;
+      payload[keys.TRANSFER_GEN] = generation;
+      messages.push(payload);
+    }
+    return messages;
+  }
+  return packBatches(first, end).map(function (batch) {
+    let payload = {};
+    payload[keys.ITEMS_BATCH] = batch;
+    payload[keys.BATCH_CHECK] = batchCheck(batch);
+    return payload;
+  });
+}
+
+function failureReason(err) {
+  let text = JSON.stringify(err || '').toLowerCase();
+  if (text.indexOf('busy') >= 0) return 'busy';
+  if (/not.?connected|disconnect|closed/.test(text)) return 'disconnected';
+  return 'timeout';
+}
+
+// Delay before retry number `attempt` (from 0) of a send that failed with
+// `err`. Half of it is random so retries spread out.
+function retryDelay(attempt, err) {
+  let delay = Math.min(RETRY_BASE_MS[failureReason(err)] * Math.pow(2, attempt), RETRY_MAX_MS);
+  return Math.round(delay / 2 + Math.random() * delay / 2);
+}
+
+function pump() {
+  if (sending || queue.length === 0) return;
+  sending = true;
+  let entry = queue[0];
+  if (entry.stats) entry.stats.roundTrips++;
+
+  Pebble.sendAppMessage(entry.payload,
+    function () {
+      sending = false;
+      queue.shift();
+      if (entry.onSent) entry.onSent();
+      pump();
+    },
+    function (err) {
+      let delay = retryDelay(entry.attempts || 0, err);
+      entry.attempts = (entry.attempts || 0) + 1;
+      console.log('Send failed for ' + entry.label + ': ' + JSON.stringify(err) +
+                  ', retrying in ' + delay + ' ms');
+      // Only this message is sent again, the ones before it arrived
+      retryTimer = setTimeout(function () {
+        retryTimer = null;
+        sending = false;
+        pump();
+      }, delay);
+    }
+  );
+}
+
+// The watch has the first `index` items of the list being sent. Items of the
+// initial window still queued are packed again from there: the ones it has
+// are skipped, and any it dropped after that are sent again. Their callbacks
+// move to the end of the new range.
+function resumeFrom(index) {
+  let end = Math.min(list.items.length, watchPageSize * watchWindowPages);
+  // A message in flight cannot be taken back
+  let keep = sending && !retryTimer ? 1 : 0;
+  let dropped = queue.slice(keep).filter(function (entry) { return entry.initial; });
+  if (dropped.length === 0 && index >= end) return;
+  if (retryTimer) {
+    clearTimeout(retryTimer);
+    retryTimer = null;
+    sending = false;
+  }
+  queue = queue.slice(0, keep).concat(queue.slice(keep).filter(function (entry) { return !entry.initial; }));
+  console.log('Watch has ' + index + ' items, resuming the transfer from there');
+  let callbacks = dropped.map(function (entry) { return entry.onSent; }).filter(Boolean);
+  let onDone = function () { callbacks.forEach(function (callback) { callback(); }); };
+  if (index >= end) {
+    onDone();
+    pump();
+    return;
+  }
+  // Ahead of pages the watch asked for, like the initial window itself
+  let rest = queue.splice(keep, queue.length - keep);
+  enqueueRange(index, end, 'items from ' + index, null, true);
+  whenSent(onDone);
+  queue = queue.concat(rest);
+  pump();
+}
+
+// Queue the items in [first, end) and call onDone once all are acknowledged.
+// `initial` marks items of the initial window, which resumeFrom() replaces;
+// any of the first screen among them get a message of their own.
+function enqueueRange(first, end, label, onDone, initial) {
+  let screen = initial ? Math.min(end, Math.max(first, FIRST_SCREEN_ITEMS)) : first;
+  let messages = buildMessages(first, screen).concat(buildMessages(screen, end));
+  let stats = { protocol: protocol, items: end - first, roundTrips: 0, start: Date.now() };
+
+  messages.forEach(function (payload, i) {
+    let entry = { payload: payload, label: label + ' message ' + i, stats: stats, page: label,
+                  initial: !!initial };
+    if (i === messages.length - 1) {
+      entry.onSent = function () {
+        let elapsed = Date.now() - stats.start;
+        console.log(`Transfer of ${label} (${stats.protocol}): ${stats.items} items in ` +
+                    `${stats.roundTrips} round trips, ${elapsed} ms`);
+        if (onDone) onDone(stats.roundTrips, elapsed);
+      };
+    }
+    queue.push(entry);
+  });
+  if (messages.length === 0 && onDone) whenSent(function () { onDone(0, 0); });
+  pump();
+}
+
+// Send the first window of the list prepared with prepareList(), as many items
+// as the watch keeps in memory at once. Calls onDone once it was acknowledged.
+function sendItems(onDone) {
+  sendNewItems(0, onDone);
+}
+
+// Send the items from `first` on that fall into the initial window, after the
+// list was extended. The watch asks for anything beyond that by itself.
+function sendNewItems(first, onDone) {
+  let end = Math.min(list.items.length, watchPageSize * watchWindowPages);
+  if (first >= end) {
+    if (onDone) whenSent(function () { onDone(0, 0); });
+    return;
+  }
+  enqueueRange(first, end, first === 0 ? 'initial window' : 'items from ' + first, onDone, true);
+}
+
+// Call `callback` once everything queued so far has been acknowledged.
+function whenSent(callback) {
+  if (queue.length === 0) {
+    callback();
+    return;
+  }
+  let last = queue[queue.length - 1];
+  let onSent = last.onSent;
+  last.onSent = function () {
+    if (onSent) onSent();
+    callback();
+  };
+}
+
+// Send any other message of the list in order with the item transfers.
+function sendMessage(payload, label, onSent) {
+  payload[keys.TRANSFER_GEN] = generation;
+  queue.push({ payload: payload, label: label, onSent: onSent });
+  pump();
+}
+
+// The watch scrolled towards a page it does not have (REQUEST_PAGE).
+function sendPage(page) {
+  let label = 'page ' + page;
+  let first = page * watchPageSize;
+  if (first < 0 || first >= list.items.length) return;
+  if (queue.some(function (entry) { return entry.page === label; })) return;
+  enqueueRange(first, Math.min(list.items.length, first + watchPageSize), label);
+}
+
+module.exports = {
+  begin: begin,
+  isCurrent: isCurrent,
+  setWatchInboxSize: setWatchInboxSize,
+  setWatchInfo: setWatchInfo,
+  fitList: fitList,
+  sectionTitleBytes: sectionTitleBytes,
+  addSectionHeaders: addSectionHeaders,
+  whenWatchReady: whenWatchReady,
+  listHash: listHash,
+  watchHasList: watchHasList,
+  resumeIndex: resumeIndex,
+  retryDelay: retryDelay,
+  setWatchListHash: setWatchListHash,
+  indexOfId: indexOfId,
+  idsValidFor: idsValidFor,
+  diffList: diffList,
+  prepareList: prepareList,
+  extendList: extendList,
+  setProtocol: setProtocol,
+  setLabelEncoding: setLabelEncoding,
+  encodeUtf8: encodeUtf8,
+  sendItems: sendItems,
+  sendNewItems: sendNewItems,
+  sendMessage: sendMessage,
+  whenSent: whenSent,
+  sendPage: sendPage,
+};
@@ -0,0 +1,187 @@
+const docCache = require('./doc_cache');
+const markdown = require('./markdown');
+
+// Uploads checklist edits back to the server.
+//
+// Toggles are applied to the in-memory document text right away and queued per
+// file. After a short quiet period all pending edits of a file go out as one
+// PUT, and there is never more than one PUT per file in flight. Uploads are
+// conditional on the ETag the document was loaded with (If-Match). If someone
+// else changed the file in the meantime (412), it is downloaded again and the
+// pending edits are re-applied by item name before uploading once more.
+
+// Quiet period after the last toggle before uploading
+const FLUSH_DELAY_MS = 1000;
+// Failed uploads are retried after this (times the number of failures) a few
+// times; after that the edits wait for the next toggle.
+const RETRY_DELAY_MS = 5000;
+const MAX_FAILURES = 3;
+// Re-fetch and merge at most this often per upload
+const MAX_CONFLICTS = 3;
+
+// Provided by init():
+//   credentials()      -> { username, password }
+//   getText(url)       -> the in-memory text of a document, or null
+//   rebase(url, text)  the document was replaced by a newer server version
+//   setStatus(text, progressing)
+let hooks = null;
+
+// url -> { pending: [edit], inFlight: [edit] | null, timer, failures }
+let files = {};
+
+function init(options) {
+  hooks = options;
+}
+
+// Set the checkbox of an edit's item in `text`, moving edit.offset to where
+// the item is now. Returns the new text, or null if the item is gone.
+function applyEdit(text, edit) {
+  let offset = markdown.findItem(text, edit.name, edit.offset);
+  if (offset < 0) return null;
+  edit.offset = offset;
+  return markdown.setChecked(text, offset, edit.checked);
+}
+
+function fileState(url) {
+  if (!files[url]) files[url] = { pending: [], inFlight: null, timer: null, failures: 0 };
+  return files[url];
+}
+
+// Queue an edit ({ offset, name, checked }) that was already applied to the
+// in-memory document of `url`.
+function queueEdit(url, edit) {
+  let file = fileState(url);
+  // A later toggle of the same item replaces the earlier one
+  file.pending = file.pending.filter(function (e) {
+    return !(e.name === edit.name && e.offset === edit.offset);
+  });
+  file.pending.push(edit);
+  scheduleFlush(url, FLUSH_DELAY_MS);
+  hooks.setStatus('', true);
+}
+
+function scheduleFlush(url, delay) {
+  let file = fileState(url);
+  if (file.timer) clearTimeout(file.timer);
+  file.timer = setTimeout(function () { flush(url); }, delay);
+}
+
+function flush(url) {
+  let file = fileState(url);
+  file.timer = null;
+  if (file.inFlight || file.pending.length === 0) return;
+  let edits = file.pending;
+  file.pending = [];
+  file.inFlight = edits;
+  upload(url, edits, 0);
+}
+
+function finish(url) {
+  let file = fileState(url);
+  file.inFlight = null;
+  file.failures = 0;
+  if (file.pending.length > 0) {
+    scheduleFlush(url, 0);
+  } else if (!file.timer) {
+    hooks.setStatus('');
+  }
+}
+
+// Put edits back in front of anything queued since, to be uploaded later.
+function requeue(url, edits) {
+  let file = fileState(url);
+  file.pending = edits.filter(function (edit) {
+    return !file.pending.some(function (e) { return e.name === edit.name && e.offset === edit.offset; });
+  }).concat(file.pending);
+}
+
+function upload(url, edits, conflicts) {
+  let body = hooks.getText(url);
+  if (body === null) {
+    console.log('Document no longer loaded, dropping edits for ' + url);
+    finish(url);
+    return;
+  }
+  let cached = docCache.get(url);
+  let credentials = hooks.credentials();
+  let request = new XMLHttpRequest();
+
+  request.onload = function () {
+    if (this.status >= 200 && this.status < 300) {
+      console.log('Successfully updated: ' + url + ' (' + edits.length + ' edits)');
+      docCache.updateAfterUpload(url, body, this.getResponseHeader('ETag'));
+      finish(url);
+    } else if (this.status === 412 && conflicts < MAX_CONFLICTS) {
+      console.log('Changed on the server, merging: ' + url);
+      refetch(url, edits, conflicts + 1);
+    } else {
+      failed(url, edits, 'Upload err: ' + this.status);
+    }
+  };
+  request.onerror = function () {
+    failed(url, edits, 'Upload error!');
+  };
+
+  request.open('PUT', url, true, credentials.username, credentials.password);
+  request.setRequestHeader('Content-Type', 'text/markdown');
+  // Weak ETags never match If-Match, upload unconditionally then
+  if (cached && cached.etag && cached.etag.indexOf('W/') !== 0) {
+    request.setRequestHeader('If-Match', cached.etag);
+  }
+  request.send(body);
+}
+
+function failed(url, edits, status) {
+  let file = fileState(url);
+  file.inFlight = null;
+  file.failures++;
+  console.log(status + ' for ' + url + ' (' + file.failures + ' failures)');
+  hooks.setStatus(status);
+  requeue(url, edits);
+  if (file.failures < MAX_FAILURES) {
+    scheduleFlush(url, RETRY_DELAY_MS * file.failures);
+  }
+}
+
+// Download the current server version, re-apply our edits to it and upload
+// the result.
+function refetch(url, edits, conflicts) {
+  let credentials = hooks.credentials();
+  let request = new XMLHttpRequest();
+
+  request.onload = function () {
+    if (this.status < 200 || this.status >= 300) {
+      failed(url, edits, 'Load error: ' + this.status);
+      return;
+    }
+    let body = this.responseText || '';
+    docCache.put(url, body, this.getResponseHeader('ETag'), this.getResponseHeader('Last-Modified'));
+
+    // Edits queued meanwhile are already in our text too, send them along
+    let file = fileState(url);
+    let all = edits.concat(file.pending);
+    file.pending = [];
+    file.inFlight = all;
+
+    let text = body;
+    all.forEach(function (edit) {
+      let updated = applyEdit(text, edit);
+      if (updated === null) console.log('Item no longer in ' + url + ': ' + edit.name);
+      else text = updated;
+    });
+    hooks.rebase(url, text);
+    upload(url, all, conflicts);
+  };
+  request.onerror = function () {
+    failed(url, edits, 'Network error!');
+  };
+
+  request.open('GET', url, true, credentials.username, credentials.password);
+  request.send();
+}
+
+module.exports = {
+  init: init,
+  applyEdit: applyEdit,
+  queueEdit: queueEdit,
+};
@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+"""Generate message_keys.auto.h/.c for the host build from package.json.
+
+The Pebble SDK assigns message keys at build time; here they simply count up
+from 10000. A name table is generated as well so recorded message streams can
+refer to keys by name.
+
+Usage: gen_message_keys.py package.json out_dir
+"""
+import json
+import os
+import sys
+
+FIRST_KEY = 10000
+
+
+def main():
+    package, out_dir = sys.argv[1], sys.argv[2]
+    with open(package) as f:
+        keys = json.load(f)['pebble']['messageKeys']
+
+    with open(os.path.join(out_dir, 'message_keys.auto.h'), 'w') as h:
+        h.write('#pragma once\n#include <stdint.h>\n\n')
+        for key in keys:
+            h.write('extern uint32_t MESSAGE_KEY_%s;\n' % key)
+        h.write('\ntypedef struct { const char *name; uint32_t key; } MessageKeyName;\n')
+        h.write('extern const MessageKeyName message_key_names[];\n')
+        h.write('extern const int message_key_count;\n')
+
+    with open(os.path.join(out_dir, 'message_keys.auto.c'), 'w') as c:
+        c.write('#include "message_keys.auto.h"\n\n')
+        for i, key in enumerate(keys):
+            c.write('uint32_t MESSAGE_KEY_%s = %d;\n' % (key, FIRST_KEY + i))
+        c.write('\nconst MessageKeyName message_key_names[] = {\n')
+        for i, key in enumerate(keys):
+            c.write('  { "%s", %d },\n' % (key, FIRST_KEY + i))
+        c.write('};\nconst int message_key_count = %d;\n' % len(keys))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,322 @@
+#pragma once
+// Minimal host-side stand-in for the Pebble SDK header.
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#define PBL_IF_COLOR_ELSE(a, b) (b)
+#define PBL_IF_ROUND_ELSE(a, b) (b)
+#define PBL_PLATFORM_BASALT 1
+#define PBL_API_EXISTS(name) 1
+
+typedef struct { int16_t x, y; } GPoint;
+typedef struct { int16_t w, h; } GSize;
+typedef struct { GPoint origin; GSize size; } GRect;
+#define GRect(x, y, w, h) ((GRect){{(x), (y)}, {(w), (h)}})
+#define GPoint(x, y) ((GPoint){(x), (y)})
+#define GSize(w, h) ((GSize){(w), (h)})
+#define GRectZero GRect(0, 0, 0, 0)
+typedef struct { uint8_t argb; } GColor8;
+typedef GColor8 GColor;
+#define GColorBlack ((GColor){0xC0})
+#define GColorWhite ((GColor){0xFF})
+#define GColorClear ((GColor){0x00})
+#define GColorPictonBlue ((GColor){0xD7})
+#define GColorOrange ((GColor){0xF4})
+#define GColorRajah ((GColor){0xF9})
+#define GColorDarkGray ((GColor){0xD5})
+#define GColorLightGray ((GColor){0xEA})
+typedef enum { GCornerNone = 0 } GCornersMask;
+typedef enum { GCompOpAssign, GCompOpSet } GCompOp;
+typedef enum { GTextOverflowModeWordWrap, GTextOverflowModeTrailingEllipsis, GTextOverflowModeFill } GTextOverflowMode;
+typedef enum { GTextAlignmentLeft, GTextAlignmentCenter, GTextAlignmentRight } GTextAlignment;
+typedef struct GContext GContext;
+typedef struct GBitmap GBitmap;
+typedef struct GFontStub *GFont;
+typedef struct GTextAttributes GTextAttributes;
+
+typedef struct Layer Layer;
+typedef void (*LayerUpdateProc)(Layer *layer, GContext *ctx);
+typedef struct Window Window;
+typedef struct TextLayer TextLayer;
+typedef struct StatusBarLayer StatusBarLayer;
+typedef struct MenuLayer MenuLayer;
+typedef struct Animation Animation;
+typedef struct PropertyAnimation PropertyAnimation;
+typedef struct AppTimer AppTimer;
+typedef void (*AppTimerCallback)(void *data);
+
+typedef enum { APP_LOG_LEVEL_ERROR = 1, APP_LOG_LEVEL_WARNING = 50, APP_LOG_LEVEL_INFO = 100,
+               APP_LOG_LEVEL_DEBUG = 200, APP_LOG_LEVEL_DEBUG_VERBOSE = 255 } AppLogLevel;
+void app_log(uint8_t level, const char *file, int line, const char *fmt, ...);
+#define APP_LOG(level, fmt, ...) app_log(level, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+
+// Layers
+Layer *layer_create(GRect frame);
+Layer *layer_create_with_data(GRect frame, size_t data_size);
+void *layer_get_data(const Layer *layer);
+void layer_destroy(Layer *layer);
+void layer_mark_dirty(Layer *layer);
+void layer_set_update_proc(Layer *layer, LayerUpdateProc proc);
+void layer_set_frame(Layer *layer, GRect frame);
+GRect layer_get_frame(const Layer *layer);
+GRect layer_get_bounds(const Layer *layer);
+void layer_add_child(Layer *parent, Layer *child);
+void layer_remove_from_parent(Layer *child);
+void layer_set_hidden(Layer *layer, bool hidden);
+bool layer_get_hidden(const Layer *layer);
+
+// Window
+typedef void (*WindowHandler)(Window *window);
+typedef struct { WindowHandler load, appear, disappear, unload; } WindowHandlers;
+Window *window_create(void);
+void window_destroy(Window *window);
+void window_set_window_handlers(Window *window, WindowHandlers handlers);
+Layer *window_get_root_layer(const Window *window);
+void window_set_background_color(Window *window, GColor color);
+void window_stack_push(Window *window, bool animated);
+void window_stack_pop_all(bool animated);
+
+// Text
+TextLayer *text_layer_create(GRect frame);
+void text_layer_destroy(TextLayer *t);
+Layer *text_layer_get_layer(TextLayer *t);
+void text_layer_set_text(TextLayer *t, const char *text);
+void text_layer_set_font(TextLayer *t, GFont font);
+void text_layer_set_background_color(TextLayer *t, GColor c);
+void text_layer_set_text_color(TextLayer *t, GColor c);
+void text_layer_set_text_alignment(TextLayer *t, GTextAlignment a);
+void text_layer_set_overflow_mode(TextLayer *t, GTextOverflowMode m);
+
+// Status bar
+#define STATUS_BAR_LAYER_HEIGHT 16
+typedef enum { StatusBarLayerSeparatorModeNone, StatusBarLayerSeparatorModeDotted } StatusBarLayerSeparatorMode;
+StatusBarLayer *status_bar_layer_create(void);
+void status_bar_layer_destroy(StatusBarLayer *s);
+Layer *status_bar_layer_get_layer(StatusBarLayer *s);
+void status_bar_layer_set_colors(StatusBarLayer *s, GColor bg, GColor fg);
+void status_bar_layer_set_separator_mode(StatusBarLayer *s, StatusBarLayerSeparatorMode m);
+
+// Graphics
+#define FONT_KEY_GOTHIC_14 "gothic14"
+#define FONT_KEY_GOTHIC_14_BOLD "gothic14b"
+#define FONT_KEY_GOTHIC_18 "gothic18"
+#define FONT_KEY_GOTHIC_18_BOLD "gothic18b"
+#define FONT_KEY_GOTHIC_24_BOLD "gothic24b"
+GFont fonts_get_system_font(const char *key);
+void graphics_context_set_fill_color(GContext *ctx, GColor c);
+void graphics_context_set_stroke_color(GContext *ctx, GColor c);
+void graphics_context_set_text_color(GContext *ctx, GColor c);
+void graphics_context_set_compositing_mode(GContext *ctx, GCompOp op);
+void graphics_fill_rect(GContext *ctx, GRect rect, uint16_t radius, GCornersMask mask);
+void graphics_draw_rect(GContext *ctx, GRect rect);
+void graphics_draw_bitmap_in_rect(GContext *ctx, const GBitmap *bmp, GRect rect);
+void graphics_draw_text(GContext *ctx, const char *text, GFont font, GRect box,
+                        GTextOverflowMode mode, GTextAlignment align, GTextAttributes *attr);
+GSize graphics_text_layout_get_content_size(const char *text, GFont font, GRect box,
+                                            GTextOverflowMode mode, GTextAlignment align);
+GBitmap *gbitmap_create_with_resource(uint32_t id);
+void gbitmap_destroy(GBitmap *bmp);
+GRect gbitmap_get_bounds(const GBitmap *bmp);
+#define RESOURCE_ID_CHECK_MARK 1
+#define RESOURCE_ID_APP_LOGO 2
+
+// Menu
+typedef struct { uint16_t section; uint16_t row; } MenuIndex;
+#define MENU_CELL_BASIC_HEADER_HEIGHT 16
+typedef uint16_t (*MenuLayerGetNumberOfSectionsCallback)(MenuLayer *, void *);
+typedef uint16_t (*MenuLayerGetNumberOfRowsInSectionsCallback)(MenuLayer *, uint16_t, void *);
+typedef int16_t (*MenuLayerGetCellHeightCallback)(MenuLayer *, MenuIndex *, void *);
+typedef int16_t (*MenuLayerGetHeaderHeightCallback)(MenuLayer *, uint16_t, void *);
+typedef void (*MenuLayerDrawHeaderCallback)(GContext *, const Layer *, uint16_t, void *);
+typedef void (*MenuLayerDrawRowCallback)(GContext *, const Layer *, MenuIndex *, void *);
+typedef void (*MenuLayerSelectCallback)(MenuLayer *, MenuIndex *, void *);
+typedef void (*MenuLayerSelectionChangedCallback)(MenuLayer *, MenuIndex, MenuIndex, void *);
+typedef struct {
+  MenuLayerGetNumberOfSectionsCallback get_num_sections;
+  MenuLayerGetNumberOfRowsInSectionsCallback get_num_rows;
+  MenuLayerGetCellHeightCallback get_cell_height;
+  MenuLayerGetHeaderHeightCallback get_header_height;
+  MenuLayerDrawRowCallback draw_row;
+  MenuLayerDrawHeaderCallback draw_header;
+  MenuLayerSelectCallback select_click;
+  MenuLayerSelectCallback select_long_click;
+  MenuLayerSelectionChangedCallback selection_changed;
+} MenuLayerCallbacks;
+typedef enum { MenuRowAlignNone, MenuRowAlignCenter, MenuRowAlignTop, MenuRowAlignBottom } MenuRowAlign;
+MenuLayer *menu_layer_create(GRect frame);
+void menu_layer_destroy(MenuLayer *m);
+Layer *menu_layer_get_layer(const MenuLayer *m);
+void menu_layer_set_callbacks(MenuLayer *m, void *ctx, MenuLayerCallbacks cbs);
+void menu_layer_set_click_config_onto_window(MenuLayer *m, Window *w);
+void menu_layer_set_highlight_colors(MenuLayer *m, GColor bg, GColor fg);
+void menu_layer_reload_data(MenuLayer *m);
+MenuIndex menu_layer_get_selected_index(const MenuLayer *m);
+void menu_layer_set_selected_index(MenuLayer *m, MenuIndex index, MenuRowAlign align, bool animated);
+bool menu_layer_is_index_selected(const MenuLayer *m, MenuIndex *index);
+
+// Animation
+typedef enum { AnimationCurveLinear, AnimationCurveEaseIn, AnimationCurveEaseOut, AnimationCurveEaseInOut } AnimationCurve;
+typedef void (*AnimationStartedHandler)(Animation *, void *);
+typedef void (*AnimationStoppedHandler)(Animation *, bool, void *);
+typedef struct { AnimationStartedHandler started; AnimationStoppedHandler stopped; } AnimationHandlers;
+typedef uint32_t AnimationProgress;
+#define ANIMATION_NORMALIZED_MAX 65535
+#define ANIMATION_PLAY_COUNT_INFINITE 0xFFFFFFFF
+#define ANIMATION_DURATION_INFINITE 0xFFFFFFFF
+typedef void (*AnimationSetupImplementation)(Animation *);
+typedef void (*AnimationUpdateImplementation)(Animation *, const AnimationProgress);
+typedef void (*AnimationTeardownImplementation)(Animation *);
+typedef struct { AnimationSetupImplementation setup; AnimationUpdateImplementation update; AnimationTeardownImplementation teardown; } AnimationImplementation;
+Animation *animation_create(void);
+bool animation_destroy(Animation *a);
+bool animation_set_implementation(Animation *a, const AnimationImplementation *impl);
+bool animation_set_duration(Animation *a, uint32_t ms);
+bool animation_set_delay(Animation *a, uint32_t ms);
+bool animation_set_curve(Animation *a, AnimationCurve c);
+bool animation_set_play_count(Animation *a, uint32_t count);
+bool animation_set_handlers(Animation *a, AnimationHandlers h, void *ctx);
+bool animation_schedule(Animation *a);
+bool animation_unschedule(Animation *a);
+bool animation_is_scheduled(Animation *a);
+PropertyAnimation *property_animation_create_layer_frame(Layer *layer, GRect *from, GRect *to);
+void property_animation_destroy(PropertyAnimation *a);
+
+// Timers & time
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback cb, void *data);
+void app_timer_cancel(AppTimer *t);
+bool app_timer_reschedule(AppTimer *t, uint32_t timeout_ms);
+uint16_t time_ms(time_t *t, uint16_t *ms);
+
+// Memory
+size_t heap_bytes_used(void);
+size_t heap_bytes_free(void);
+
+// Persist
+#define PERSIST_DATA_MAX_LENGTH 256
+#define PERSIST_STRING_MAX_LENGTH PERSIST_DATA_MAX_LENGTH
+#define E_DOES_NOT_EXIST (-4)
+typedef int status_t;
+bool persist_exists(uint32_t key);
+int persist_get_size(uint32_t key);
+int32_t persist_read_int(uint32_t key);
+status_t persist_write_int(uint32_t key, int32_t value);
+int persist_read_data(uint32_t key, void *buffer, size_t size);
+int persist_write_data(uint32_t key, const void *data, size_t size);
+status_t persist_delete(uint32_t key);
+
+// Dictionary / AppMessage
+typedef enum { TUPLE_BYTE_ARRAY = 0, TUPLE_CSTRING = 1, TUPLE_UINT = 2, TUPLE_INT = 3 } TupleType;
+typedef struct __attribute__((__packed__)) {
+  uint32_t key;
+  TupleType type:8;
+  uint16_t length;
+  union {
+    uint8_t data[0];
+    char cstring[0];
+    uint8_t uint8;
+    uint16_t uint16;
+    uint32_t uint32;
+    int8_t int8;
+    int16_t int16;
+    int32_t int32;
+  } value[];
+} Tuple;
+typedef struct __attribute__((__packed__)) { uint8_t count; Tuple head[]; } Dictionary;
+typedef struct { Dictionary *dictionary; const void *end; Tuple *cursor; } DictionaryIterator;
+typedef enum {
+  DICT_OK = 0, DICT_NOT_ENOUGH_STORAGE = 1 << 1, DICT_INVALID_ARGS = 1 << 2,
+  DICT_INTERNAL_INCONSISTENCY = 1 << 3, DICT_MALLOC_FAILED = 1 << 4,
+} DictionaryResult;
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key);
+Tuple *dict_read_first(DictionaryIterator *iter);
+Tuple *dict_read_next(DictionaryIterator *iter);
+DictionaryResult dict_write_begin(DictionaryIterator *iter, uint8_t *buffer, const uint16_t size);
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t *data, const uint16_t size);
+DictionaryResult dict_write_cstring(DictionaryIterator *iter, const uint32_t key, const char *cstring);
+DictionaryResult dict_write_int(DictionaryIterator *iter, const uint32_t key, const void *integer, const uint8_t width_bytes, const bool is_signed);
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value);
+DictionaryResult dict_write_uint16(DictionaryIterator *iter, const uint32_t key, const uint16_t value);
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key, const uint32_t value);
+DictionaryResult dict_write_int32(DictionaryIterator *iter, const uint32_t key, const int32_t value);
+uint32_t dict_write_end(DictionaryIterator *iter);
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...);
+
+typedef enum {
+  APP_MSG_OK = 0, APP_MSG_SEND_TIMEOUT = 1 << 1, APP_MSG_SEND_REJECTED = 1 << 2,
+  APP_MSG_NOT_CONNECTED = 1 << 3, APP_MSG_APP_NOT_RUNNING = 1 << 4, APP_MSG_INVALID_ARGS = 1 << 5,
+  APP_MSG_BUSY = 1 << 6, APP_MSG_BUFFER_OVERFLOW = 1 << 7, APP_MSG_ALREADY_RELEASED = 1 << 9,
+  APP_MSG_CALLBACK_ALREADY_REGISTERED = 1 << 10, APP_MSG_CALLBACK_NOT_REGISTERED = 1 << 11,
+  APP_MSG_OUT_OF_MEMORY = 1 << 12, APP_MSG_CLOSED = 1 << 13, APP_MSG_INTERNAL_ERROR = 1 << 14,
+  APP_MSG_INVALID_STATE = 1 << 15,
+} AppMessageResult;
+typedef void (*AppMessageInboxReceived)(DictionaryIterator *iter, void *ctx);
+typedef void (*AppMessageInboxDropped)(AppMessageResult reason, void *ctx);
+typedef void (*AppMessageOutboxSent)(DictionaryIterator *iter, void *ctx);
+typedef void (*AppMessageOutboxFailed)(DictionaryIterator *iter, AppMessageResult reason, void *ctx);
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound);
+uint32_t app_message_inbox_size_maximum(void);
+uint32_t app_message_outbox_size_maximum(void);
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived cb);
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped cb);
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent cb);
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed cb);
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iter);
+AppMessageResult app_message_outbox_send(void);
+
+// Connection
+typedef void (*ConnectionHandler)(bool connected);
+typedef struct { ConnectionHandler pebble_app_connection_handler; ConnectionHandler pebblekit_connection_handler; } ConnectionHandlers;
+void connection_service_subscribe(ConnectionHandlers handlers);
+void connection_service_unsubscribe(void);
+bool connection_service_peek_pebble_app_connection(void);
+
+// Clicks
+typedef void (*ClickHandler)(void *recognizer, void *context);
+
+// App lifecycle
+void app_event_loop(void);
+typedef enum {
+  APP_LAUNCH_SYSTEM, APP_LAUNCH_USER, APP_LAUNCH_PHONE, APP_LAUNCH_WAKEUP, APP_LAUNCH_WORKER,
+  APP_LAUNCH_QUICK_LAUNCH, APP_LAUNCH_TIMELINE_ACTION, APP_LAUNCH_SMARTSTRAP,
+} AppLaunchReason;
+AppLaunchReason launch_reason(void);
+
+// Wakeup
+typedef int32_t WakeupId;
+WakeupId wakeup_schedule(time_t timestamp, int32_t cookie, bool notify_if_missed);
+void wakeup_cancel_all(void);
+bool wakeup_get_launch_event(WakeupId *wakeup_id, int32_t *cookie);
+
+// App glance
+typedef struct AppGlanceReloadSession AppGlanceReloadSession;
+typedef enum {
+  APP_GLANCE_RESULT_SUCCESS = 0, APP_GLANCE_RESULT_INVALID_TEMPLATE_STRING = 1 << 0,
+  APP_GLANCE_RESULT_TEMPLATE_STRING_TOO_LONG = 1 << 1, APP_GLANCE_RESULT_INVALID_ICON = 1 << 2,
+  APP_GLANCE_RESULT_SLICE_CAPACITY_EXCEEDED = 1 << 3, APP_GLANCE_RESULT_EXPIRES_IN_THE_PAST = 1 << 4,
+  APP_GLANCE_RESULT_INVALID_SESSION = 1 << 5,
+} AppGlanceResult;
+#define APP_GLANCE_SLICE_DEFAULT_ICON 0
+#define APP_GLANCE_SLICE_NO_EXPIRATION ((time_t)0)
+typedef struct {
+  struct { uint32_t icon; const char *subtitle_template_string; } layout;
+  time_t expiration_time;
+} AppGlanceSlice;
+typedef void (*AppGlanceReloadCallback)(AppGlanceReloadSession *session, size_t limit, void *context);
+AppGlanceResult app_glance_add_slice(AppGlanceReloadSession *session, AppGlanceSlice slice);
+void app_glance_reload(AppGlanceReloadCallback callback, void *context);
+
+// Heap accounting: all allocations of the code under test go through these so
+// tests can report allocation counts and peak heap usage.
+void *shim_malloc(size_t size);
+void *shim_calloc(size_t count, size_t size);
+void *shim_realloc(void *ptr, size_t size);
+void shim_free(void *ptr);
+#define malloc shim_malloc
+#define calloc shim_calloc
+#define realloc shim_realloc
+#define free shim_free
@@ -0,0 +1,83 @@
+#pragma once
+// Helpers for tests that play the companion's part.
+#include <stdio.h>
+
+#include "message_keys.auto.h"
+#include "shim.h"
+
+static inline void msg_int(DictionaryIterator *iter, uint32_t key, int32_t value) {
+  dict_write_int(iter, key, &value, sizeof(value), true);
+}
+
+// Announce a list the way the companion does.
+static inline void send_list_setup(int count, int num_sections, int page_bytes, int32_t hash) {
+  DictionaryIterator *iter = shim_message_begin();
+  msg_int(iter, MESSAGE_KEY_ITEMS_COUNT, count);
+  if (num_sections > 0) msg_int(iter, MESSAGE_KEY_SECTION_COUNT, num_sections);
+  msg_int(iter, MESSAGE_KEY_ITEMS_PAGE_BYTES, page_bytes);
+  if (hash) msg_int(iter, MESSAGE_KEY_LIST_HASH, hash);
+  shim_message_deliver();
+}
+
+// Send the header of one section as a SECTION_HEADERS blob.
+static inline void send_section(int index, const char *title, int item_count) {
+  uint8_t blob[4 + 255];
+  size_t length = strlen(title);
+  blob[0] = index;
+  blob[1] = item_count & 0xff;
+  blob[2] = item_count >> 8;
+  blob[3] = length;
+  memcpy(blob + 4, title, length);
+  DictionaryIterator *iter = shim_message_begin();
+  dict_write_data(iter, MESSAGE_KEY_SECTION_HEADERS, blob, 4 + length);
+  shim_message_deliver();
+}
+
+// Send items [first, end) labelled "item <index>" in ITEMS_BATCH messages;
+// every third item is checked.
+static inline void send_items(int first, int end) {
+  static uint8_t blob[2048];
+  while (first < end) {
+    size_t pos = 2;
+    blob[0] = first & 0xff;
+    blob[1] = first >> 8;
+    int index = first;
+    for (; index < end && pos + 2 + 16 < sizeof(blob); index++) {
+      int length = snprintf((char *)blob + pos + 2, 16, "item %d", index);
+      blob[pos] = index % 3 == 0 ? 0x01 : 0;
+      blob[pos + 1] = length;
+      pos += 2 + length;
+    }
+    DictionaryIterator *iter = shim_message_begin();
+    dict_write_data(iter, MESSAGE_KEY_ITEMS_BATCH, blob, pos);
+    shim_message_deliver();
+    first = index;
+  }
+}
+
+// Value of `key` in the last message the watch sent, or -1.
+static inline int32_t last_sent_int(uint32_t key) {
+  DictionaryIterator *iter = shim_last_sent();
+  Tuple *tuple = iter ? dict_find(iter, key) : NULL;
+  return tuple ? tuple->value->int32 : -1;
+}
+
+// State the last message the watch sent gives item `id` in its ITEM_TOGGLES:
+// 1 checked, 0 unchecked, -1 if it does not name the item.
+static inline int last_sent_toggle(int id) {
+  DictionaryIterator *iter = shim_last_sent();
+  Tuple *tuple = iter ? dict_find(iter, MESSAGE_KEY_ITEM_TOGGLES) : NULL;
+  if (!tuple) return -1;
+  for (int pos = 0; pos + 3 <= tuple->length; pos += 3) {
+    const uint8_t *entry = tuple->value->data + pos;
+    if ((entry[0] | (entry[1] << 8)) == id) return entry[2];
+  }
+  return -1;
+}
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      exit(1); \
+    } \
+  } while (0)
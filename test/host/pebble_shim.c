@@ -0,0 +1,750 @@
+// Fake implementations of the Pebble SDK used by the host-side tests.
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pebble.h"
+#include "shim.h"
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+ShimState shim;
+
+// --- Heap ---
+
+typedef struct { size_t size; size_t pad; } AllocHeader;
+
+void *shim_malloc(size_t size) {
+  if (shim.heap_limit && shim.heap_used + size > shim.heap_limit) {
+    shim.failed_allocs++;
+    return NULL;
+  }
+  AllocHeader *h = malloc(sizeof(AllocHeader) + size);
+  if (!h) return NULL;
+  h->size = size;
+  shim.heap_used += size;
+  shim.allocs++;
+  if (shim.heap_used > shim.heap_peak) shim.heap_peak = shim.heap_used;
+  return h + 1;
+}
+
+void *shim_calloc(size_t count, size_t size) {
+  void *p = shim_malloc(count * size);
+  if (p) memset(p, 0, count * size);
+  return p;
+}
+
+void shim_free(void *ptr) {
+  if (!ptr) return;
+  AllocHeader *h = (AllocHeader *)ptr - 1;
+  shim.heap_used -= h->size;
+  shim.frees++;
+  free(h);
+}
+
+void *shim_realloc(void *ptr, size_t size) {
+  if (!ptr) return shim_malloc(size);
+  AllocHeader *h = (AllocHeader *)ptr - 1;
+  void *p = shim_malloc(size);
+  if (!p) return NULL;
+  memcpy(p, ptr, h->size < size ? h->size : size);
+  shim_free(ptr);
+  return p;
+}
+
+size_t heap_bytes_used(void) { return shim.heap_used; }
+size_t heap_bytes_free(void) {
+  size_t limit = shim.heap_limit ? shim.heap_limit : 65536;
+  return shim.heap_used < limit ? limit - shim.heap_used : 0;
+}
+
+// --- Logging ---
+
+void app_log(uint8_t level, const char *file, int line, const char *fmt, ...) {
+  if (!shim.verbose && level > APP_LOG_LEVEL_WARNING) return;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "[%d] %s:%d ", level, file, line);
+  vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+}
+
+// --- Layers ---
+
+struct Layer {
+  GRect frame;
+  LayerUpdateProc update_proc;
+  Layer *parent;
+  bool hidden;
+  void *data;
+};
+
+Layer *layer_create(GRect frame) {
+  Layer *l = calloc(1, sizeof(Layer));
+  l->frame = frame;
+  return l;
+}
+Layer *layer_create_with_data(GRect frame, size_t data_size) {
+  Layer *l = layer_create(frame);
+  l->data = calloc(1, data_size);
+  return l;
+}
+void *layer_get_data(const Layer *layer) { return layer->data; }
+void layer_destroy(Layer *layer) {
+  if (!layer) return;
+  free(layer->data);
+  free(layer);
+}
+void layer_mark_dirty(Layer *layer) { shim.dirty_marks++; }
+void layer_set_update_proc(Layer *layer, LayerUpdateProc proc) { layer->update_proc = proc; }
+void layer_set_frame(Layer *layer, GRect frame) { layer->frame = frame; }
+GRect layer_get_frame(const Layer *layer) { return layer->frame; }
+GRect layer_get_bounds(const Layer *layer) {
+  return GRect(0, 0, layer->frame.size.w, layer->frame.size.h);
+}
+void layer_add_child(Layer *parent, Layer *child) { child->parent = parent; }
+void layer_remove_from_parent(Layer *child) { child->parent = NULL; }
+void layer_set_hidden(Layer *layer, bool hidden) { layer->hidden = hidden; }
+bool layer_get_hidden(const Layer *layer) { return layer->hidden; }
+
+// --- Window ---
+
+struct Window { Layer *root; WindowHandlers handlers; };
+
+Window *window_create(void) {
+  Window *w = calloc(1, sizeof(Window));
+  w->root = layer_create(GRect(0, 0, SHIM_SCREEN_WIDTH, SHIM_SCREEN_HEIGHT));
+  return w;
+}
+void window_destroy(Window *window) {
+  if (!window) return;
+  if (window->handlers.unload) window->handlers.unload(window);
+  layer_destroy(window->root);
+  free(window);
+}
+void window_set_window_handlers(Window *window, WindowHandlers handlers) {
+  window->handlers = handlers;
+}
+Layer *window_get_root_layer(const Window *window) { return window->root; }
+void window_set_background_color(Window *window, GColor color) {}
+void window_stack_push(Window *window, bool animated) {
+  if (window->handlers.load) window->handlers.load(window);
+}
+void window_stack_pop_all(bool animated) { shim.windows_popped = true; }
+
+// --- Text layer ---
+
+struct TextLayer { Layer *layer; const char *text; };
+
+TextLayer *text_layer_create(GRect frame) {
+  TextLayer *t = calloc(1, sizeof(TextLayer));
+  t->layer = layer_create(frame);
+  return t;
+}
+void text_layer_destroy(TextLayer *t) {
+  if (!t) return;
+  layer_destroy(t->layer);
+  free(t);
+}
+Layer *text_layer_get_layer(TextLayer *t) { return t->layer; }
+void text_layer_set_text(TextLayer *t, const char *text) {
+  t->text = text;
+  shim.text_layer_text = text;
+}
+void text_layer_set_font(TextLayer *t, GFont font) {}
+void text_layer_set_background_color(TextLayer *t, GColor c) {}
+void text_layer_set_text_color(TextLayer *t, GColor c) {}
+void text_layer_set_text_alignment(TextLayer *t, GTextAlignment a) {}
+void text_layer_set_overflow_mode(TextLayer *t, GTextOverflowMode m) {}
+
+// --- Status bar layer ---
+
+struct StatusBarLayer { Layer *layer; };
+
+StatusBarLayer *status_bar_layer_create(void) {
+  StatusBarLayer *s = calloc(1, sizeof(StatusBarLayer));
+  s->layer = layer_create(GRect(0, 0, SHIM_SCREEN_WIDTH, STATUS_BAR_LAYER_HEIGHT));
+  return s;
+}
+void status_bar_layer_destroy(StatusBarLayer *s) {
+  if (!s) return;
+  layer_destroy(s->layer);
+  free(s);
+}
+Layer *status_bar_layer_get_layer(StatusBarLayer *s) { return s->layer; }
+void status_bar_layer_set_colors(StatusBarLayer *s, GColor bg, GColor fg) {}
+void status_bar_layer_set_separator_mode(StatusBarLayer *s, StatusBarLayerSeparatorMode m) {}
+
+// --- Graphics ---
+
+GFont fonts_get_system_font(const char *key) { return (GFont)key; }
+void graphics_context_set_fill_color(GContext *ctx, GColor c) {}
+void graphics_context_set_stroke_color(GContext *ctx, GColor c) {}
+void graphics_context_set_text_color(GContext *ctx, GColor c) {}
+void graphics_context_set_compositing_mode(GContext *ctx, GCompOp op) {}
+void graphics_fill_rect(GContext *ctx, GRect rect, uint16_t radius, GCornersMask mask) {}
+void graphics_draw_rect(GContext *ctx, GRect rect) {}
+void graphics_draw_bitmap_in_rect(GContext *ctx, const GBitmap *bmp, GRect rect) {}
+
+void graphics_draw_text(GContext *ctx, const char *text, GFont font, GRect box,
+                        GTextOverflowMode mode, GTextAlignment align, GTextAttributes *attr) {
+  shim.texts_drawn++;
+  strncpy(shim.last_text, text ? text : "", sizeof(shim.last_text) - 1);
+  shim.last_text[sizeof(shim.last_text) - 1] = '\0';
+}
+
+// Fixed-width font model: 7 px per byte, 18 px per line.
+GSize graphics_text_layout_get_content_size(const char *text, GFont font, GRect box,
+                                            GTextOverflowMode mode, GTextAlignment align) {
+  shim.text_measurements++;
+  int chars_per_line = box.size.w / 7;
+  if (chars_per_line < 1) chars_per_line = 1;
+  int len = (int)strlen(text);
+  int lines = len == 0 ? 1 : (len + chars_per_line - 1) / chars_per_line;
+  int h = lines * 18;
+  if (mode != GTextOverflowModeWordWrap) h = 18;
+  if (h > box.size.h) h = box.size.h;
+  return GSize(len < chars_per_line ? len * 7 : box.size.w, h);
+}
+
+struct GBitmap { GRect bounds; };
+GBitmap *gbitmap_create_with_resource(uint32_t id) {
+  GBitmap *b = calloc(1, sizeof(GBitmap));
+  b->bounds = GRect(0, 0, 14, 14);
+  return b;
+}
+void gbitmap_destroy(GBitmap *bmp) { free(bmp); }
+GRect gbitmap_get_bounds(const GBitmap *bmp) { return bmp->bounds; }
+
+// --- Menu layer (records callbacks, "draws" the visible rows on demand) ---
+
+struct MenuLayer {
+  Layer *layer;
+  MenuLayerCallbacks callbacks;
+  void *ctx;
+  MenuIndex selected;
+};
+
+MenuLayer *menu_layer_create(GRect frame) {
+  MenuLayer *m = calloc(1, sizeof(MenuLayer));
+  m->layer = layer_create(frame);
+  shim.menu = m;
+  shim.menus_created++;
+  return m;
+}
+void menu_layer_destroy(MenuLayer *m) {
+  if (!m) return;
+  if (shim.menu == m) shim.menu = NULL;
+  layer_destroy(m->layer);
+  free(m);
+}
+Layer *menu_layer_get_layer(const MenuLayer *m) { return m->layer; }
+void menu_layer_set_callbacks(MenuLayer *m, void *ctx, MenuLayerCallbacks cbs) {
+  m->callbacks = cbs;
+  m->ctx = ctx;
+}
+void menu_layer_set_click_config_onto_window(MenuLayer *m, Window *w) {}
+void menu_layer_set_highlight_colors(MenuLayer *m, GColor bg, GColor fg) {}
+void menu_layer_reload_data(MenuLayer *m) { shim.menu_reloads++; }
+MenuIndex menu_layer_get_selected_index(const MenuLayer *m) { return m->selected; }
+void menu_layer_set_selected_index(MenuLayer *m, MenuIndex index, MenuRowAlign align, bool animated) {
+  MenuIndex old = m->selected;
+  m->selected = index;
+  if (m->callbacks.selection_changed) m->callbacks.selection_changed(m, index, old, m->ctx);
+}
+bool menu_layer_is_index_selected(const MenuLayer *m, MenuIndex *index) {
+  return m->selected.section == index->section && m->selected.row == index->row;
+}
+
+int shim_menu_draw(int max_height) {
+  MenuLayer *m = shim.menu;
+  if (!m) return 0;
+  MenuLayerCallbacks *cb = &m->callbacks;
+  Layer *cell = layer_create(GRect(0, 0, m->layer->frame.size.w, 0));
+  int y = 0;
+  int rows = 0;
+  uint16_t sections = cb->get_num_sections ? cb->get_num_sections(m, m->ctx) : 1;
+  for (uint16_t s = 0; s < sections && y < max_height; s++) {
+    int16_t hh = cb->get_header_height ? cb->get_header_height(m, s, m->ctx) : 0;
+    cell->frame.size.h = hh;
+    if (hh > 0 && cb->draw_header) cb->draw_header(NULL, cell, s, m->ctx);
+    y += hh;
+    uint16_t n = cb->get_num_rows(m, s, m->ctx);
+    for (uint16_t r = 0; r < n && y < max_height; r++) {
+      MenuIndex idx = { s, r };
+      int16_t h = cb->get_cell_height ? cb->get_cell_height(m, &idx, m->ctx) : 44;
+      cell->frame.size.h = h;
+      cb->draw_row(NULL, cell, &idx, m->ctx);
+      y += h;
+      rows++;
+    }
+  }
+  layer_destroy(cell);
+  return rows;
+}
+
+void shim_menu_click(MenuIndex idx, bool long_click) {
+  MenuLayer *m = shim.menu;
+  if (!m) return;
+  MenuLayerSelectCallback cb = long_click ? m->callbacks.select_long_click : m->callbacks.select_click;
+  if (cb) cb(m, &idx, m->ctx);
+}
+
+// --- Animation (driven by the fake clock, see shim_advance) ---
+
+struct Animation {
+  AnimationHandlers handlers;
+  void *ctx;
+  AnimationImplementation impl;
+  bool scheduled;
+  bool is_property;
+  uint32_t delay;
+  uint32_t duration;
+  uint32_t play_count;
+  uint64_t end;
+  Animation *next_scheduled;
+};
+struct PropertyAnimation { Animation base; Layer *layer; GRect to; };
+
+static Animation *s_scheduled;
+
+static void prv_animation_init(Animation *a) {
+  a->duration = 250;
+  a->play_count = 1;
+  shim.animations_created++;
+}
+
+static void prv_animation_unlink(Animation *a) {
+  for (Animation **p = &s_scheduled; *p; p = &(*p)->next_scheduled) {
+    if (*p == a) { *p = a->next_scheduled; break; }
+  }
+  a->scheduled = false;
+}
+
+Animation *animation_create(void) {
+  Animation *a = calloc(1, sizeof(Animation));
+  prv_animation_init(a);
+  return a;
+}
+// Destroying a scheduled animation just drops it, without calling handlers
+bool animation_destroy(Animation *a) {
+  if (!a) return false;
+  if (a->scheduled) prv_animation_unlink(a);
+  free(a);
+  return true;
+}
+bool animation_set_implementation(Animation *a, const AnimationImplementation *impl) { a->impl = *impl; return true; }
+bool animation_set_duration(Animation *a, uint32_t ms) { a->duration = ms; return true; }
+bool animation_set_delay(Animation *a, uint32_t ms) { a->delay = ms; return true; }
+bool animation_set_curve(Animation *a, AnimationCurve c) { return true; }
+bool animation_set_play_count(Animation *a, uint32_t count) { a->play_count = count; return true; }
+bool animation_set_handlers(Animation *a, AnimationHandlers h, void *ctx) { a->handlers = h; a->ctx = ctx; return true; }
+bool animation_schedule(Animation *a) {
+  if (a->scheduled) prv_animation_unlink(a);
+  if (a->duration == ANIMATION_DURATION_INFINITE || a->play_count == ANIMATION_PLAY_COUNT_INFINITE) {
+    a->end = UINT64_MAX;
+  } else {
+    a->end = shim.now_ms + a->delay + (uint64_t)a->duration * (a->play_count ? a->play_count : 1);
+  }
+  a->scheduled = true;
+  a->next_scheduled = s_scheduled;
+  s_scheduled = a;
+  shim.animations_scheduled++;
+  if (a->handlers.started) a->handlers.started(a, a->ctx);
+  return true;
+}
+bool animation_unschedule(Animation *a) {
+  if (!a->scheduled) return false;
+  prv_animation_unlink(a);
+  if (a->handlers.stopped) a->handlers.stopped(a, false, a->ctx);
+  return true;
+}
+bool animation_is_scheduled(Animation *a) { return a && a->scheduled; }
+
+int shim_animations_running(void) {
+  int count = 0;
+  for (Animation *a = s_scheduled; a; a = a->next_scheduled) count++;
+  return count;
+}
+
+PropertyAnimation *property_animation_create_layer_frame(Layer *layer, GRect *from, GRect *to) {
+  PropertyAnimation *p = calloc(1, sizeof(PropertyAnimation));
+  prv_animation_init(&p->base);
+  p->base.is_property = true;
+  p->layer = layer;
+  p->to = to ? *to : layer->frame;
+  return p;
+}
+void property_animation_destroy(PropertyAnimation *a) { animation_destroy((Animation *)a); }
+
+// Run an animation to its end. Its stopped handler may destroy it.
+static void prv_animation_finish(Animation *a) {
+  prv_animation_unlink(a);
+  shim.animations_finished++;
+  if (a->is_property) {
+    PropertyAnimation *p = (PropertyAnimation *)a;
+    p->layer->frame = p->to;
+  }
+  if (a->handlers.stopped) a->handlers.stopped(a, true, a->ctx);
+}
+
+// --- Timers and the fake clock ---
+
+struct AppTimer { uint64_t due; AppTimerCallback cb; void *data; AppTimer *next; };
+static AppTimer *s_timers;
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback cb, void *data) {
+  AppTimer *t = calloc(1, sizeof(AppTimer));
+  t->due = shim.now_ms + timeout_ms;
+  t->cb = cb;
+  t->data = data;
+  t->next = s_timers;
+  s_timers = t;
+  return t;
+}
+void app_timer_cancel(AppTimer *t) {
+  for (AppTimer **p = &s_timers; *p; p = &(*p)->next) {
+    if (*p == t) { *p = t->next; free(t); return; }
+  }
+}
+bool app_timer_reschedule(AppTimer *t, uint32_t timeout_ms) {
+  for (AppTimer *it = s_timers; it; it = it->next) {
+    if (it == t) { t->due = shim.now_ms + timeout_ms; return true; }
+  }
+  return false;
+}
+
+// Move the clock forward, firing timers and finishing animations in order.
+void shim_advance(uint32_t ms) {
+  uint64_t target = shim.now_ms + ms;
+  for (;;) {
+    AppTimer *next = NULL;
+    for (AppTimer *t = s_timers; t; t = t->next) {
+      if (t->due <= target && (!next || t->due < next->due)) next = t;
+    }
+    Animation *anim = NULL;
+    for (Animation *a = s_scheduled; a; a = a->next_scheduled) {
+      if (a->end <= target && (!anim || a->end < anim->end)) anim = a;
+    }
+    if (anim && (!next || anim->end <= next->due)) {
+      shim.now_ms = anim->end;
+      prv_animation_finish(anim);
+      continue;
+    }
+    if (!next) break;
+    shim.now_ms = next->due;
+    AppTimerCallback cb = next->cb;
+    void *data = next->data;
+    app_timer_cancel(next);
+    cb(data);
+  }
+  shim.now_ms = target;
+}
+
+uint16_t time_ms(time_t *t, uint16_t *ms) {
+  if (t) *t = (time_t)(shim.now_ms / 1000);
+  if (ms) *ms = (uint16_t)(shim.now_ms % 1000);
+  return (uint16_t)(shim.now_ms % 1000);
+}
+
+// --- Persist (in-memory, enforcing the per-key size limit) ---
+
+#define SHIM_PERSIST_KEYS 256
+static struct { bool used; uint32_t key; int size; uint8_t data[PERSIST_DATA_MAX_LENGTH]; } s_persist[SHIM_PERSIST_KEYS];
+
+static int prv_persist_slot(uint32_t key, bool create) {
+  for (int i = 0; i < SHIM_PERSIST_KEYS; i++) {
+    if (s_persist[i].used && s_persist[i].key == key) return i;
+  }
+  if (!create) return -1;
+  for (int i = 0; i < SHIM_PERSIST_KEYS; i++) {
+    if (!s_persist[i].used) { s_persist[i].used = true; s_persist[i].key = key; return i; }
+  }
+  return -1;
+}
+bool persist_exists(uint32_t key) { return prv_persist_slot(key, false) >= 0; }
+int persist_get_size(uint32_t key) {
+  int i = prv_persist_slot(key, false);
+  return i < 0 ? E_DOES_NOT_EXIST : s_persist[i].size;
+}
+int32_t persist_read_int(uint32_t key) {
+  int32_t v = 0;
+  persist_read_data(key, &v, sizeof(v));
+  return v;
+}
+status_t persist_write_int(uint32_t key, int32_t value) {
+  return persist_write_data(key, &value, sizeof(value));
+}
+int persist_read_data(uint32_t key, void *buffer, size_t size) {
+  int i = prv_persist_slot(key, false);
+  if (i < 0) return E_DOES_NOT_EXIST;
+  int n = s_persist[i].size < (int)size ? s_persist[i].size : (int)size;
+  memcpy(buffer, s_persist[i].data, n);
+  return n;
+}
+int persist_write_data(uint32_t key, const void *data, size_t size) {
+  if (size > PERSIST_DATA_MAX_LENGTH) size = PERSIST_DATA_MAX_LENGTH;
+  int i = prv_persist_slot(key, true);
+  if (i < 0) return -1;
+  memcpy(s_persist[i].data, data, size);
+  s_persist[i].size = (int)size;
+  shim.persist_writes++;
+  return (int)size;
+}
+status_t persist_delete(uint32_t key) {
+  int i = prv_persist_slot(key, false);
+  if (i >= 0) s_persist[i].used = false;
+  return 0;
+}
+int shim_persist_total_bytes(void) {
+  int total = 0;
+  for (int i = 0; i < SHIM_PERSIST_KEYS; i++) if (s_persist[i].used) total += s_persist[i].size;
+  return total;
+}
+void shim_persist_clear(void) { memset(s_persist, 0, sizeof(s_persist)); }
+
+// --- Dictionary ---
+
+#define TUPLE_SIZE(t) (sizeof(Tuple) + (t)->length)
+
+DictionaryResult dict_write_begin(DictionaryIterator *iter, uint8_t *buffer, const uint16_t size) {
+  if (!iter || !buffer || size < sizeof(Dictionary)) return DICT_INVALID_ARGS;
+  iter->dictionary = (Dictionary *)buffer;
+  iter->dictionary->count = 0;
+  iter->end = buffer + size;
+  iter->cursor = iter->dictionary->head;
+  return DICT_OK;
+}
+
+static DictionaryResult prv_dict_write(DictionaryIterator *iter, uint32_t key, TupleType type,
+                                       const void *data, uint16_t length) {
+  uint8_t *cursor = (uint8_t *)iter->cursor;
+  if (cursor + sizeof(Tuple) + length > (const uint8_t *)iter->end) return DICT_NOT_ENOUGH_STORAGE;
+  Tuple *t = (Tuple *)cursor;
+  t->key = key;
+  t->type = type;
+  t->length = length;
+  memcpy(t->value, data, length);
+  iter->cursor = (Tuple *)(cursor + sizeof(Tuple) + length);
+  iter->dictionary->count++;
+  return DICT_OK;
+}
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t *data, const uint16_t size) {
+  return prv_dict_write(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+DictionaryResult dict_write_cstring(DictionaryIterator *iter, const uint32_t key, const char *cstring) {
+  return prv_dict_write(iter, key, TUPLE_CSTRING, cstring, (uint16_t)strlen(cstring) + 1);
+}
+DictionaryResult dict_write_int(DictionaryIterator *iter, const uint32_t key, const void *integer,
+                                const uint8_t width_bytes, const bool is_signed) {
+  return prv_dict_write(iter, key, is_signed ? TUPLE_INT : TUPLE_UINT, integer, width_bytes);
+}
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value) {
+  return prv_dict_write(iter, key, TUPLE_UINT, &value, 1);
+}
+DictionaryResult dict_write_uint16(DictionaryIterator *iter, const uint32_t key, const uint16_t value) {
+  return prv_dict_write(iter, key, TUPLE_UINT, &value, 2);
+}
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key, const uint32_t value) {
+  return prv_dict_write(iter, key, TUPLE_UINT, &value, 4);
+}
+DictionaryResult dict_write_int32(DictionaryIterator *iter, const uint32_t key, const int32_t value) {
+  return prv_dict_write(iter, key, TUPLE_INT, &value, 4);
+}
+uint32_t dict_write_end(DictionaryIterator *iter) {
+  uint32_t size = (uint32_t)((uint8_t *)iter->cursor - (uint8_t *)iter->dictionary);
+  iter->end = iter->cursor;
+  iter->cursor = iter->dictionary->head;
+  return size;
+}
+
+Tuple *dict_read_first(DictionaryIterator *iter) {
+  iter->cursor = iter->dictionary->head;
+  return iter->dictionary->count ? iter->cursor : NULL;
+}
+Tuple *dict_read_next(DictionaryIterator *iter) {
+  Tuple *next = (Tuple *)((uint8_t *)iter->cursor + TUPLE_SIZE(iter->cursor));
+  if ((const void *)next >= iter->end) return NULL;
+  iter->cursor = next;
+  return next;
+}
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key) {
+  Tuple *t = iter->dictionary->head;
+  for (int i = 0; i < iter->dictionary->count; i++) {
+    if (t->key == key) return t;
+    t = (Tuple *)((uint8_t *)t + TUPLE_SIZE(t));
+  }
+  return NULL;
+}
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...) {
+  va_list args;
+  va_start(args, tuple_count);
+  uint32_t size = sizeof(Dictionary);
+  for (int i = 0; i < tuple_count; i++) size += sizeof(Tuple) + va_arg(args, uint32_t);
+  va_end(args);
+  return size;
+}
+
+// --- AppMessage ---
+
+static AppMessageInboxReceived s_inbox_received;
+static AppMessageInboxDropped s_inbox_dropped;
+static AppMessageOutboxSent s_outbox_sent;
+static AppMessageOutboxFailed s_outbox_failed;
+static uint8_t s_outbox_buffer[SHIM_OUTBOX_CAPACITY];
+static DictionaryIterator s_outbox_iter;
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound) {
+  shim.inbox_size = size_inbound;
+  shim.outbox_size = size_outbound < sizeof(s_outbox_buffer) ? size_outbound : sizeof(s_outbox_buffer);
+  // The real inbox and outbox buffers come out of the app heap as well. An app
+  // started again by a test gets new ones in place of the old.
+  static size_t s_open_bytes = 0;
+  shim.heap_used += size_inbound + size_outbound - s_open_bytes;
+  s_open_bytes = size_inbound + size_outbound;
+  if (shim.heap_used > shim.heap_peak) shim.heap_peak = shim.heap_used;
+  return APP_MSG_OK;
+}
+uint32_t app_message_inbox_size_maximum(void) { return SHIM_INBOX_MAXIMUM; }
+uint32_t app_message_outbox_size_maximum(void) { return SHIM_OUTBOX_CAPACITY; }
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived cb) {
+  AppMessageInboxReceived old = s_inbox_received; s_inbox_received = cb; return old;
+}
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped cb) {
+  AppMessageInboxDropped old = s_inbox_dropped; s_inbox_dropped = cb; return old;
+}
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent cb) {
+  AppMessageOutboxSent old = s_outbox_sent; s_outbox_sent = cb; return old;
+}
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed cb) {
+  AppMessageOutboxFailed old = s_outbox_failed; s_outbox_failed = cb; return old;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iter) {
+  if (shim.outbox_busy) return APP_MSG_BUSY;
+  dict_write_begin(&s_outbox_iter, s_outbox_buffer, (uint16_t)shim.outbox_size);
+  *iter = &s_outbox_iter;
+  shim.outbox_busy = true;
+  return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_send(void) {
+  if (!shim.outbox_busy) return APP_MSG_INVALID_STATE;
+  uint32_t size = dict_write_end(&s_outbox_iter);
+  // The last SHIM_MAX_SENT messages are kept
+  int i = shim.sent_count % SHIM_MAX_SENT;
+  memcpy(shim.sent[i].data, s_outbox_buffer, size);
+  shim.sent[i].size = size;
+  shim.sent_count++;
+  return APP_MSG_OK;
+}
+
+// Complete the pending outbox send: acknowledged by the phone or failed.
+void shim_outbox_complete(AppMessageResult result) {
+  if (!shim.outbox_busy) return;
+  shim.outbox_busy = false;
+  if (result == APP_MSG_OK) {
+    if (s_outbox_sent) s_outbox_sent(&s_outbox_iter, NULL);
+  } else {
+    if (s_outbox_failed) s_outbox_failed(&s_outbox_iter, result, NULL);
+  }
+}
+
+DictionaryIterator *shim_last_sent(void) {
+  static DictionaryIterator iter;
+  if (shim.sent_count == 0) return NULL;
+  int i = (shim.sent_count - 1) % SHIM_MAX_SENT;
+  iter.dictionary = (Dictionary *)shim.sent[i].data;
+  iter.end = shim.sent[i].data + shim.sent[i].size;
+  iter.cursor = iter.dictionary->head;
+  return &iter;
+}
+
+// Build a message to the watch in a static buffer: shim_message_begin(), the
+// usual dict_write_*() calls, then shim_message_deliver().
+static uint8_t s_message_buffer[SHIM_INBOX_MAXIMUM];
+static DictionaryIterator s_message_iter;
+
+DictionaryIterator *shim_message_begin(void) {
+  dict_write_begin(&s_message_iter, s_message_buffer, sizeof(s_message_buffer));
+  return &s_message_iter;
+}
+
+bool shim_message_deliver(void) {
+  dict_write_end(&s_message_iter);
+  return shim_deliver(&s_message_iter);
+}
+
+bool shim_deliver(DictionaryIterator *iter) {
+  uint32_t size = (uint32_t)((const uint8_t *)iter->end - (const uint8_t *)iter->dictionary);
+  if (size > shim.inbox_size) {
+    shim.inbox_dropped++;
+    if (s_inbox_dropped) s_inbox_dropped(APP_MSG_BUFFER_OVERFLOW, NULL);
+    return false;
+  }
+  shim.inbox_received++;
+  if (s_inbox_received) s_inbox_received(iter, NULL);
+  return true;
+}
+
+void shim_drop(AppMessageResult reason) {
+  shim.inbox_dropped++;
+  if (s_inbox_dropped) s_inbox_dropped(reason, NULL);
+}
+
+// --- Connection service ---
+
+static ConnectionHandlers s_connection_handlers;
+void connection_service_subscribe(ConnectionHandlers handlers) { s_connection_handlers = handlers; }
+void connection_service_unsubscribe(void) { memset(&s_connection_handlers, 0, sizeof(s_connection_handlers)); }
+bool connection_service_peek_pebble_app_connection(void) { return !shim.disconnected; }
+void shim_set_connected(bool connected) {
+  shim.disconnected = !connected;
+  if (s_connection_handlers.pebble_app_connection_handler) {
+    s_connection_handlers.pebble_app_connection_handler(connected);
+  }
+}
+
+void app_event_loop(void) {}
+
+// --- Launch, wakeup and app glance (recorded in shim) ---
+
+AppLaunchReason launch_reason(void) { return shim.launch_reason; }
+
+WakeupId wakeup_schedule(time_t timestamp, int32_t cookie, bool notify_if_missed) {
+  shim.wakeup_time = timestamp;
+  shim.wakeup_cookie = cookie;
+  shim.wakeups_scheduled++;
+  return 1;
+}
+
+void wakeup_cancel_all(void) { shim.wakeup_time = 0; }
+
+bool wakeup_get_launch_event(WakeupId *wakeup_id, int32_t *cookie) {
+  if (shim.launch_reason != APP_LAUNCH_WAKEUP) return false;
+  *wakeup_id = 1;
+  *cookie = shim.wakeup_cookie;
+  return true;
+}
+
+struct AppGlanceReloadSession { int slices; };
+
+AppGlanceResult app_glance_add_slice(AppGlanceReloadSession *session, AppGlanceSlice slice) {
+  if (session->slices++ > 0) return APP_GLANCE_RESULT_SLICE_CAPACITY_EXCEEDED;
+  snprintf(shim.glance_subtitle, sizeof(shim.glance_subtitle), "%s",
+           slice.layout.subtitle_template_string);
+  return APP_GLANCE_RESULT_SUCCESS;
+}
+
+void app_glance_reload(AppGlanceReloadCallback callback, void *context) {
+  AppGlanceReloadSession session = { 0 };
+  shim.glance_reloads++;
+  shim.glance_subtitle[0] = '\0';
+  if (callback) callback(&session, 1, context);
+}
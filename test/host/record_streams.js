@@ -0,0 +1,218 @@
+// Records the messages src/pkjs/transfer.js sends for generated lists, for
+// replay against the watch code by replay.c.
+//
+// Usage: node record_streams.js out_dir [N...]
+//
+// For every N three streams are written: flat_N.stream (one document, edited
+// a few times), flat_raw_N.stream (the same with labels sent raw rather than
+// in the compact encoding) and sections_N.stream (several files). Edits go
+// out as diffs where the phone would send one and as full transfers
+// otherwise. Stream
+// format, one directive per line:
+//
+//   L                        a new list follows, forget pages and expectations
+//   M <tuples>               message the phone sends unasked
+//   R <page> <tuples>        message answering REQUEST_PAGE <page>
+//   X count <items> <sections>
+//   X section <index> <items> <hex title>
+//   X item <index> <flags> <hex label>
+//   C                        compare the list on the watch with the X lines
+//
+// Tuples are KEY=i:<int>, KEY=s:<hex UTF-8> or KEY=d:<hex bytes> with KEY a
+// name from package.json.
+
+const fs = require('fs');
+const path = require('path');
+const Module = require('module');
+
+const pkg = require('../../package.json');
+const messageKeys = {};
+const keyNames = {};
+pkg.pebble.messageKeys.forEach(function (name, i) {
+  messageKeys[name] = 10000 + i;
+  keyNames[10000 + i] = name;
+});
+
+const originalLoad = Module._load;
+Module._load = function (request, parent, isMain) {
+  if (request === 'message_keys') return messageKeys;
+  return originalLoad.apply(this, arguments);
+};
+
+// Watch geometry of the basalt and later platforms, see item_store.h
+const WATCH_INBOX_SIZE = 8192;
+const GEOMETRY = { pageSize: 32, windowPages: 6, poolBudget: 12288 };
+
+// Every message is acknowledged at once; `captured` collects them.
+let captured = [];
+global.Pebble = {
+  sendAppMessage: function (payload, ack) {
+    captured.push(payload);
+    if (ack) ack();
+  },
+};
+console.log = function () {};
+
+const transfer = require('../../src/pkjs/transfer.js');
+
+function hex(bytes) {
+  return Buffer.from(bytes).toString('hex');
+}
+
+function encodeTuples(payload) {
+  return Object.keys(payload).map(function (key) {
+    let value = payload[key];
+    let name = keyNames[key] || key;
+    if (typeof value === 'number') return name + '=i:' + value;
+    if (typeof value === 'string') return name + '=s:' + hex(Buffer.from(value, 'utf8'));
+    return name + '=d:' + hex(value);
+  }).join(' ');
+}
+
+// Run `send` and return what it sent.
+function capture(send) {
+  captured = [];
+  send();
+  let messages = captured;
+  captured = [];
+  return messages;
+}
+
+function generateItems(n, prefix) {
+  let words = ['Buy', 'Call', 'Fix', 'Review', 'Write', 'Plan', 'Email', 'Book'];
+  let items = [];
+  for (let i = 0; i < n; i++) {
+    items.push({ name: `${words[i % words.length]} ${prefix}task ${i} #project`, checked: i % 7 === 3 });
+  }
+  return items;
+}
+
+// Record `items` the way index.js sends them: a diff if possible, else the
+// setup message with the section headers and the initial window, and the answer to every
+// page request the watch may make.
+function recordList(lines, title, sections, items) {
+  let hash = transfer.listHash(title, sections, items);
+  let generation = transfer.begin();
+  lines.push('L');
+
+  let diff = transfer.diffList(title, sections, items, hash);
+  if (diff) {
+    diff[messageKeys.TRANSFER_GEN] = generation;
+    lines.push('M ' + encodeTuples(diff));
+  } else {
+    let prepared = transfer.prepareList(items, false, hash);
+    let setup = {};
+    setup[messageKeys.ITEMS_COUNT] = items.length;
+    if (sections.length > 0) {
+      setup[messageKeys.SECTION_COUNT] = sections.length;
+      setup[messageKeys.SECTION_TITLE_BYTES] = transfer.sectionTitleBytes(sections);
+    } else {
+      setup[messageKeys.LIST_TITLE] = title;
+    }
+    setup[messageKeys.LIST_HASH] = hash;
+    setup[messageKeys.ITEMS_PAGE_BYTES] = prepared.pageBytes;
+    if (prepared.dict) setup[messageKeys.LABEL_DICT] = prepared.dict;
+    setup[messageKeys.TRANSFER_GEN] = generation;
+    let headers = transfer.addSectionHeaders(setup, sections, 0);
+    lines.push('M ' + encodeTuples(setup));
+    headers.forEach(function (payload) {
+      payload[messageKeys.TRANSFER_GEN] = generation;
+      lines.push('M ' + encodeTuples(payload));
+    });
+    capture(function () { transfer.sendItems(); }).forEach(function (payload) {
+      lines.push('M ' + encodeTuples(payload));
+    });
+    transfer.setWatchListHash(hash, { title: title, sections: sections });
+  }
+
+  let pages = Math.ceil(items.length / GEOMETRY.pageSize);
+  for (let page = 0; page < pages; page++) {
+    capture(function () { transfer.sendPage(page); }).forEach(function (payload) {
+      lines.push('R ' + page + ' ' + encodeTuples(payload));
+    });
+  }
+
+  lines.push('X count ' + items.length + ' ' + sections.length);
+  sections.forEach(function (section, index) {
+    lines.push('X section ' + index + ' ' + section.item_count + ' ' + hex(Buffer.from(section.title, 'utf8')));
+  });
+  items.forEach(function (item, index) {
+    lines.push('X item ' + index + ' ' + (item.checked ? 1 : 0) + ' ' + hex(Buffer.from(item.name, 'utf8')));
+  });
+  lines.push('C');
+}
+
+function writeStream(file, comment, record) {
+  transfer.setWatchInfo(WATCH_INBOX_SIZE, 0, GEOMETRY);
+  transfer.setWatchListHash(0, null);
+  let lines = ['# ' + comment];
+  record(lines);
+  fs.writeFileSync(file, lines.join('\n') + '\n');
+}
+
+function recordFlat(outDir, n, encoding) {
+  let name = encoding === 'raw' ? 'flat_raw_' : 'flat_';
+  let comment = n + ' items in one document, ' + encoding + ' labels';
+  transfer.setLabelEncoding(encoding);
+  writeStream(path.join(outDir, name + n + '.stream'), comment, function (lines) {
+    let title = 'Tasks';
+    let items = generateItems(n, '');
+    recordList(lines, title, [], items);
+
+    items = items.slice();
+    items[1] = { name: items[1].name, checked: !items[1].checked };
+    recordList(lines, title, [], items);
+
+    let middle = Math.floor(items.length / 2);
+    items = items.slice(0, middle).concat(generateItems(3, 'new '), items.slice(middle));
+    recordList(lines, title, [], items);
+
+    items = items.slice(2);
+    recordList(lines, title, [], items);
+
+    items = items.slice();
+    items[items.length - 1] = { name: 'Renamed last task', checked: false };
+    recordList(lines, title, [], items);
+  });
+  transfer.setLabelEncoding('compact');
+}
+
+function recordSections(outDir, n) {
+  writeStream(path.join(outDir, 'sections_' + n + '.stream'), n + ' items in four files', function (lines) {
+    let titles = ['Inbox', '', 'Work', 'Home'];
+    let sections = [];
+    let items = [];
+    titles.forEach(function (title, fileIndex) {
+      let count = Math.floor(n / 4) + (fileIndex < n % 4 ? 1 : 0);
+      generateItems(count, title.toLowerCase() + ' ').forEach(function (item) {
+        item.fileIndex = fileIndex;
+        items.push(item);
+      });
+      sections.push({ title: title, item_count: count });
+    });
+    recordList(lines, '', sections, items);
+
+    items = items.slice();
+    items[0] = { name: items[0].name, checked: !items[0].checked, fileIndex: 0 };
+    recordList(lines, '', sections, items);
+
+    items = items.slice(1);
+    sections = sections.slice();
+    sections[0] = { title: sections[0].title, item_count: sections[0].item_count - 1 };
+    recordList(lines, '', sections, items);
+  });
+}
+
+let outDir = process.argv[2];
+let sizes = process.argv.slice(3).map(function (arg) { return parseInt(arg, 10); });
+if (!outDir) {
+  process.stderr.write('Usage: node record_streams.js out_dir [N...]\n');
+  process.exit(1);
+}
+if (sizes.length === 0) sizes = [10, 100, 1000, 10000];
+fs.mkdirSync(outDir, { recursive: true });
+sizes.forEach(function (n) {
+  recordFlat(outDir, n, 'compact');
+  recordFlat(outDir, n, 'raw');
+  recordSections(outDir, n);
+});
@@ -0,0 +1,322 @@
+// Replays message streams recorded by record_streams.js against the watch
+// app and checks the list it ends up with after every change. The whole list
+// is scrolled through, page requests are answered from the stream.
+//
+// Usage: replay [--bench] file.stream...
+//
+// With --bench a line per stream reports the time spent handling each
+// message, app heap allocations, the peak heap, and the cost of a draw pass
+// over the visible rows and of prv_content_height().
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include <time.h>
+
+#include "messages.h"
+
+// The harness' own memory is not the app's
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#define DRAW_PASSES 2000
+#define HEIGHT_PASSES 20000
+
+typedef struct {
+  int page;
+  char *tuples;
+} PageReply;
+
+typedef struct {
+  uint8_t flags;
+  char *label;
+} ExpectedItem;
+
+typedef struct {
+  const char *file;
+  int line_number;
+  // Replies to REQUEST_PAGE for the current list
+  PageReply *replies;
+  int num_replies;
+  int replies_capacity;
+  // Expected list
+  int count;
+  int num_sections;
+  ExpectedItem *items;
+  int *section_counts;
+  char **section_titles;
+  // Metrics
+  int messages;
+  double message_us;
+  double max_message_us;
+  int checks;
+} Replay;
+
+static Replay s_replay;
+
+static double prv_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void prv_fail(const char *message) {
+  fprintf(stderr, "%s:%d: %s\n", s_replay.file, s_replay.line_number, message);
+  exit(1);
+}
+
+static uint32_t prv_key(const char *name, size_t length) {
+  for (int i = 0; i < message_key_count; i++) {
+    if (strlen(message_key_names[i].name) == length
+        && strncmp(message_key_names[i].name, name, length) == 0) {
+      return message_key_names[i].key;
+    }
+  }
+  prv_fail("unknown message key");
+  return 0;
+}
+
+// Decode hex into `out`, returns the number of bytes.
+static size_t prv_unhex(const char *hex, size_t length, uint8_t *out) {
+  for (size_t i = 0; i + 1 < length; i += 2) sscanf(hex + i, "%2hhx", &out[i / 2]);
+  return length / 2;
+}
+
+static char *prv_unhex_string(const char *hex) {
+  size_t length = strlen(hex);
+  char *text = malloc(length / 2 + 1);
+  text[prv_unhex(hex, length, (uint8_t *)text)] = '\0';
+  return text;
+}
+
+// Build the message described by `tuples` and hand it to the app.
+static void prv_deliver(const char *tuples) {
+  static uint8_t value[SHIM_INBOX_MAXIMUM];
+  DictionaryIterator *iter = shim_message_begin();
+  const char *cursor = tuples;
+  while (*cursor) {
+    while (*cursor == ' ') cursor++;
+    if (!*cursor) break;
+    const char *equals = strchr(cursor, '=');
+    if (!equals || equals[1] == '\0' || equals[2] != ':') prv_fail("bad tuple");
+    uint32_t key = prv_key(cursor, equals - cursor);
+    char type = equals[1];
+    const char *text = equals + 3;
+    size_t length = strcspn(text, " \n");
+    if (type == 'i') {
+      msg_int(iter, key, (int32_t)strtol(text, NULL, 10));
+    } else if (type == 's') {
+      value[prv_unhex(text, length, value)] = '\0';
+      dict_write_cstring(iter, key, (const char *)value);
+    } else if (type == 'd') {
+      dict_write_data(iter, key, value, prv_unhex(text, length, value));
+    } else {
+      prv_fail("bad tuple type");
+    }
+    cursor = text + length;
+  }
+
+  double start = prv_now_us();
+  if (!shim_message_deliver()) prv_fail("message does not fit the inbox");
+  double elapsed = prv_now_us() - start;
+  s_replay.messages++;
+  s_replay.message_us += elapsed;
+  if (elapsed > s_replay.max_message_us) s_replay.max_message_us = elapsed;
+}
+
+static void prv_forget_list(void) {
+  for (int i = 0; i < s_replay.num_replies; i++) free(s_replay.replies[i].tuples);
+  s_replay.num_replies = 0;
+  for (int i = 0; i < s_replay.count; i++) free(s_replay.items[i].label);
+  for (int i = 0; i < s_replay.num_sections; i++) free(s_replay.section_titles[i]);
+  free(s_replay.items);
+  free(s_replay.section_counts);
+  free(s_replay.section_titles);
+  s_replay.items = NULL;
+  s_replay.section_counts = NULL;
+  s_replay.section_titles = NULL;
+  s_replay.count = 0;
+  s_replay.num_sections = 0;
+}
+
+static void prv_add_reply(int page, const char *tuples) {
+  if (s_replay.num_replies == s_replay.replies_capacity) {
+    s_replay.replies_capacity = s_replay.replies_capacity ? 2 * s_replay.replies_capacity : 64;
+    s_replay.replies = realloc(s_replay.replies, s_replay.replies_capacity * sizeof(PageReply));
+  }
+  s_replay.replies[s_replay.num_replies++] = (PageReply){ page, strdup(tuples) };
+}
+
+static void prv_answer_page_requests(void) {
+  for (int guard = 0; s_requested_page >= 0 && guard < 16; guard++) {
+    int page = last_sent_int(MESSAGE_KEY_REQUEST_PAGE);
+    if (page != s_requested_page) prv_fail("page request not sent");
+    shim_outbox_complete(APP_MSG_OK);
+    bool answered = false;
+    for (int i = 0; i < s_replay.num_replies; i++) {
+      if (s_replay.replies[i].page == page) {
+        prv_deliver(s_replay.replies[i].tuples);
+        answered = true;
+      }
+    }
+    if (!answered) prv_fail("no reply recorded for a requested page");
+  }
+}
+
+static void prv_check_list(void) {
+  char message[160];
+  shim_outbox_complete(APP_MSG_OK);
+  shim_advance(1000);
+  // The list's telemetry may have gone out meanwhile
+  shim_outbox_complete(APP_MSG_OK);
+  if (item_store_count() != s_replay.count) prv_fail("item count differs");
+  if (item_store_section_count() != s_replay.num_sections) prv_fail("section count differs");
+  for (int i = 0; i < s_replay.num_sections; i++) {
+    if (item_store_section_item_count(i) != s_replay.section_counts[i]
+        || strcmp(item_store_section_title(i), s_replay.section_titles[i]) != 0) {
+      snprintf(message, sizeof(message), "section %d differs", i);
+      prv_fail(message);
+    }
+  }
+  if (s_replay.count > 0 && !shim.menu) prv_fail("list not shown");
+
+  for (int index = 0; index < s_replay.count; index++) {
+    int section, row;
+    item_store_position(index, &section, &row);
+    menu_layer_set_selected_index(shim.menu, (MenuIndex){ section, row }, MenuRowAlignCenter, false);
+    prv_answer_page_requests();
+    TodoItem *item = item_store_get(index);
+    ExpectedItem *expected = &s_replay.items[index];
+    const char *text = item ? item_store_text(item, s_label_text, sizeof(s_label_text)) : NULL;
+    if (!item || strcmp(text, expected->label) != 0
+        || (item->flags & ITEM_FLAG_CHECKED) != expected->flags) {
+      snprintf(message, sizeof(message), "item %d: expected '%s', got '%s'", index,
+               expected->label, item ? text : "(not loaded)");
+      prv_fail(message);
+    }
+  }
+  if (s_replay.count > 0) {
+    menu_layer_set_selected_index(shim.menu, (MenuIndex){ 0, 0 }, MenuRowAlignCenter, false);
+    prv_answer_page_requests();
+  }
+  s_replay.checks++;
+}
+
+static void prv_expect(const char *line) {
+  int index, value, consumed = 0;
+  if (sscanf(line, "count %d %d", &index, &value) == 2) {
+    s_replay.count = index;
+    s_replay.num_sections = value;
+    s_replay.items = calloc(index > 0 ? index : 1, sizeof(ExpectedItem));
+    s_replay.section_counts = calloc(value > 0 ? value : 1, sizeof(int));
+    s_replay.section_titles = calloc(value > 0 ? value : 1, sizeof(char *));
+  } else if (sscanf(line, "section %d %d %n", &index, &value, &consumed) == 2 && consumed) {
+    if (index < 0 || index >= s_replay.num_sections) prv_fail("bad section expectation");
+    s_replay.section_counts[index] = value;
+    s_replay.section_titles[index] = prv_unhex_string(line + consumed);
+  } else if (sscanf(line, "item %d %d %n", &index, &value, &consumed) == 2 && consumed) {
+    if (index < 0 || index >= s_replay.count) prv_fail("bad item expectation");
+    s_replay.items[index].flags = value;
+    s_replay.items[index].label = prv_unhex_string(line + consumed);
+  } else {
+    prv_fail("bad expectation");
+  }
+}
+
+static void prv_bench_draw(double *draw_us, double *height_us, volatile int *sink) {
+  double start = prv_now_us();
+  for (int i = 0; i < DRAW_PASSES; i++) *sink += shim_menu_draw(s_menu_bounds.size.h);
+  *draw_us = (prv_now_us() - start) / DRAW_PASSES;
+  start = prv_now_us();
+  for (int i = 0; i < HEIGHT_PASSES; i++) *sink += prv_content_height();
+  *height_us = (prv_now_us() - start) / HEIGHT_PASSES;
+}
+
+int main(int argc, char **argv) {
+  bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+  int first = bench ? 2 : 1;
+  if (first >= argc) {
+    fprintf(stderr, "Usage: replay [--bench] file.stream...\n");
+    return 2;
+  }
+  // Every stream runs in a fresh process, the app keeps its state in statics
+  if (argc - first > 1) {
+    if (bench) {
+      printf("%-22s %6s %8s %8s %8s %9s %9s %8s %9s\n", "stream", "msgs", "us/msg", "max us",
+             "allocs", "peak heap", "end heap", "draw us", "height us");
+      fflush(stdout);
+    }
+    for (int i = first; i < argc; i++) {
+      char command[1024];
+      snprintf(command, sizeof(command), "%s %s%s", argv[0], bench ? "--bench " : "", argv[i]);
+      if (system(command) != 0) return 1;
+    }
+    return 0;
+  }
+
+  s_replay.file = argv[first];
+  FILE *file = fopen(s_replay.file, "r");
+  if (!file) {
+    perror(s_replay.file);
+    return 1;
+  }
+
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+  size_t buffers = shim.inbox_size + shim.outbox_size;
+
+  char *line = NULL;
+  size_t capacity = 0;
+  ssize_t length;
+  while ((length = getline(&line, &capacity, file)) > 0) {
+    s_replay.line_number++;
+    if (line[length - 1] == '\n') line[--length] = '\0';
+    if (line[0] == '#' || line[0] == '\0') continue;
+    if (line[0] == 'L') {
+      prv_forget_list();
+    } else if (line[0] == 'M') {
+      prv_deliver(line + 2);
+    } else if (line[0] == 'R') {
+      int page, consumed = 0;
+      if (sscanf(line + 2, "%d %n", &page, &consumed) != 1 || !consumed) prv_fail("bad reply");
+      prv_add_reply(page, line + 2 + consumed);
+    } else if (line[0] == 'X') {
+      prv_expect(line + 2);
+    } else if (line[0] == 'C') {
+      prv_check_list();
+    } else {
+      prv_fail("unknown directive");
+    }
+  }
+  free(line);
+  fclose(file);
+
+  double draw_us = 0, height_us = 0;
+  volatile int sink = 0;
+  if (bench) prv_bench_draw(&draw_us, &height_us, &sink);
+  prv_forget_list();
+  free(s_replay.replies);
+
+  int allocs = shim.allocs;
+  size_t peak = shim.heap_peak;
+  prv_deinit();
+  size_t end_heap = shim.heap_used - buffers;
+
+  const char *name = strrchr(s_replay.file, '/');
+  name = name ? name + 1 : s_replay.file;
+  if (bench) {
+    printf("%-22s %6d %8.2f %8.1f %8d %9zu %9zu %8.2f %9.3f\n", name, s_replay.messages,
+           s_replay.message_us / (s_replay.messages ? s_replay.messages : 1),
+           s_replay.max_message_us, allocs, peak, end_heap, draw_us, height_us);
+  } else {
+    printf("replay %s: ok (%d messages, %d lists checked)\n", name, s_replay.messages,
+           s_replay.checks);
+  }
+  if (end_heap != 0) {
+    fprintf(stderr, "%s: %zu bytes of app heap left after deinit\n", name, end_heap);
+    return 1;
+  }
+  return 0;
+}
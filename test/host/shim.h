@@ -0,0 +1,70 @@
+#pragma once
+// Test-side view of the fake Pebble SDK in pebble_shim.c.
+#include "pebble.h"
+
+#define SHIM_SCREEN_WIDTH 144
+#define SHIM_SCREEN_HEIGHT 168
+#define SHIM_INBOX_MAXIMUM 8200
+#define SHIM_OUTBOX_CAPACITY 2048
+#define SHIM_MAX_SENT 64
+
+typedef struct {
+  bool verbose;
+  // heap
+  size_t heap_used;
+  size_t heap_peak;
+  size_t heap_limit;
+  int allocs;
+  int frees;
+  int failed_allocs;
+  // app message
+  uint32_t inbox_size;
+  uint32_t outbox_size;
+  bool outbox_busy;
+  int inbox_received;
+  int inbox_dropped;
+  struct { uint8_t data[SHIM_OUTBOX_CAPACITY]; uint32_t size; } sent[SHIM_MAX_SENT];
+  int sent_count;
+  // ui
+  MenuLayer *menu;
+  int menus_created;
+  int menu_reloads;
+  int dirty_marks;
+  int texts_drawn;
+  int text_measurements;
+  char last_text[256];
+  // What the last text_layer_set_text() call set, on any text layer
+  const char *text_layer_text;
+  int animations_created;
+  int animations_scheduled;
+  int animations_finished;
+  bool windows_popped;
+  // persist
+  int persist_writes;
+  // launch, wakeup and glance
+  AppLaunchReason launch_reason;
+  int32_t wakeup_cookie;
+  time_t wakeup_time;
+  int wakeups_scheduled;
+  int glance_reloads;
+  char glance_subtitle[256];
+  // clock
+  uint64_t now_ms;
+  bool disconnected;
+} ShimState;
+
+extern ShimState shim;
+
+int shim_menu_draw(int max_height);
+void shim_menu_click(MenuIndex idx, bool long_click);
+void shim_advance(uint32_t ms);
+int shim_animations_running(void);
+void shim_outbox_complete(AppMessageResult result);
+DictionaryIterator *shim_last_sent(void);
+bool shim_deliver(DictionaryIterator *iter);
+DictionaryIterator *shim_message_begin(void);
+bool shim_message_deliver(void);
+void shim_drop(AppMessageResult reason);
+int shim_persist_total_bytes(void);
+void shim_persist_clear(void);
+void shim_set_connected(bool connected);
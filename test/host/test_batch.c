@@ -0,0 +1,78 @@
+// A short list sent in one ITEMS_BATCH: parsing, drawing, toggling, caching.
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "messages.h"
+
+int main(void) {
+  prv_init();
+  // The hello goes out right away, without a cached list
+  CHECK(shim.sent_count == 1);
+  CHECK(last_sent_int(MESSAGE_KEY_WATCH_INBOX_SIZE) == INBOX_SIZE_LIMIT);
+  CHECK(last_sent_int(MESSAGE_KEY_CACHED_LIST_HASH) == 0);
+  CHECK(last_sent_int(MESSAGE_KEY_WATCH_PAGE_SIZE) == ITEM_STORE_PAGE_SIZE);
+  shim_outbox_complete(APP_MSG_OK);
+  size_t heap_before = shim.heap_used;
+
+  send_list_setup(10, 0, 80, 4242);
+  CHECK(!s_list_shown);
+  send_items(0, 10);
+  CHECK(s_list_shown);
+  CHECK(item_store_count() == 10);
+  CHECK(item_store_fully_resident());
+  CHECK(strcmp(item_store_label(item_store_get(7)), "item 7") == 0);
+  CHECK(item_store_get(3)->flags & ITEM_FLAG_CHECKED);
+  CHECK(!(item_store_get(4)->flags & ITEM_FLAG_CHECKED));
+
+  // The menu slides in and its animation cleans up after itself
+  CHECK(shim.menus_created == 1);
+  shim_advance(1000);
+  CHECK(shim.animations_finished == shim.animations_scheduled);
+  CHECK(s_menu_anim == NULL);
+  // ...and the list's telemetry went out meanwhile
+  CHECK(dict_find(shim_last_sent(), MESSAGE_KEY_TELEMETRY) != NULL);
+  shim_outbox_complete(APP_MSG_OK);
+
+  CHECK(shim_menu_draw(SHIM_SCREEN_HEIGHT) == 7);
+  CHECK(strcmp(shim.last_text, "item 6") == 0);
+
+  // Toggling flips the flag and sends the item id
+  shim_menu_click((MenuIndex){ 0, 3 }, false);
+  CHECK(last_sent_toggle(3) == 0);
+  CHECK(!(item_store_get(3)->flags & ITEM_FLAG_CHECKED));
+  // ...or waits for the outbox if it is busy
+  int sent = shim.sent_count;
+  shim_menu_click((MenuIndex){ 0, 4 }, false);
+  CHECK(shim.sent_count == sent);
+  CHECK(item_store_get(4)->flags & ITEM_FLAG_CHECKED);
+  shim_outbox_complete(APP_MSG_OK);
+  CHECK(shim.sent_count == sent + 1);
+  CHECK(last_sent_toggle(4) == 1);
+  CHECK(last_sent_toggle(3) == -1);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // The complete list was cached and comes back from persist
+  CHECK(list_cache_hash() == 4242);
+  CHECK(shim_persist_total_bytes() > 0);
+  update_count(0, 0, 0, 0, NULL, 0);
+  s_list_hash = 0;
+  prv_load_list_cache();
+  CHECK(item_store_count() == 10);
+  CHECK(strcmp(item_store_label(item_store_get(9)), "item 9") == 0);
+  CHECK(item_store_get(5)->id == 5);
+  prv_send_hello(NULL);
+  CHECK(last_sent_int(MESSAGE_KEY_CACHED_LIST_HASH) == 4242);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // An empty list drops the cache
+  send_list_setup(0, 0, 0, 0);
+  CHECK(item_store_count() == 0);
+  CHECK(list_cache_hash() == 0);
+  shim_advance(1000);
+
+  prv_deinit();
+  CHECK(shim.heap_used <= heap_before);
+  printf("test_batch: ok (%d allocations, peak heap %zu bytes)\n", shim.allocs, shim.heap_peak);
+  return 0;
+}
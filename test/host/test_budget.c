@@ -0,0 +1,47 @@
+// Heap budget: the hello reports it, labels get less room when the heap is
+// tight, and a list that does not fit at all is refused with a message.
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "messages.h"
+
+int main(void) {
+  prv_init();
+  CHECK(last_sent_int(MESSAGE_KEY_WATCH_HEAP_BUDGET) == ITEM_STORE_HEAP_BUDGET);
+  CHECK(last_sent_int(MESSAGE_KEY_WATCH_POOL_BUDGET) == ITEM_STORE_POOL_BUDGET);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // Little heap left: the hello says so
+  shim.heap_limit = shim.heap_used + ITEM_STORE_HEAP_RESERVE + 2000;
+  prv_send_hello(NULL);
+  CHECK(last_sent_int(MESSAGE_KEY_WATCH_HEAP_BUDGET) == 2000);
+  int pool_budget = last_sent_int(MESSAGE_KEY_WATCH_POOL_BUDGET);
+  CHECK(pool_budget > 0 && pool_budget < 2000);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // A list with longer labels than that still loads, cut short
+  send_list_setup(200, 0, 800, 0);
+  CHECK(item_store_count() == 200);
+  send_items(0, ITEM_STORE_PAGE_SIZE * ITEM_STORE_WINDOW_PAGES);
+  CHECK(s_list_shown);
+  CHECK(item_store_dropped_count() > 0);
+  CHECK(strcmp(shim.text_layer_text, "Low memory, items cut") == 0);
+  CHECK(heap_bytes_free() >= ITEM_STORE_HEAP_RESERVE);
+
+  // Far too many sections for the heap: refused, and the user is told
+  send_list_setup(400, 200, 400, 0);
+  CHECK(item_store_count() == 0);
+  CHECK(!s_list_shown);
+  CHECK(strcmp(shim.text_layer_text, "List too large!") == 0);
+  CHECK(shim.failed_allocs == 0);
+
+  // With the heap back the same list fits
+  shim.heap_limit = 0;
+  send_list_setup(400, 200, 400, 0);
+  CHECK(item_store_count() == 400);
+
+  prv_deinit();
+  printf("test_budget: ok\n");
+  return 0;
+}
@@ -0,0 +1,132 @@
+// ITEMS_DIFF messages: removals, insertions and updates applied in place.
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "messages.h"
+
+static uint8_t s_diff[256];
+static size_t s_diff_length;
+
+static void prv_u16(int value) {
+  s_diff[s_diff_length++] = value & 0xff;
+  s_diff[s_diff_length++] = value >> 8;
+}
+
+static void prv_diff_begin(int before, int after) {
+  s_diff_length = 0;
+  prv_u16(before);
+  prv_u16(after);
+  s_diff[s_diff_length++] = 0;
+}
+
+static void prv_record(uint8_t flags, const char *label) {
+  size_t length = strlen(label);
+  s_diff[s_diff_length++] = flags;
+  s_diff[s_diff_length++] = length;
+  memcpy(s_diff + s_diff_length, label, length);
+  s_diff_length += length;
+}
+
+static void prv_remove(int index, int count) {
+  s_diff[s_diff_length++] = DIFF_REMOVE;
+  prv_u16(index);
+  prv_u16(count);
+}
+
+static void prv_insert(int index, int id, uint8_t flags, const char *label) {
+  s_diff[s_diff_length++] = DIFF_INSERT;
+  prv_u16(index);
+  prv_u16(id);
+  prv_record(flags, label);
+}
+
+static void prv_update(int index, uint8_t flags, const char *label) {
+  s_diff[s_diff_length++] = DIFF_UPDATE;
+  prv_u16(index);
+  prv_record(flags, label);
+}
+
+static void prv_diff_send(int32_t hash) {
+  DictionaryIterator *iter = shim_message_begin();
+  dict_write_data(iter, MESSAGE_KEY_ITEMS_DIFF, s_diff, s_diff_length);
+  msg_int(iter, MESSAGE_KEY_LIST_HASH, hash);
+  msg_int(iter, MESSAGE_KEY_ITEMS_PAGE_BYTES, 64);
+  shim_message_deliver();
+}
+
+// The list is `count` items with these labels and ids.
+static void prv_expect(int count, const char *labels[], const int ids[]) {
+  CHECK(item_store_count() == count);
+  for (int i = 0; i < count; i++) {
+    TodoItem *item = item_store_get(i);
+    CHECK(item != NULL);
+    CHECK(strcmp(item_store_label(item), labels[i]) == 0);
+    CHECK(item->id == ids[i]);
+  }
+}
+
+int main(void) {
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+  send_list_setup(6, 0, 64, 100);
+  send_items(0, 6);
+  shim_advance(1000);
+  // The list's telemetry went out meanwhile
+  shim_outbox_complete(APP_MSG_OK);
+  CHECK(list_cache_hash() == 100);
+  int menus = shim.menus_created;
+
+  prv_diff_begin(6, 4);
+  prv_remove(1, 2);
+  prv_diff_send(101);
+  prv_expect(4, (const char *[]){ "item 0", "item 3", "item 4", "item 5" },
+             (const int[]){ 0, 3, 4, 5 });
+  CHECK(list_cache_hash() == 101);
+
+  prv_diff_begin(4, 5);
+  prv_update(0, ITEM_FLAG_CHECKED, "zero");
+  prv_insert(2, 6, ITEM_FLAG_CHECKED, "new");
+  prv_diff_send(102);
+  prv_expect(5, (const char *[]){ "zero", "item 3", "new", "item 4", "item 5" },
+             (const int[]){ 0, 3, 6, 4, 5 });
+  CHECK(item_store_get(0)->flags & ITEM_FLAG_CHECKED);
+  CHECK(item_store_get(2)->flags & ITEM_FLAG_CHECKED);
+  CHECK(!(item_store_get(3)->flags & ITEM_FLAG_CHECKED));
+
+  // The selection stays on its item, and toggles still send its id
+  menu_layer_set_selected_index(shim.menu, (MenuIndex){ 0, 3 }, MenuRowAlignNone, false);
+  prv_diff_begin(5, 3);
+  prv_remove(0, 2);
+  prv_diff_send(103);
+  prv_expect(3, (const char *[]){ "new", "item 4", "item 5" }, (const int[]){ 6, 4, 5 });
+  CHECK(menu_layer_get_selected_index(shim.menu).row == 1);
+  shim_menu_click(menu_layer_get_selected_index(shim.menu), false);
+  CHECK(last_sent_toggle(4) == 1);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // Diffs reuse the menu
+  CHECK(shim.menus_created == menus);
+  shim_advance(1000);
+
+  // A diff for another list is refused and the watch asks for the whole list
+  int sent = shim.sent_count;
+  prv_diff_begin(9, 8);
+  prv_remove(0, 1);
+  prv_diff_send(104);
+  CHECK(shim.sent_count == sent + 1);
+  CHECK(last_sent_int(MESSAGE_KEY_CACHED_LIST_HASH) == 0);
+  CHECK(item_store_count() == 3);
+
+  // So is one whose operations run past the end
+  shim_outbox_complete(APP_MSG_OK);
+  prv_diff_begin(3, 3);
+  prv_update(3, 0, "x");
+  prv_diff_send(105);
+  CHECK(shim.sent_count == sent + 2);
+  shim_outbox_complete(APP_MSG_OK);
+
+  prv_deinit();
+  printf("test_diff: ok\n");
+  return 0;
+}
@@ -0,0 +1,77 @@
+// Progressive first paint: the menu shows as soon as the first screen of a
+// list arrived, rows still on their way show a placeholder.
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "messages.h"
+
+#define HASH 0x0f125c2e
+
+int main(void) {
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+
+  // A few rows do not fill the screen yet
+  shim_advance(200);
+  send_list_setup(150, 0, 400, HASH);
+  send_items(0, 3);
+  CHECK(s_menu_layer == NULL);
+
+  // A screenful does, long before the initial window is complete
+  shim_advance(100);
+  send_items(3, 10);
+  CHECK(s_menu_layer != NULL);
+  CHECK(!s_list_shown);
+  CHECK(shim.menus_created == 1);
+  CHECK(prv_get_num_rows(s_menu_layer, 0, NULL) == 150);
+  telemetry_format(s_debug_text, sizeof(s_debug_text));
+  CHECK(strstr(s_debug_text, "First screen: 300 ms") != NULL);
+  shim_advance(1000);
+
+  // Rows that did not arrive show a placeholder and cannot be toggled
+  int twenty_rows = MENU_CELL_BASIC_HEADER_HEIGHT + 20 * CELL_HEIGHT;
+  CHECK(shim_menu_draw(twenty_rows) == 20);
+  CHECK(strcmp(shim.last_text, "...") == 0);
+  MenuIndex missing = { 0, 19 };
+  int sent = shim.sent_count;
+  shim_menu_click(missing, false);
+  CHECK(shim.sent_count == sent);
+
+  // The transfer is still resumed from where it got
+  prv_send_hello(NULL);
+  CHECK(last_sent_int(MESSAGE_KEY_CACHED_LIST_HASH) == 0);
+  CHECK(last_sent_int(MESSAGE_KEY_RESUME_INDEX) == 10);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // The rest fills in the same menu
+  send_items(10, 100);
+  CHECK(!s_list_shown);
+  send_items(100, 150);
+  CHECK(s_list_shown);
+  CHECK(shim.menus_created == 1);
+  shim_menu_draw(twenty_rows);
+  CHECK(strcmp(shim.last_text, "item 19") == 0);
+
+  // A list restored as far as it got shows its first screen right away
+  send_list_setup(150, 0, 400, HASH + 1);
+  send_items(0, 20);
+  prv_deinit();
+  prv_init();
+  CHECK(s_menu_layer != NULL);
+  CHECK(!s_list_shown);
+  CHECK(item_store_loaded_count() == 20);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // A short list shows once it is complete
+  send_list_setup(5, 0, 50, HASH + 2);
+  send_items(0, 3);
+  CHECK(s_menu_layer == NULL);
+  send_items(3, 5);
+  CHECK(s_menu_layer != NULL);
+  CHECK(s_list_shown);
+
+  prv_deinit();
+  printf("test_first_screen: ok\n");
+  return 0;
+}
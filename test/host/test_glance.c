@@ -0,0 +1,167 @@
+// App glance: task lists publish their open items, the picker does not, and
+// a wakeup launch refreshes the list and quits once the phone is done. The
+// wakeup is only scheduled once the user turned it on, and not again after a
+// refresh that brought nothing new.
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "messages.h"
+
+#define HASH 0x91a2ce
+
+static void prv_send_task_list(int count, int32_t hash) {
+  DictionaryIterator *iter = shim_message_begin();
+  msg_int(iter, MESSAGE_KEY_ITEMS_COUNT, count);
+  msg_int(iter, MESSAGE_KEY_ITEMS_PAGE_BYTES, 200);
+  msg_int(iter, MESSAGE_KEY_LIST_HASH, hash);
+  msg_int(iter, MESSAGE_KEY_LIST_GLANCE, 1);
+  shim_message_deliver();
+  send_items(0, count);
+}
+
+static void prv_send_progressing(int phase) {
+  DictionaryIterator *iter = shim_message_begin();
+  msg_int(iter, MESSAGE_KEY_SET_PROGRESSING, phase);
+  shim_message_deliver();
+}
+
+static void prv_set_glance_refresh(bool enabled) {
+  DictionaryIterator *iter = shim_message_begin();
+  msg_int(iter, MESSAGE_KEY_CONFIG_GLANCE_REFRESH, enabled);
+  shim_message_deliver();
+}
+
+static void prv_wakeup_launch(void) {
+  shim.launch_reason = APP_LAUNCH_WAKEUP;
+  shim.windows_popped = false;
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+}
+
+int main(void) {
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+
+  // Items 0, 3, 6 and 9 are checked
+  prv_send_task_list(10, HASH);
+  CHECK(s_list_shown);
+
+  // Neither the list nor a toggle publish anything while the app is open,
+  // closing it publishes once
+  MenuIndex first_open = { 0, 1 };
+  shim_menu_click(first_open, false);
+  CHECK(shim.glance_reloads == 0);
+  prv_deinit();
+  CHECK(shim.glance_reloads == 1);
+  CHECK(strcmp(shim.glance_subtitle, "5 open: item 2") == 0);
+
+  // Closing the app schedules the refresh once it is turned on. The cached
+  // list is what was published, there is nothing to publish again.
+  CHECK(shim.wakeups_scheduled == 0);
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+  CHECK(s_list_shown);
+  prv_set_glance_refresh(true);
+  prv_deinit();
+  CHECK(shim.wakeups_scheduled == 1);
+  CHECK(shim.wakeup_time >= time(NULL) + GLANCE_REFRESH_INTERVAL_S - 5);
+  CHECK(shim.glance_reloads == 1);
+
+  // The file picker is not published, and schedules nothing
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+  send_list_setup(5, 0, 100, HASH + 1);
+  send_items(0, 5);
+  CHECK(s_list_shown);
+  prv_deinit();
+  CHECK(shim.glance_reloads == 1);
+  CHECK(shim.wakeups_scheduled == 1);
+
+  // A refresh launch quits once the phone is quiet...
+  prv_wakeup_launch();
+  prv_send_progressing(PROGRESS_SENDING);
+  prv_send_task_list(10, HASH + 2);
+  shim_advance(REFRESH_IDLE_MS * 3);
+  CHECK(!shim.windows_popped);
+  prv_send_progressing(0);
+  shim_advance(REFRESH_IDLE_MS - 1);
+  CHECK(!shim.windows_popped);
+  CHECK(shim.glance_reloads == 1);
+  shim_advance(1);
+  CHECK(shim.windows_popped);
+  CHECK(shim.glance_reloads == 2);
+  CHECK(strcmp(shim.glance_subtitle, "6 open: item 1") == 0);
+  prv_deinit();
+  CHECK(shim.glance_reloads == 2);
+  CHECK(shim.wakeups_scheduled == 2);
+
+  // ...or does not answer at all, or is busy for too long. Nothing changed,
+  // so no further refresh is scheduled.
+  prv_wakeup_launch();
+  shim_advance(REFRESH_START_MS);
+  CHECK(shim.windows_popped);
+  prv_deinit();
+  CHECK(shim.wakeups_scheduled == 2 && shim.wakeup_time == 0);
+  prv_wakeup_launch();
+  prv_send_progressing(1);
+  shim_advance(REFRESH_IDLE_MS * REFRESH_MAX_WAITS);
+  CHECK(!shim.windows_popped);
+  shim_advance(REFRESH_IDLE_MS);
+  CHECK(shim.windows_popped);
+  prv_deinit();
+  CHECK(shim.wakeups_scheduled == 2);
+
+  // The user picking the app up keeps it open
+  prv_wakeup_launch();
+  shim_menu_click(first_open, true);
+  shim_advance(REFRESH_START_MS * 10);
+  CHECK(!shim.windows_popped);
+  prv_deinit();
+  CHECK(shim.wakeups_scheduled == 3);
+  shim.launch_reason = APP_LAUNCH_USER;
+
+  // Turning it off cancels the one scheduled
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+  prv_set_glance_refresh(false);
+  CHECK(shim.wakeup_time == 0);
+  prv_deinit();
+  CHECK(shim.wakeups_scheduled == 3);
+
+  // Braces would be template syntax, long labels are cut between characters
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+  static uint8_t blob[128] = { 0, 0, 0, 0 };
+  const char *label = "Call {mum} \xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4"
+                      "\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4"
+                      "\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4"
+                      "\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4\xc3\xa4";
+  size_t length = strlen(label);
+  blob[3] = length;
+  memcpy(blob + 4, label, length);
+  DictionaryIterator *iter = shim_message_begin();
+  msg_int(iter, MESSAGE_KEY_ITEMS_COUNT, 1);
+  msg_int(iter, MESSAGE_KEY_ITEMS_PAGE_BYTES, 100);
+  msg_int(iter, MESSAGE_KEY_LIST_HASH, HASH + 3);
+  msg_int(iter, MESSAGE_KEY_LIST_GLANCE, 1);
+  shim_message_deliver();
+  iter = shim_message_begin();
+  dict_write_data(iter, MESSAGE_KEY_ITEMS_BATCH, blob, 4 + length);
+  shim_message_deliver();
+  CHECK(s_list_shown);
+  prv_deinit();
+  CHECK(strncmp(shim.glance_subtitle, "1 open: Call (mum) \xc3\xa4", 21) == 0);
+  CHECK(strlen(shim.glance_subtitle) == GLANCE_SUBTITLE_MAX - 1);
+
+  // Checking the last item of the cached list
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+  MenuIndex only = { 0, 0 };
+  shim_menu_click(only, false);
+  prv_deinit();
+  CHECK(strcmp(shim.glance_subtitle, "All done!") == 0);
+
+  printf("test_glance: ok\n");
+  return 0;
+}
@@ -0,0 +1,96 @@
+// Compact labels: a list's LABEL_DICT, labels kept encoded and expanded only
+// to be drawn, carried through the cache and diffs, and raw lists unchanged.
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "messages.h"
+
+#define HASH 0x1abe1
+
+// "Buy " is code 1, "#project" code 2
+static const uint8_t s_dict[] = { 4, 'B', 'u', 'y', ' ', 8, '#', 'p', 'r', 'o', 'j', 'e', 'c', 't' };
+
+static void prv_send_setup(int count, bool with_dict, int32_t hash) {
+  DictionaryIterator *iter = shim_message_begin();
+  msg_int(iter, MESSAGE_KEY_ITEMS_COUNT, count);
+  msg_int(iter, MESSAGE_KEY_ITEMS_PAGE_BYTES, 64);
+  msg_int(iter, MESSAGE_KEY_LIST_HASH, hash);
+  if (with_dict) dict_write_data(iter, MESSAGE_KEY_LABEL_DICT, s_dict, sizeof(s_dict));
+  shim_message_deliver();
+}
+
+static void prv_send_labels(const char **labels, int count) {
+  static uint8_t blob[256];
+  size_t pos = 2;
+  blob[0] = 0;
+  blob[1] = 0;
+  for (int i = 0; i < count; i++) {
+    size_t length = strlen(labels[i]);
+    blob[pos] = 0;
+    blob[pos + 1] = length;
+    memcpy(blob + pos + 2, labels[i], length);
+    pos += 2 + length;
+  }
+  DictionaryIterator *iter = shim_message_begin();
+  dict_write_data(iter, MESSAGE_KEY_ITEMS_BATCH, blob, pos);
+  shim_message_deliver();
+}
+
+static const char *prv_text(int index) {
+  return item_store_text(item_store_get(index), s_label_text, sizeof(s_label_text));
+}
+
+int main(void) {
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+
+  const char *labels[] = { "\x01milk \x02", "\x01" "bread", "plain text", "\x05unknown" };
+  prv_send_setup(4, true, HASH);
+  prv_send_labels(labels, 4);
+  CHECK(s_list_shown);
+
+  // Stored as sent, shown expanded
+  CHECK(strcmp(item_store_label(item_store_get(0)), labels[0]) == 0);
+  CHECK(strcmp(prv_text(0), "Buy milk #project") == 0);
+  CHECK(strcmp(prv_text(1), "Buy bread") == 0);
+  CHECK(strcmp(prv_text(2), "plain text") == 0);
+  // Codes without an entry are left out
+  CHECK(strcmp(prv_text(3), "unknown") == 0);
+  shim_menu_draw(MENU_CELL_BASIC_HEADER_HEIGHT + CELL_HEIGHT);
+  CHECK(strcmp(shim.last_text, "Buy milk #project") == 0);
+
+  // Expansion stops where the buffer ends
+  char small[8];
+  CHECK(strcmp(item_store_text(item_store_get(0), small, sizeof(small)), "Buy mil") == 0);
+
+  // A diff keeps the dictionary
+  uint8_t diff[32] = { 4, 0, 4, 0, 0, DIFF_UPDATE, 2, 0, 0, 5, 0x01, 'e', 'g', 'g', 's' };
+  DictionaryIterator *iter = shim_message_begin();
+  dict_write_data(iter, MESSAGE_KEY_ITEMS_DIFF, diff, 15);
+  msg_int(iter, MESSAGE_KEY_LIST_HASH, HASH + 1);
+  msg_int(iter, MESSAGE_KEY_ITEMS_PAGE_BYTES, 64);
+  shim_message_deliver();
+  CHECK(strcmp(prv_text(2), "Buy eggs") == 0);
+  CHECK(strcmp(prv_text(0), "Buy milk #project") == 0);
+
+  // ...and so does the cached list
+  prv_deinit();
+  CHECK(list_cache_hash() == HASH + 1);
+  prv_init();
+  CHECK(s_list_shown);
+  CHECK(strcmp(prv_text(0), "Buy milk #project") == 0);
+  CHECK(strcmp(prv_text(2), "Buy eggs") == 0);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // A list without a dictionary keeps its labels as they are
+  prv_send_setup(4, false, HASH + 2);
+  prv_send_labels(labels, 4);
+  size_t length;
+  CHECK(item_store_dictionary(&length) == NULL && length == 0);
+  CHECK(prv_text(0) == item_store_label(item_store_get(0)));
+
+  prv_deinit();
+  printf("test_labels: ok\n");
+  return 0;
+}
@@ -0,0 +1,83 @@
+// A list larger than the window: scrolling requests the missing pages and the
+// heap stays the same size however far the list is scrolled.
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "messages.h"
+
+#define NUM_ITEMS 500
+
+// Select `index` and answer page requests until it is in memory.
+static void prv_scroll_to(int index) {
+  int section, row;
+  item_store_position(index, &section, &row);
+  menu_layer_set_selected_index(shim.menu, (MenuIndex){ section, row }, MenuRowAlignCenter, false);
+  for (int guard = 0; s_requested_page >= 0 && guard < 10; guard++) {
+    int page = last_sent_int(MESSAGE_KEY_REQUEST_PAGE);
+    CHECK(page == s_requested_page);
+    shim_outbox_complete(APP_MSG_OK);
+    int first = page * ITEM_STORE_PAGE_SIZE;
+    send_items(first, first + ITEM_STORE_PAGE_SIZE < NUM_ITEMS ? first + ITEM_STORE_PAGE_SIZE : NUM_ITEMS);
+  }
+  TodoItem *item = item_store_get(index);
+  CHECK(item && (item->flags & ITEM_FLAG_LOADED));
+  char expected[16];
+  snprintf(expected, sizeof(expected), "item %d", index);
+  CHECK(strcmp(item_store_label(item), expected) == 0);
+  CHECK(!!(item->flags & ITEM_FLAG_CHECKED) == (index % 3 == 0));
+}
+
+int main(void) {
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+
+  send_list_setup(NUM_ITEMS, 0, 300, 77);
+  send_items(0, ITEM_STORE_PAGE_SIZE * ITEM_STORE_WINDOW_PAGES);
+  CHECK(s_list_shown);
+  CHECK(!item_store_fully_resident());
+  CHECK(item_store_loaded_count() == ITEM_STORE_PAGE_SIZE * ITEM_STORE_WINDOW_PAGES);
+  CHECK(item_store_capacity() == ITEM_STORE_PAGE_SIZE * ITEM_STORE_WINDOW_PAGES);
+  shim_advance(1000);
+  // The list's telemetry went out meanwhile
+  CHECK(dict_find(shim_last_sent(), MESSAGE_KEY_TELEMETRY) != NULL);
+  shim_outbox_complete(APP_MSG_OK);
+  size_t heap_window = shim.heap_used;
+  int allocs_window = shim.allocs;
+
+  // Rows not in memory draw as placeholders
+  CHECK(shim_menu_draw(SHIM_SCREEN_HEIGHT) > 0);
+
+  for (int index = 0; index < NUM_ITEMS; index += 20) prv_scroll_to(index);
+  prv_scroll_to(NUM_ITEMS - 1);
+  CHECK(item_store_get(0) == NULL);
+  for (int index = NUM_ITEMS - 1; index >= 0; index -= 50) prv_scroll_to(index);
+  prv_scroll_to(0);
+
+  // Pages are recycled in place
+  CHECK(shim.heap_used == heap_window);
+  CHECK(shim.allocs == allocs_window);
+
+  // A paged list is not cached
+  CHECK(list_cache_hash() == 0);
+
+  // A page that never arrives is asked for again
+  prv_scroll_to(NUM_ITEMS - 1);
+  menu_layer_set_selected_index(shim.menu, (MenuIndex){ 0, 0 }, MenuRowAlignCenter, false);
+  CHECK(s_requested_page == 0);
+  int sent = shim.sent_count;
+  shim_outbox_complete(APP_MSG_OK);
+  shim_advance(PAGE_REQUEST_TIMEOUT_MS + 100);
+  CHECK(shim.sent_count > sent);
+  CHECK(last_sent_int(MESSAGE_KEY_REQUEST_PAGE) == 0);
+  shim_outbox_complete(APP_MSG_OK);
+  send_items(0, ITEM_STORE_PAGE_SIZE);
+  CHECK(item_store_get(0) != NULL);
+  CHECK(s_requested_page != 0);
+
+  prv_deinit();
+  // Not counting the hello and the telemetry
+  printf("test_paging: ok (%d page requests, heap %zu bytes while scrolling)\n",
+         shim.sent_count - 2, heap_window);
+  return 0;
+}
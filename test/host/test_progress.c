@@ -0,0 +1,63 @@
+// Progress bar: one looping animation while the end is not known, a bar
+// filled from the items received while the phone sends a list.
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "messages.h"
+
+static void prv_send_progressing(int phase) {
+  DictionaryIterator *iter = shim_message_begin();
+  dict_write_cstring(iter, MESSAGE_KEY_SET_STATUS, "");
+  msg_int(iter, MESSAGE_KEY_SET_PROGRESSING, phase);
+  shim_message_deliver();
+}
+
+int main(void) {
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+  int created = shim.animations_created;
+
+  // Downloading: the bar sweeps, with the same animation all along
+  prv_send_progressing(2);
+  CHECK(shim_animations_running() == 1);
+  CHECK(shim.animations_created == created + 1);
+  shim_advance(10000);
+  CHECK(shim_animations_running() == 1);
+  CHECK(shim.animations_created == created + 1);
+  prv_send_progressing(1);
+  CHECK(shim.animations_created == created + 1);
+
+  // Sending: the setup says so and the sweep stops, the bar fills up instead
+  DictionaryIterator *iter = shim_message_begin();
+  msg_int(iter, MESSAGE_KEY_ITEMS_COUNT, 60);
+  msg_int(iter, MESSAGE_KEY_ITEMS_PAGE_BYTES, 400);
+  msg_int(iter, MESSAGE_KEY_SET_PROGRESSING, PROGRESS_SENDING);
+  shim_message_deliver();
+  CHECK(s_progress_sending);
+  CHECK(shim_animations_running() == 0);
+  int marks = shim.dirty_marks;
+  send_items(0, 30);
+  CHECK(shim.dirty_marks > marks);
+  shim_advance(1000); // the first screen is there, the menu slides in
+  CHECK(shim_animations_running() == 0);
+  send_items(30, 60);
+  CHECK(s_list_shown);
+
+  // Done
+  prv_send_progressing(0);
+  CHECK(!s_progress_sending);
+  CHECK(shim_animations_running() == 0);
+
+  // A later download sweeps again, without a total left over from the list
+  created = shim.animations_created;
+  prv_send_progressing(2);
+  CHECK(shim_animations_running() == 1);
+  CHECK(shim.animations_created == created + 1);
+  prv_send_progressing(0);
+  CHECK(shim_animations_running() == 0);
+
+  prv_deinit();
+  printf("test_progress: ok\n");
+  return 0;
+}
@@ -0,0 +1,137 @@
+// Resumable transfers: generations, batch checks, the resume point in the
+// hello, keeping a partial list across restarts and backing off hello retries.
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "messages.h"
+
+#define HASH 0x5a17c0de
+
+// Send items [first, end) like send_items(), in one batch with a BATCH_CHECK
+// for transfer `generation`. `corrupt` flips a byte after the check was taken.
+static void prv_send_checked(int first, int end, uint16_t generation, bool corrupt) {
+  static uint8_t blob[2048];
+  size_t pos = 2;
+  blob[0] = first & 0xff;
+  blob[1] = first >> 8;
+  for (int index = first; index < end; index++) {
+    int length = snprintf((char *)blob + pos + 2, 16, "item %d", index);
+    blob[pos] = 0;
+    blob[pos + 1] = length;
+    pos += 2 + length;
+  }
+  int32_t check = (int32_t)(((uint32_t)generation << 16) | prv_batch_checksum(blob, pos));
+  if (corrupt) blob[pos - 1] ^= 0x20;
+  DictionaryIterator *iter = shim_message_begin();
+  dict_write_data(iter, MESSAGE_KEY_ITEMS_BATCH, blob, pos);
+  msg_int(iter, MESSAGE_KEY_BATCH_CHECK, check);
+  shim_message_deliver();
+}
+
+static void prv_send_setup(int count, int num_sections, bool append, uint16_t generation) {
+  DictionaryIterator *iter = shim_message_begin();
+  msg_int(iter, MESSAGE_KEY_ITEMS_COUNT, count);
+  if (num_sections > 0) msg_int(iter, MESSAGE_KEY_SECTION_COUNT, num_sections);
+  msg_int(iter, MESSAGE_KEY_ITEMS_PAGE_BYTES, 400);
+  if (append) msg_int(iter, MESSAGE_KEY_LIST_APPEND, 1);
+  else msg_int(iter, MESSAGE_KEY_LIST_HASH, HASH);
+  msg_int(iter, MESSAGE_KEY_TRANSFER_GEN, generation);
+  shim_message_deliver();
+}
+
+int main(void) {
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+
+  // A newer transfer replaces an older one, whose remaining messages are dropped
+  prv_send_setup(20, 1, false, 6);
+  prv_send_checked(0, 10, 6, false);
+  prv_send_setup(150, 0, false, 7);
+  CHECK(s_generation == 7);
+  prv_send_setup(40, 2, true, 6);
+  CHECK(item_store_count() == 150);
+  prv_send_checked(10, 20, 6, false);
+  CHECK(item_store_loaded_count() == 0);
+
+  prv_send_checked(0, 40, 7, false);
+  CHECK(item_store_loaded_count() == 40);
+
+  // A corrupted batch is dropped and the hello says where to resume
+  int sent = shim.sent_count;
+  prv_send_checked(40, 80, 7, true);
+  CHECK(item_store_loaded_count() == 40);
+  CHECK(shim.sent_count == sent + 1);
+  CHECK(last_sent_int(MESSAGE_KEY_CACHED_LIST_HASH) == 0);
+  CHECK(last_sent_int(MESSAGE_KEY_RESUME_HASH) == HASH);
+  CHECK(last_sent_int(MESSAGE_KEY_RESUME_INDEX) == 40);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // Untagged batches are accepted
+  prv_send_checked(40, 60, 0, false);
+  CHECK(item_store_loaded_count() == 60);
+
+  // Items after a gap do not move the resume point
+  prv_send_checked(70, 80, 7, false);
+  CHECK(prv_received_count() == 60);
+
+  // Back from a disconnect, the watch reports how far it got
+  shim_set_connected(false);
+  shim_set_connected(true);
+  CHECK(last_sent_int(MESSAGE_KEY_RESUME_INDEX) == 60);
+
+  // Without a connection the hello waits for it instead of retrying
+  shim_set_connected(false);
+  shim_outbox_complete(APP_MSG_NOT_CONNECTED);
+  CHECK(s_hello_timer == NULL);
+  shim_set_connected(true);
+  shim_outbox_complete(APP_MSG_SEND_TIMEOUT);
+  CHECK(s_hello_timer != NULL);
+  sent = shim.sent_count;
+  shim_advance(HELLO_RETRY_MS / 2 - 1);
+  CHECK(shim.sent_count == sent);
+  shim_advance(HELLO_RETRY_MS / 2 + 1);
+  CHECK(shim.sent_count == sent + 1);
+  // ...and backs off further each time
+  shim_outbox_complete(APP_MSG_SEND_TIMEOUT);
+  sent = shim.sent_count;
+  shim_advance(HELLO_RETRY_MS - 1);
+  CHECK(shim.sent_count == sent);
+  shim_advance(HELLO_RETRY_MS + 1);
+  CHECK(shim.sent_count == sent + 1);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // Closing the app keeps what arrived, and the next start resumes from it
+  prv_deinit();
+  CHECK(list_cache_hash() == HASH);
+  prv_init();
+  CHECK(!s_list_shown);
+  CHECK(item_store_count() == 150);
+  CHECK(item_store_loaded_count() == 60);
+  CHECK(last_sent_int(MESSAGE_KEY_CACHED_LIST_HASH) == 0);
+  CHECK(last_sent_int(MESSAGE_KEY_RESUME_HASH) == HASH);
+  CHECK(last_sent_int(MESSAGE_KEY_RESUME_INDEX) == 60);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // The phone resumes in a generation of its own
+  prv_send_checked(60, 150, 2, false);
+  CHECK(item_store_loaded_count() == 60);
+  DictionaryIterator *iter = shim_message_begin();
+  msg_int(iter, MESSAGE_KEY_RESUME_HASH, HASH);
+  msg_int(iter, MESSAGE_KEY_TRANSFER_GEN, 2);
+  shim_message_deliver();
+  CHECK(s_generation == 2);
+  prv_send_checked(60, 150, 2, false);
+  CHECK(s_list_shown);
+  CHECK(strcmp(item_store_label(item_store_get(149)), "item 149") == 0);
+  CHECK(strcmp(item_store_label(item_store_get(10)), "item 10") == 0);
+  // The complete list replaced the partial one in the cache
+  prv_send_hello(NULL);
+  CHECK(last_sent_int(MESSAGE_KEY_CACHED_LIST_HASH) == HASH);
+  CHECK(last_sent_int(MESSAGE_KEY_RESUME_INDEX) == -1);
+  shim_outbox_complete(APP_MSG_OK);
+
+  prv_deinit();
+  printf("test_resume: ok\n");
+  return 0;
+}
@@ -0,0 +1,71 @@
+// Wrapped rows: heights are measured once per label and cached.
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "messages.h"
+
+static void prv_send_labels(int first, const char **labels, int count) {
+  static uint8_t blob[1024];
+  size_t pos = 2;
+  blob[0] = first & 0xff;
+  blob[1] = first >> 8;
+  for (int i = 0; i < count; i++) {
+    size_t length = strlen(labels[i]);
+    blob[pos] = 0;
+    blob[pos + 1] = length;
+    memcpy(blob + pos + 2, labels[i], length);
+    pos += 2 + length;
+  }
+  DictionaryIterator *iter = shim_message_begin();
+  dict_write_data(iter, MESSAGE_KEY_ITEMS_BATCH, blob, pos);
+  shim_message_deliver();
+}
+
+int main(void) {
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+
+  const char *labels[] = {
+    "Short",
+    "Wraps onto a second line",
+    "A task with a label so long that it would need more lines than a row may have, "
+    "so it is cut off after the last one and ends in an ellipsis instead",
+    "Another short one",
+  };
+  send_list_setup(4, 0, 400, 0);
+  prv_send_labels(0, labels, 4);
+  CHECK(s_list_shown);
+
+  // Every label was measured as it arrived
+  int measured = shim.text_measurements;
+  CHECK(measured == 4);
+  MenuIndex rows[4] = { { 0, 0 }, { 0, 1 }, { 0, 2 }, { 0, 3 } };
+  CHECK(prv_cell_height(shim.menu, &rows[0], NULL) == CELL_HEIGHT);
+  CHECK(prv_cell_height(shim.menu, &rows[1], NULL) == CELL_HEIGHT + ROW_LINE_HEIGHT);
+  CHECK(prv_cell_height(shim.menu, &rows[2], NULL)
+        == CELL_HEIGHT + (ROW_MAX_LINES - 1) * ROW_LINE_HEIGHT);
+  // Only counted until the menu is full, the last row does not fit any more
+  CHECK(prv_content_height() == MENU_CELL_BASIC_HEADER_HEIGHT + 3 * CELL_HEIGHT
+                                + ROW_MAX_LINES * ROW_LINE_HEIGHT);
+  CHECK(prv_content_height() >= s_menu_bounds.size.h);
+
+  // Scrolling and drawing do not measure again
+  for (int i = 0; i < 10; i++) {
+    shim_menu_draw(SHIM_SCREEN_HEIGHT);
+    prv_content_height();
+  }
+  CHECK(shim.text_measurements == measured);
+
+  // The checked icon narrows the label, so toggling measures it once more
+  shim_menu_click(rows[1], false);
+  CHECK(shim.text_measurements == measured + 1);
+  CHECK(item_store_get(1)->flags & ITEM_FLAG_CHECKED);
+  shim_outbox_complete(APP_MSG_OK);
+  shim_menu_draw(SHIM_SCREEN_HEIGHT);
+  CHECK(shim.text_measurements == measured + 1);
+
+  prv_deinit();
+  printf("test_rows: ok\n");
+  return 0;
+}
@@ -0,0 +1,104 @@
+// Sectioned lists streamed one file at a time (LIST_APPEND).
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "messages.h"
+
+static void prv_send_append(int count, int num_sections, int32_t hash) {
+  DictionaryIterator *iter = shim_message_begin();
+  msg_int(iter, MESSAGE_KEY_ITEMS_COUNT, count);
+  msg_int(iter, MESSAGE_KEY_SECTION_COUNT, num_sections);
+  msg_int(iter, MESSAGE_KEY_ITEMS_PAGE_BYTES, 300);
+  msg_int(iter, MESSAGE_KEY_LIST_APPEND, 1);
+  if (hash) msg_int(iter, MESSAGE_KEY_LIST_HASH, hash);
+  shim_message_deliver();
+}
+
+int main(void) {
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+
+  // Small list: the first section is shown before the others arrive
+  send_list_setup(10, 1, 300, 0);
+  send_section(0, "A", 10);
+  send_items(0, 10);
+  CHECK(s_list_shown);
+  MenuLayer *menu = shim.menu;
+
+  prv_send_append(10, 2, 0);
+  send_section(1, "[404] B", 0);
+  prv_send_append(25, 3, 4242);
+  send_section(2, "C", 15);
+  send_items(10, 25);
+  shim_advance(1000);
+
+  // Same menu throughout, only the last message completes (and caches) it
+  CHECK(shim.menu == menu);
+  CHECK(shim.menus_created == 1);
+  CHECK(item_store_count() == 25);
+  CHECK(item_store_section_count() == 3);
+  CHECK(item_store_section_item_count(1) == 0);
+  CHECK(item_store_global_index(2, 3) == 13);
+  CHECK(strcmp(item_store_label(item_store_get(13)), "item 13") == 0);
+  CHECK(strcmp(item_store_section_title(1), "[404] B") == 0);
+  CHECK(list_cache_hash() == 4242);
+
+  int section, row;
+  item_store_position(24, &section, &row);
+  CHECK(section == 2 && row == 14);
+  CHECK(shim_menu_draw(SHIM_SCREEN_HEIGHT) > 0);
+
+  // Large list: appending beyond the window keeps what is loaded
+  send_list_setup(100, 1, 300, 0);
+  send_section(0, "A", 100);
+  send_items(0, 100);
+  CHECK(s_list_shown);
+  prv_send_append(300, 2, 99);
+  send_section(1, "B", 200);
+  CHECK(item_store_count() == 300);
+  CHECK(item_store_capacity() == ITEM_STORE_PAGE_SIZE * ITEM_STORE_WINDOW_PAGES);
+  CHECK(item_store_loaded_count() == 100);
+  send_items(100, item_store_capacity());
+  CHECK(item_store_loaded_count() == item_store_capacity());
+  CHECK(strcmp(item_store_label(item_store_get(150)), "item 150") == 0);
+  CHECK(strcmp(item_store_section_title(1), "B") == 0);
+  // Too large to cache
+  CHECK(list_cache_hash() == 0);
+  shim_advance(1000);
+
+  // All headers come with the setup. Titles take the room announced for
+  // them, one that does not fit is cut.
+  static const uint8_t headers[] = { 0, 2, 0, 5, 'I', 'n', 'b', 'o', 'x',
+                                     2, 0, 7, 'S', 'o', 'm', 'e', 'd', 'a', 'y' };
+  DictionaryIterator *iter = shim_message_begin();
+  msg_int(iter, MESSAGE_KEY_ITEMS_COUNT, 4);
+  msg_int(iter, MESSAGE_KEY_SECTION_COUNT, 2);
+  msg_int(iter, MESSAGE_KEY_SECTION_TITLE_BYTES, 8);
+  msg_int(iter, MESSAGE_KEY_ITEMS_PAGE_BYTES, 40);
+  msg_int(iter, MESSAGE_KEY_LIST_HASH, 77);
+  dict_write_data(iter, MESSAGE_KEY_SECTION_HEADERS, headers, sizeof(headers));
+  shim_message_deliver();
+  CHECK(item_store_section_item_count(1) == 2);
+  CHECK(strcmp(item_store_section_title(1), "Somed") == 0);
+  // Sent again, a title keeps its place
+  send_section(0, "Inbox", 2);
+  send_section(1, "Someday later", 2);
+  send_items(0, 4);
+  CHECK(s_list_shown);
+  CHECK(strcmp(item_store_section_title(0), "Inbox") == 0);
+  CHECK(strcmp(item_store_section_title(1), "Somed") == 0);
+
+  // ...and they come back from the cache as they were
+  prv_deinit();
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+  CHECK(s_list_shown);
+  CHECK(strcmp(item_store_section_title(0), "Inbox") == 0);
+  CHECK(strcmp(item_store_section_title(1), "Somed") == 0);
+  CHECK(item_store_section_item_count(1) == 2);
+
+  prv_deinit();
+  printf("test_sections: ok (%d allocations, peak heap %zu bytes)\n", shim.allocs, shim.heap_peak);
+  return 0;
+}
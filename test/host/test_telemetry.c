@@ -0,0 +1,96 @@
+// Telemetry: timings, counters, the debug overlay and the TELEMETRY blob.
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "messages.h"
+
+static uint32_t prv_get_u32(const uint8_t *data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+int main(void) {
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+
+  // The first list is timed from app start
+  shim_advance(300);
+  send_list_setup(40, 0, 400, 77);
+  shim_advance(200);
+  send_items(0, 20);
+  shim_advance(100);
+  CHECK(!telemetry_pending());
+  send_items(20, 40);
+  CHECK(s_list_shown);
+  CHECK(telemetry_pending());
+  shim_drop(APP_MSG_BUFFER_OVERFLOW);
+
+  // A long press shows the overlay and another one hides it again
+  shim_menu_click((MenuIndex){ 0, 0 }, true);
+  CHECK(s_debug_layer != NULL);
+  CHECK(strstr(s_debug_text, "First item: 500 ms") != NULL);
+  CHECK(strstr(s_debug_text, "List: 600 ms (40 items)") != NULL);
+  CHECK(strstr(s_debug_text, "Dropped: 1") != NULL);
+  shim_menu_click((MenuIndex){ 0, 0 }, true);
+  CHECK(s_debug_layer == NULL);
+
+  // The telemetry goes out with a toggle made right away
+  shim_menu_click((MenuIndex){ 0, 1 }, false);
+  CHECK(last_sent_toggle(1) == 1);
+  Tuple *blob = dict_find(shim_last_sent(), MESSAGE_KEY_TELEMETRY);
+  CHECK(blob && blob->length == TELEMETRY_SIZE);
+  const uint8_t *data = blob->value->data;
+  CHECK(data[0] == TELEMETRY_VERSION);
+  CHECK(prv_get_u32(data + 1) == 500);
+  CHECK(prv_get_u32(data + 5) == 600);
+  CHECK((data[9] | (data[10] << 8)) == 40);
+  CHECK((data[11] | (data[12] << 8)) == 3);
+  CHECK((data[17] | (data[18] << 8)) == 1);
+  CHECK(prv_get_u32(data + 23) >= prv_get_u32(data + 13));
+  CHECK(!telemetry_pending());
+  shim_outbox_complete(APP_MSG_OK);
+
+  // ...and only once
+  shim_menu_click((MenuIndex){ 0, 1 }, false);
+  CHECK(dict_find(shim_last_sent(), MESSAGE_KEY_TELEMETRY) == NULL);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // Later lists are timed from their setup message
+  shim_advance(5000);
+  send_list_setup(5, 0, 50, 78);
+  shim_advance(40);
+  send_items(0, 5);
+  CHECK(telemetry_pending());
+  telemetry_format(s_debug_text, sizeof(s_debug_text));
+  CHECK(strstr(s_debug_text, "List: 40 ms (5 items)") != NULL);
+
+  // Without a toggle it goes out on its own
+  int sent = shim.sent_count;
+  shim_advance(TELEMETRY_SEND_DELAY_MS - 1);
+  CHECK(shim.sent_count == sent);
+  shim_advance(1);
+  CHECK(shim.sent_count == sent + 1);
+  blob = dict_find(shim_last_sent(), MESSAGE_KEY_TELEMETRY);
+  CHECK(blob && blob->length == TELEMETRY_SIZE);
+  CHECK(prv_get_u32(blob->value->data + 5) == 40);
+  CHECK(dict_find(shim_last_sent(), MESSAGE_KEY_ITEM_TOGGLES) == NULL);
+  CHECK(!telemetry_pending());
+  shim_outbox_complete(APP_MSG_OK);
+
+  // ...once the outbox is free
+  send_list_setup(5, 0, 50, 79);
+  send_items(0, 5);
+  prv_send_hello(NULL);
+  sent = shim.sent_count;
+  shim_advance(TELEMETRY_SEND_DELAY_MS);
+  CHECK(shim.sent_count == sent);
+  CHECK(telemetry_pending());
+  shim_outbox_complete(APP_MSG_OK);
+  CHECK(shim.sent_count == sent + 1);
+  CHECK(dict_find(shim_last_sent(), MESSAGE_KEY_TELEMETRY) != NULL);
+  shim_outbox_complete(APP_MSG_OK);
+
+  prv_deinit();
+  printf("test_telemetry: ok\n");
+  return 0;
+}
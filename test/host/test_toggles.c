@@ -0,0 +1,144 @@
+// Toggle journal: toggles wait for a busy outbox or a missing connection,
+// survive a restart, merge, go out in batches and stay until acknowledged.
+// They name the list they were made on and do not outlive it.
+#define main checkmark_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "messages.h"
+
+static void prv_toggle(int index) {
+  shim_menu_click((MenuIndex){ 0, index }, false);
+}
+
+static int prv_sent_toggles(void) {
+  Tuple *tuple = dict_find(shim_last_sent(), MESSAGE_KEY_ITEM_TOGGLES);
+  return tuple ? tuple->length / TOGGLE_JOURNAL_ENTRY_SIZE : 0;
+}
+
+int main(void) {
+  prv_init();
+  shim_outbox_complete(APP_MSG_OK);
+  send_list_setup(40, 0, 400, 99);
+  send_items(0, 40);
+  CHECK(s_list_shown);
+
+  // The connection drops while a toggle is on its way, the next ones wait
+  prv_toggle(1);
+  CHECK(last_sent_toggle(1) == 1);
+  shim_set_connected(false);
+  shim_outbox_complete(APP_MSG_NOT_CONNECTED);
+  CHECK(s_toggle_timer == NULL);
+  int sent = shim.sent_count;
+  prv_toggle(2);
+  prv_toggle(3);
+  CHECK(toggle_journal_unsent() == 3);
+  // Toggling an item back before it was sent cancels it
+  prv_toggle(2);
+  CHECK(toggle_journal_unsent() == 2);
+  CHECK(item_store_get(1)->flags & ITEM_FLAG_CHECKED);
+  CHECK(!(item_store_get(3)->flags & ITEM_FLAG_CHECKED));
+
+  // They are still there after a restart, and go out after the hello once
+  // the phone is back
+  prv_deinit();
+  prv_init();
+  CHECK(toggle_journal_unsent() == 2);
+  CHECK(item_store_get(1)->flags & ITEM_FLAG_CHECKED);
+  CHECK(!(item_store_get(3)->flags & ITEM_FLAG_CHECKED));
+  shim_outbox_complete(APP_MSG_NOT_CONNECTED);
+  shim_set_connected(true);
+  CHECK(last_sent_int(MESSAGE_KEY_WATCH_INBOX_SIZE) > 0);
+  shim_outbox_complete(APP_MSG_OK);
+  CHECK(shim.sent_count == sent + 3);
+  CHECK(prv_sent_toggles() == 2);
+  CHECK(last_sent_toggle(1) == 1);
+  CHECK(last_sent_toggle(3) == 0);
+  CHECK(toggle_journal_in_flight());
+
+  // Toggled again while in flight: that state goes out after the ack
+  prv_toggle(1);
+  shim_outbox_complete(APP_MSG_OK);
+  CHECK(prv_sent_toggles() == 1);
+  CHECK(last_sent_toggle(1) == 0);
+  shim_outbox_complete(APP_MSG_OK);
+  CHECK(toggle_journal_unsent() == 0 && !toggle_journal_in_flight());
+  CHECK(!persist_exists(90));
+
+  // A failed send is tried again after a while
+  prv_toggle(5);
+  sent = shim.sent_count;
+  shim_outbox_complete(APP_MSG_SEND_TIMEOUT);
+  CHECK(s_toggle_timer != NULL);
+  shim_advance(TOGGLE_RETRY_MS);
+  CHECK(shim.sent_count == sent + 1);
+  CHECK(last_sent_toggle(5) == 1);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // Quick toggles pile up behind a busy outbox and go out together
+  prv_send_hello(NULL);
+  for (int i = 10; i < 30; i++) prv_toggle(i);
+  shim_outbox_complete(APP_MSG_OK);
+  CHECK(prv_sent_toggles() == TOGGLES_PER_MESSAGE);
+  shim_outbox_complete(APP_MSG_OK);
+  CHECK(prv_sent_toggles() == 20 - TOGGLES_PER_MESSAGE);
+  CHECK(last_sent_toggle(29) >= 0);
+  shim_outbox_complete(APP_MSG_OK);
+  CHECK(toggle_journal_unsent() == 0 && !toggle_journal_in_flight());
+  CHECK(last_sent_int(MESSAGE_KEY_TOGGLES_LIST_HASH) == 99);
+
+  // A diff keeps the ids, so waiting entries now belong to its list
+  shim_set_connected(false);
+  prv_toggle(4);
+  static const uint8_t remove_first[] = { 40, 0, 39, 0, 0, DIFF_REMOVE, 0, 0, 1, 0 };
+  DictionaryIterator *iter = shim_message_begin();
+  dict_write_data(iter, MESSAGE_KEY_ITEMS_DIFF, remove_first, sizeof(remove_first));
+  msg_int(iter, MESSAGE_KEY_LIST_HASH, 100);
+  msg_int(iter, MESSAGE_KEY_ITEMS_PAGE_BYTES, 400);
+  shim_message_deliver();
+  CHECK(item_store_count() == 39 && item_store_get(3)->id == 4);
+  CHECK(toggle_journal_list_hash() == 100);
+
+  // The restored list numbers its items by position, so do the entries
+  prv_deinit();
+  prv_init();
+  CHECK(item_store_get(3)->id == 3);
+  shim_set_connected(true);
+  shim_outbox_complete(APP_MSG_OK);
+  CHECK(last_sent_int(MESSAGE_KEY_TOGGLES_LIST_HASH) == 100);
+  CHECK(last_sent_toggle(3) == 1);
+  shim_outbox_complete(APP_MSG_OK);
+
+  // A new list drops what was not sent, even one in flight
+  shim_set_connected(false);
+  prv_toggle(5);
+  send_list_setup(20, 0, 200, 101);
+  send_items(0, 20);
+  CHECK(toggle_journal_unsent() == 0 && toggle_journal_list_hash() == 101);
+  shim_set_connected(true);
+  prv_toggle(6);
+  send_list_setup(20, 0, 200, 102);
+  shim_outbox_complete(APP_MSG_OK);
+  CHECK(toggle_journal_unsent() == 0 && !toggle_journal_in_flight());
+  CHECK(!persist_exists(90));
+
+  // So does restoring a list other than the one they were made on
+  send_items(0, 20);
+  shim_set_connected(false);
+  prv_toggle(7);
+  prv_deinit();
+  CHECK(toggle_journal_unsent() == 1);
+  uint8_t *data;
+  uint32_t hash;
+  size_t length = list_cache_read(&hash, &data);
+  CHECK(length > 0 && hash == 102);
+  list_cache_write(103, data, length);
+  free(data);
+  prv_init();
+  CHECK(s_list_shown && s_list_hash == 103);
+  CHECK(toggle_journal_unsent() == 0);
+
+  prv_deinit();
+  printf("test_toggles: ok\n");
+  return 0;
+}
@@ -0,0 +1,448 @@
+// End-to-end benchmark of the companion (src/pkjs/index.js): from 'ready' to
+// the list on the watch, and from a burst of toggles on the watch to the
+// document saved on the server. Runs against the in-process WebDAV server of
+// mock-webdav.js with simulated time, see companion-harness.js.
+//
+// Usage: node test/pkjs/bench-pipeline.js [options] [scenario...]
+//   --latency=60        HTTP latency in ms
+//   --link-latency=80   Bluetooth round trip per AppMessage in ms
+//   --throughput=4000   Bluetooth throughput in bytes per second
+//   --items=80          items in the single-file document
+//   --seed=1            seed for injected errors
+//   --baseline[=file]   compare with a baseline, exit 1 on regressions
+//   --write-baseline[=file]
+//   --verbose           show the companion's log
+//
+// 'first ms' is when the first items of the list reached the watch, which shows
+// them as soon as they fill its screen; 'list ms' when all of them had.
+//
+// The default baseline is test/pkjs/pipeline-baseline.json. Simulated times,
+// request, message and byte counts are deterministic and compared; the CPU
+// time the run took in Node is only reported.
+
+const fs = require('fs');
+const path = require('path');
+
+const harness = require('./companion-harness');
+const mockWebdav = require('./mock-webdav');
+const markdown = require('../../src/pkjs/markdown');
+
+const DEFAULT_BASELINE = path.join(__dirname, 'pipeline-baseline.json');
+// A metric regresses if it grows by more than this fraction (and by more
+// than one unit, so small counts do not flap). Every compared metric is
+// deterministic, so anything beyond rounding is a real change: record it with
+// --write-baseline if it is intended.
+const TOLERANCE = 0.02;
+const COMPARED = ['firstMs', 'listMs', 'simMs', 'http', 'httpBytes', 'messages', 'messageBytes', 'retries'];
+
+const ORIGIN = 'https://dav.test';
+const ROOT = '/remote.php/dav/files/user/';
+// Rows of the file picker before the files: Load, All open tasks
+const FILE_ROW = 2;
+
+let options = { latency: 60, 'link-latency': 80, throughput: 4000, items: 80, seed: 1 };
+let baselineFile = null;
+let writeBaselineFile = null;
+let verbose = false;
+let selected = [];
+process.argv.slice(2).forEach(function (arg) {
+  let m = arg.match(/^--([\w-]+)=(\d+)$/);
+  if (m && m[1] in options) options[m[1]] = parseInt(m[2], 10);
+  else if (arg === '--baseline' || arg.startsWith('--baseline=')) baselineFile = arg.split('=')[1] || DEFAULT_BASELINE;
+  else if (arg === '--write-baseline' || arg.startsWith('--write-baseline=')) writeBaselineFile = arg.split('=')[1] || DEFAULT_BASELINE;
+  else if (arg === '--verbose') verbose = true;
+  else if (arg.startsWith('--')) throw new Error('Unknown option ' + arg);
+  else selected.push(arg);
+});
+
+function newServer(errorRate) {
+  return mockWebdav.create({ origin: ORIGIN, latency: options.latency, errorRate: errorRate || 0,
+                             seed: options.seed });
+}
+
+function newSession(server, url, previous, extra) {
+  return harness.createSession(Object.assign({
+    server: server,
+    url: url,
+    storage: previous ? previous.storage : null,
+    watch: previous ? previous.watch : null,
+    linkLatency: options['link-latency'],
+    throughput: options.throughput,
+    seed: options.seed,
+    verbose: verbose,
+  }, extra || {}));
+}
+
+// Run a session to the end and collect what it cost. `listStart` is when the
+// wait for the list began, `cpuStart` when the companion started working.
+function measure(session, listStart, cpuStart) {
+  let end = session.run();
+  let stats = session.stats;
+  let since = function (ms) { return ms === null || ms < listStart ? 0 : ms - listStart; };
+  return {
+    firstMs: since(stats.firstItemMs),
+    listMs: since(stats.listMs),
+    simMs: end,
+    cpuMs: Number(process.hrtime.bigint() - cpuStart) / 1e6,
+    http: stats.http,
+    httpBytes: stats.httpBytes,
+    messages: stats.messages,
+    messageBytes: stats.messageBytes,
+    retries: stats.nacks + stats.httpErrors,
+  };
+}
+
+function finish(session, result) {
+  let watch = session.finish();
+  result.state = { storage: session.storage, watch: watch };
+  return result;
+}
+
+// --- Scenarios ---
+
+// Single-file mode: one document, first start, restart and a changed file.
+function singleFile(items) {
+  let server = newServer();
+  let url = ORIGIN + ROOT + 'todo.md';
+  server.putFile(ROOT + 'todo.md', mockWebdav.generateDocument('todo', items, 5));
+  return { server: server, url: url };
+}
+
+function loadOnce(env, previous, extra) {
+  let session = newSession(env.server, env.url, previous, extra);
+  let cpuStart = process.hrtime.bigint();
+  session.start();
+  let result = measure(session, 0, cpuStart);
+  if (session.watch.count > 0 && !session.watch.complete) throw new Error('List not complete on the watch');
+  return finish(session, result);
+}
+
+let scenarios = {};
+let shared = {};
+
+scenarios['single-cold'] = function () {
+  shared.single = singleFile(options.items);
+  shared.singleCold = loadOnce(shared.single, null);
+  return shared.singleCold;
+};
+
+scenarios['single-warm'] = function () {
+  if (!shared.singleCold) scenarios['single-cold']();
+  return loadOnce(shared.single, shared.singleCold.state);
+};
+
+scenarios['single-edited'] = function () {
+  if (!shared.singleCold) scenarios['single-cold']();
+  shared.single.server.editFile(ROOT + 'todo.md', function (text) {
+    return text.replace('- [ ] Call', '- [x] Call') + '- [ ] Added from another device\n';
+  });
+  return loadOnce(shared.single, shared.singleCold.state);
+};
+
+scenarios['single-large'] = function () {
+  return loadOnce(singleFile(2000), null);
+};
+
+// The watch app is closed while a large list arrives through a small (aplite)
+// inbox, and started again. Measured over the second start, which only sends
+// what the watch does not have yet.
+scenarios['single-resumed'] = function () {
+  let env = singleFile(2000);
+  let extra = { inboxSize: 2048 };
+  let first = newSession(env.server, env.url, null, extra);
+  first.start();
+  for (let i = 0; i < 1000 && first.watch.items.length === 0; i++) first.clock.run(10);
+  if (first.watch.items.length === 0) throw new Error('No items arrived');
+  let state = { storage: first.storage, watch: first.stop() };
+  if (!state.watch.partial) throw new Error('Watch did not keep the partial list');
+  return loadOnce(env, state, extra);
+};
+
+// Folder mode: list the tree, select four files on the watch and load them.
+// The list time counts from pressing Load.
+function folderEnv() {
+  let server = newServer();
+  mockWebdav.generateTree(server, ROOT + 'Notes/', 8, 12, 30);
+  return { server: server, url: ORIGIN + ROOT + 'Notes/' };
+}
+
+function loadFolder(env, previous) {
+  let session = newSession(env.server, env.url, previous);
+  let cpuStart = process.hrtime.bigint();
+  session.start();
+  session.run();
+  if (session.watch.count < FILE_ROW + 4) throw new Error('File picker not shown');
+  let pickedAt = session.clock.now();
+  [0, 1, 2, 3].forEach(function (file) {
+    let row = FILE_ROW + file;
+    if (!(session.watch.items[row].flags & 1)) session.watch.toggle(row);
+  });
+  session.watch.toggle(0);
+  let result = measure(session, pickedAt, cpuStart);
+  if (session.watch.sections.length !== 4) throw new Error('Selected files not shown');
+  return finish(session, result);
+}
+
+scenarios['folder-cold'] = function () {
+  shared.folder = folderEnv();
+  shared.folderCold = loadFolder(shared.folder, null);
+  return shared.folderCold;
+};
+
+scenarios['folder-warm'] = function () {
+  if (!shared.folderCold) scenarios['folder-cold']();
+  return loadFolder(shared.folder, shared.folderCold.state);
+};
+
+// All open tasks of the folder in one list, measured from pressing the row.
+// The first time every file is read, after that only those whose ETag
+// changed. `gets` is how many GET requests that may take. `then(session)`
+// runs once the list is shown.
+function openAllTasks(env, previous, gets, then) {
+  let session = newSession(env.server, env.url, previous);
+  let cpuStart = process.hrtime.bigint();
+  session.start();
+  session.run();
+  if (session.watch.count < FILE_ROW) throw new Error('File picker not shown');
+  let pressedAt = session.clock.now();
+  let getsBefore = session.stats.httpByMethod.GET || 0;
+  session.watch.toggle(1);
+  let result = measure(session, pressedAt, cpuStart);
+  let read = (session.stats.httpByMethod.GET || 0) - getsBefore;
+  if (read !== gets) throw new Error('Read ' + read + ' files instead of ' + gets);
+  if (session.watch.sections.length !== 8 * 12) throw new Error('Not every file is shown');
+  if (then) then(session);
+  return finish(session, result);
+}
+
+function openTasks(server) {
+  let count = 0;
+  for (let d = 0; d < 8; d++) {
+    for (let f = 0; f < 12; f++) {
+      let text = server.getFile(ROOT + 'Notes/Project ' + d + '/Notes ' + f + '.md');
+      count += markdown.scanItems(text).length;
+    }
+  }
+  return count;
+}
+
+scenarios['tasks-cold'] = function () {
+  shared.tasks = folderEnv();
+  shared.tasksCold = openAllTasks(shared.tasks, null, 8 * 12);
+  return shared.tasksCold;
+};
+
+scenarios['tasks-warm'] = function () {
+  if (!shared.tasksCold) scenarios['tasks-cold']();
+  return openAllTasks(shared.tasks, shared.tasksCold.state, 0);
+};
+
+// One file changed on the server: only it is read again. Checking off the
+// first task of the list then goes back to its file.
+scenarios['tasks-edited'] = function () {
+  if (!shared.tasksCold) scenarios['tasks-cold']();
+  let server = shared.tasks.server;
+  server.editFile(ROOT + 'Notes/Project 3/Notes 5.md', function (text) {
+    return text + '- [ ] Added from another device\n';
+  });
+  let before = openTasks(server);
+  return openAllTasks(shared.tasks, shared.tasksCold.state, 1, function (session) {
+    session.watch.toggle(0);
+    session.run();
+    if (openTasks(server) !== before - 1) throw new Error('Check-off not saved');
+  });
+};
+
+// Files of a large folder are loaded through a small inbox, and the settings
+// are saved (main() runs again) as soon as the first of them reaches the
+// watch. Only the newest list, the picker again, should use the link after.
+scenarios['folder-reload'] = function () {
+  let server = newServer();
+  mockWebdav.generateTree(server, ROOT + 'Notes/', 40, 12, 30);
+  let session = newSession(server, ORIGIN + ROOT + 'Notes/', null, { inboxSize: 2048 });
+  let cpuStart = process.hrtime.bigint();
+  session.start();
+  session.run();
+  [0, 1, 2, 3].forEach(function (file) { session.watch.toggle(FILE_ROW + file); });
+  session.watch.toggle(0);
+  let picker = session.watch.count;
+  for (let i = 0; i < 1000 && session.watch.count === picker; i++) session.clock.run(10);
+  session.reload();
+  let result = measure(session, 0, cpuStart);
+  if (session.watch.sections.length !== 2 || session.watch.count !== FILE_ROW + 40 * 12) {
+    throw new Error('Picker not shown after the reload');
+  }
+  return finish(session, result);
+};
+
+scenarios['large-tree'] = function () {
+  let server = newServer();
+  mockWebdav.generateTree(server, ROOT + 'Archive/', 100, 30, 5);
+  let session = newSession(server, ORIGIN + ROOT + 'Archive/', null);
+  let cpuStart = process.hrtime.bigint();
+  session.start();
+  let result = measure(session, 0, cpuStart);
+  if (session.watch.count !== FILE_ROW + 3000) throw new Error('Picker has ' + session.watch.count + ' rows');
+  return finish(session, result);
+};
+
+// Sixty files are selected on a watch with little heap left: the files it has
+// no room for are left out instead of the list being refused.
+scenarios['folder-low-memory'] = function () {
+  let server = newServer();
+  mockWebdav.generateTree(server, ROOT + 'Notes/', 6, 10, 5);
+  let session = newSession(server, ORIGIN + ROOT + 'Notes/', null, { heapBudget: 2560 });
+  let cpuStart = process.hrtime.bigint();
+  session.start();
+  session.run();
+  let pickedAt = session.clock.now();
+  for (let file = 0; file < 60; file++) session.watch.toggle(FILE_ROW + file);
+  session.watch.toggle(0);
+  let result = measure(session, pickedAt, cpuStart);
+  let sections = session.watch.sections.length;
+  if (sections === 0 || sections >= 60 || !session.watch.complete) {
+    throw new Error('Watch shows ' + sections + ' of 60 files');
+  }
+  return finish(session, result);
+};
+
+// Toggle storm: the user checks and unchecks items quickly while another
+// device edits the same file. Measured from the first toggle until the
+// server has every change.
+function toggleStorm(errorRate, nackRate) {
+  let env = singleFile(options.items);
+  let server = mockWebdav.create({ origin: ORIGIN, latency: options.latency, errorRate: 0,
+                                   seed: options.seed });
+  server.putFile(ROOT + 'todo.md', env.server.getFile(ROOT + 'todo.md'));
+  let session = newSession(server, env.url, null);
+  session.start();
+  session.run();
+  let count = session.watch.count;
+  if (count < 40) throw new Error('Storm needs at least 40 items');
+
+  // Errors only once the list is shown
+  server.options.errorRate = errorRate;
+  session.setNackRate(nackRate);
+  let statsBefore = JSON.parse(JSON.stringify(session.stats));
+  let start = session.clock.now();
+  let expected = {};
+  for (let i = 0; i < 60; i++) {
+    let row = (i * 7) % 40;
+    session.clock.setTimeout(function () {
+      session.watch.toggle(row);
+    }, 25 * i);
+  }
+  session.clock.setTimeout(function () {
+    server.editFile(ROOT + 'todo.md', function (text) {
+      return '- [ ] Inserted by someone else\n' + text;
+    });
+  }, 700);
+
+  let cpuStart = process.hrtime.bigint();
+  let end = session.run();
+  let stats = session.stats;
+  let conflicts = server.stats.statuses[412] || 0;
+
+  for (let row = 0; row < 40; row++) {
+    let item = session.watch.items[row];
+    expected[row] = !!(item.flags & 1);
+  }
+  let text = server.getFile(ROOT + 'todo.md');
+  let onServer = {};
+  markdown.scanItems(text, true).forEach(function (item) { onServer[item.name] = item.checked; });
+  let original = markdown.scanItems(env.server.getFile(ROOT + 'todo.md'), false);
+  let synced = Object.keys(expected).every(function (row) {
+    return onServer[original[row].name] === expected[row];
+  }) && onServer['Inserted by someone else'] === false;
+
+  let result = {
+    firstMs: 0,
+    listMs: 0,
+    simMs: end - start,
+    cpuMs: Number(process.hrtime.bigint() - cpuStart) / 1e6,
+    http: stats.http - statsBefore.http,
+    httpBytes: stats.httpBytes - statsBefore.httpBytes,
+    messages: stats.messages - statsBefore.messages,
+    messageBytes: stats.messageBytes - statsBefore.messageBytes,
+    retries: stats.nacks - statsBefore.nacks + stats.httpErrors - statsBefore.httpErrors + conflicts,
+    synced: synced,
+  };
+  finish(session, result);
+  if (!synced && errorRate === 0) throw new Error('Server does not have all toggles');
+  return result;
+}
+
+scenarios['toggle-storm'] = function () {
+  return toggleStorm(0, 0);
+};
+
+scenarios['toggle-storm-lossy'] = function () {
+  return toggleStorm(0.1, 0.05);
+};
+
+// --- Report ---
+
+function pad(value, width) {
+  return String(value).padStart(width);
+}
+
+function formatDelta(current, base) {
+  if (base === undefined) return '';
+  if (base === 0) return current === 0 ? '' : ' (new)';
+  let change = Math.round((current - base) * 100 / base);
+  return change === 0 ? '' : ' (' + (change > 0 ? '+' : '') + change + '%)';
+}
+
+let baseline = null;
+if (baselineFile) {
+  baseline = JSON.parse(fs.readFileSync(baselineFile, 'utf8'));
+  if (JSON.stringify(baseline.options) !== JSON.stringify(options)) {
+    process.stdout.write('Warning: baseline was recorded with ' + JSON.stringify(baseline.options) + '\n');
+  }
+}
+
+let names = selected.length > 0 ? selected : Object.keys(scenarios);
+let results = {};
+let regressions = [];
+
+process.stdout.write(`http latency=${options.latency}ms link latency=${options['link-latency']}ms ` +
+                     `throughput=${options.throughput}B/s items=${options.items}\n`);
+process.stdout.write('scenario           first ms   list ms    sim ms  cpu ms  http  http KB  msgs  msg KB  retries\n');
+names.forEach(function (name) {
+  if (!scenarios[name]) throw new Error('Unknown scenario ' + name);
+  let r = Object.assign({}, scenarios[name]());
+  delete r.state;
+  results[name] = r;
+  let base = baseline && baseline.scenarios[name];
+  let d = function (key) { return base ? formatDelta(r[key], base[key]) : ''; };
+  process.stdout.write(`${name.padEnd(18)} ${pad(r.firstMs, 8)} ${pad(r.listMs, 9)} ${pad(r.simMs, 9)} ` +
+                       `${pad(r.cpuMs.toFixed(1), 7)} ` +
+                       `${pad(r.http, 5)} ${pad((r.httpBytes / 1024).toFixed(1), 8)} ${pad(r.messages, 5)} ` +
+                       `${pad((r.messageBytes / 1024).toFixed(1), 7)} ${pad(r.retries, 8)}` +
+                       `${r.synced === false ? '  NOT SYNCED' : ''}\n`);
+  if (base) {
+    let changes = COMPARED.map(function (key) { return d(key) ? key + d(key) : ''; }).filter(Boolean);
+    if (changes.length > 0) process.stdout.write(' '.repeat(19) + changes.join(', ') + '\n');
+    COMPARED.forEach(function (key) {
+      if (r[key] > base[key] * (1 + TOLERANCE) && r[key] > base[key] + 1) {
+        regressions.push(name + ' ' + key + ': ' + base[key] + ' -> ' + r[key]);
+      }
+    });
+    if (base.synced === true && r.synced === false) regressions.push(name + ': no longer synced');
+  }
+});
+
+if (writeBaselineFile) {
+  let stored = {};
+  Object.keys(results).forEach(function (name) {
+    stored[name] = Object.assign({}, results[name]);
+    delete stored[name].cpuMs;
+  });
+  fs.writeFileSync(writeBaselineFile, JSON.stringify({ options: options, scenarios: stored }, null, 2) + '\n');
+  process.stdout.write('Baseline written to ' + writeBaselineFile + '\n');
+}
+
+if (regressions.length > 0) {
+  process.stdout.write('Regressions against the baseline:\n  ' + regressions.join('\n  ') + '\n');
+  process.exit(1);
+}
@@ -0,0 +1,143 @@
+// Compares the 'single' (one item per AppMessage) and 'batch' (ITEMS_BATCH)
+// transfer protocols from src/pkjs/transfer.js over a simulated Bluetooth link.
+// A second table compares raw and compact label encodings on an aplite watch:
+// bytes sent for the list setup and its initial window, and the heap the
+// watch's item store takes per resident item (computed as item_store_init()
+// sizes it).
+//
+// Usage: node test/pkjs/bench-transfer.js [--inbox=8192] [--latency=80] [--throughput=4000] [N...]
+//
+// Every AppMessage costs one round trip of `latency` ms plus its size divided by
+// `throughput` (bytes per second). The numbers are a model, not a measurement,
+// but round trip counts are exact.
+
+const path = require('path');
+const Module = require('module');
+
+const pkg = require('../../package.json');
+const messageKeys = {};
+pkg.pebble.messageKeys.forEach(function (name, i) { messageKeys[name] = 10000 + i; });
+
+const originalLoad = Module._load;
+Module._load = function (request, parent, isMain) {
+  if (request === 'message_keys') return messageKeys;
+  return originalLoad.apply(this, arguments);
+};
+
+let options = { inbox: 8192, latency: 80, throughput: 4000 };
+let counts = [];
+process.argv.slice(2).forEach(function (arg) {
+  let m = arg.match(/^--(\w+)=(\d+)$/);
+  if (m) options[m[1]] = parseInt(m[2], 10);
+  else counts.push(parseInt(arg, 10));
+});
+if (counts.length === 0) counts = [10, 50, 200, 1000];
+
+function messageSize(payload) {
+  let size = 1;
+  Object.keys(payload).forEach(function (key) {
+    let value = payload[key];
+    size += 7;
+    if (typeof value === 'number') size += 4;
+    else if (typeof value === 'string') size += Buffer.byteLength(value) + 1;
+    else size += value.length;
+  });
+  return size;
+}
+
+let linkMs = 0;
+let bytes = 0;
+global.Pebble = {
+  sendAppMessage: function (payload, ack) {
+    let size = messageSize(payload);
+    if (size > options.inbox) throw new Error('Message of ' + size + ' bytes exceeds inbox');
+    bytes += size;
+    linkMs += options.latency + size * 1000 / options.throughput;
+    setImmediate(ack);
+  },
+};
+console.log = function () {};
+
+const transfer = require(path.join(__dirname, '../../src/pkjs/transfer.js'));
+
+function generateItems(n) {
+  let words = ['Buy', 'Call', 'Fix', 'Review', 'Write', 'Plan', 'Email', 'Book'];
+  let items = [];
+  for (let i = 0; i < n; i++) {
+    items.push({ name: `${words[i % words.length]} task number ${i} #project`, checked: false });
+  }
+  return items;
+}
+
+function run(protocol, n) {
+  return new Promise(function (resolve) {
+    linkMs = 0;
+    bytes = 0;
+    transfer.setProtocol(protocol);
+    // ITEMS_ITEM sends names as they are, so compare with raw batches
+    transfer.setLabelEncoding('raw');
+    // Measure a full transfer: pretend the whole list fits the watch window
+    let pages = Math.ceil(n / 32);
+    transfer.setWatchInfo(options.inbox, 0, { pageSize: 32, windowPages: pages, poolBudget: pages * 32 * 256 });
+    transfer.prepareList(generateItems(n));
+    transfer.sendItems(function (roundTrips) {
+      resolve({ protocol: protocol, n: n, roundTrips: roundTrips, ms: Math.round(linkMs), bytes: bytes });
+    });
+  });
+}
+
+// Aplite geometry and inbox, see item_store.h and main.c
+const APLITE = { inbox: 2048, pageSize: 32, windowPages: 3, poolBudget: 3072, heapBudget: 8192 };
+
+function align4(size) {
+  return (size + 3) & ~3;
+}
+
+function runLabels(encoding, n) {
+  return new Promise(function (resolve) {
+    linkMs = 0;
+    bytes = 0;
+    transfer.setProtocol('batch');
+    transfer.setLabelEncoding(encoding);
+    transfer.setWatchInfo(APLITE.inbox, 0, APLITE);
+    let prepared = transfer.prepareList(generateItems(n));
+    let setup = {};
+    setup[messageKeys.ITEMS_COUNT] = n;
+    setup[messageKeys.ITEMS_PAGE_BYTES] = prepared.pageBytes;
+    if (prepared.dict) setup[messageKeys.LABEL_DICT] = prepared.dict;
+    transfer.sendMessage(setup, 'list setup');
+    transfer.sendItems(function () {
+      let pages = Math.ceil(n / APLITE.pageSize);
+      let slots = Math.min(pages, APLITE.windowPages);
+      let dictBytes = prepared.dict ? prepared.dict.length : 0;
+      let heap = align4(pages) + align4(slots * 4) + slots * APLITE.pageSize * 6 +
+        slots * (prepared.pageBytes + APLITE.pageSize) + align4(dictBytes);
+      resolve({ encoding: encoding, n: n, bytes: bytes, pageBytes: prepared.pageBytes, dictBytes: dictBytes,
+                perItem: (heap / Math.min(n, slots * APLITE.pageSize)).toFixed(1) });
+    });
+  });
+}
+
+(async function () {
+  process.stdout.write(`inbox=${options.inbox} latency=${options.latency}ms ` +
+                       `throughput=${options.throughput}B/s\n`);
+  process.stdout.write('protocol     items  round trips      bytes   time (ms)\n');
+  for (let n of counts) {
+    for (let protocol of ['single', 'batch']) {
+      let r = await run(protocol, n);
+      process.stdout.write(`${r.protocol.padEnd(8)} ${String(r.n).padStart(9)} ` +
+                           `${String(r.roundTrips).padStart(12)} ${String(r.bytes).padStart(10)} ` +
+                           `${String(r.ms).padStart(11)}\n`);
+    }
+  }
+
+  process.stdout.write('\nlabels on aplite  items      bytes  page bytes  dict bytes  heap/item\n');
+  for (let n of counts) {
+    for (let encoding of ['raw', 'compact']) {
+      let r = await runLabels(encoding, n);
+      process.stdout.write(`${r.encoding.padEnd(12)} ${String(r.n).padStart(10)} ` +
+                           `${String(r.bytes).padStart(10)} ${String(r.pageBytes).padStart(11)} ` +
+                           `${String(r.dictBytes).padStart(11)} ${String(r.perItem).padStart(10)}\n`);
+    }
+  }
+})();
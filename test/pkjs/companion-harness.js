@@ -0,0 +1,558 @@
+// Runs src/pkjs/index.js in Node with stubbed Pebble, XMLHttpRequest and
+// localStorage objects, talking to a mock WebDAV server (mock-webdav.js) and a
+// simple model of the watch app.
+//
+// Time is simulated: setTimeout and Date.now are replaced by a virtual clock
+// while a session runs, so the companion's timers (upload delays, retries) and
+// the modelled latencies cost nothing in real time and results are exactly
+// repeatable (Math.random is seeded as well). The Bluetooth link carries one
+// AppMessage at a time; each takes
+// `linkLatency` ms plus its size divided by `throughput` bytes per second, and
+// a seeded fraction `nackRate` of them is rejected by the watch.
+//
+// session.stop() ends a session early, like the watch app being closed: the
+// watch keeps what it received of an unfinished list for the next session.
+//
+//   let session = harness.createSession({ server, url, storage, watch });
+//   session.start();            // 'ready', the watch says hello
+//   session.run();              // until nothing is left to do
+//   session.watch.toggle(3);    // the user checks an item on the watch
+//   session.reload();           // main() again, as after the settings closed
+//   session.run();
+//   session.finish();           // restores the globals
+
+const path = require('path');
+const Module = require('module');
+
+const pkg = require('../../package.json');
+const messageKeys = {};
+const keyNames = {};
+pkg.pebble.messageKeys.forEach(function (name, i) {
+  messageKeys[name] = 10000 + i;
+  keyNames[10000 + i] = name;
+});
+
+const originalLoad = Module._load;
+Module._load = function (request, parent, isMain) {
+  if (request === 'message_keys') return messageKeys;
+  if (request === 'pebble-clay') {
+    return function () {
+      this.generateUrl = function () { return ''; };
+      this.getSettings = function () { return {}; };
+    };
+  }
+  return originalLoad.apply(this, arguments);
+};
+
+const PKJS_DIR = path.join(__dirname, '../../src/pkjs');
+
+// Watch geometry of the basalt and later platforms (see src/c/item_store.h).
+// The inbox size and heap budget can be changed per session.
+const WATCH_INBOX_SIZE = 8192;
+const WATCH_PAGE_SIZE = 32;
+const WATCH_WINDOW_PAGES = 6;
+const WATCH_POOL_BUDGET = 12288;
+const WATCH_HEAP_BUDGET = 32768;
+// Serialized lists larger than this are not cached (LIST_CACHE_MAX_SIZE)
+const WATCH_CACHE_BYTES = 12 * 256;
+
+const DIFF_REMOVE = 1;
+const DIFF_INSERT = 2;
+const DIFF_UPDATE = 3;
+
+// Dictionary size on the wire, as in bench-transfer.js
+function messageSize(payload) {
+  let size = 1;
+  Object.keys(payload).forEach(function (key) {
+    let value = payload[key];
+    size += 7;
+    if (typeof value === 'number') size += 4;
+    else if (typeof value === 'string') size += Buffer.byteLength(value) + 1;
+    else size += value.length;
+  });
+  return size;
+}
+
+function random(seed) {
+  let state = seed >>> 0 || 1;
+  return function () {
+    state = (Math.imul(state, 1664525) + 1013904223) >>> 0;
+    return (state >>> 8) / 0x1000000;
+  };
+}
+
+// Virtual timers. run() executes them in time order until none are left.
+function createClock() {
+  let now = 0;
+  let timers = [];
+  let nextId = 1;
+  let saved = null;
+
+  function setTimeout_(callback, delay) {
+    let args = Array.prototype.slice.call(arguments, 2);
+    let timer = { id: nextId++, due: now + Math.max(0, delay || 0), callback: callback, args: args };
+    timers.push(timer);
+    return timer.id;
+  }
+
+  function clearTimeout_(id) {
+    timers = timers.filter(function (timer) { return timer.id !== id; });
+  }
+
+  return {
+    now: function () { return now; },
+    install: function () {
+      saved = { setTimeout: global.setTimeout, clearTimeout: global.clearTimeout, now: Date.now };
+      global.setTimeout = setTimeout_;
+      global.clearTimeout = clearTimeout_;
+      Date.now = function () { return 1700000000000 + now; };
+    },
+    uninstall: function () {
+      global.setTimeout = saved.setTimeout;
+      global.clearTimeout = saved.clearTimeout;
+      Date.now = saved.now;
+    },
+    setTimeout: setTimeout_,
+    // Returns false if `limit` ms of simulated time passed first
+    run: function (limit) {
+      let end = now + (limit || 600000);
+      while (timers.length > 0) {
+        let next = timers.reduce(function (a, b) {
+          return b.due < a.due || (b.due === a.due && b.id < a.id) ? b : a;
+        });
+        if (next.due > end) {
+          now = end;
+          return false;
+        }
+        timers = timers.filter(function (timer) { return timer !== next; });
+        now = next.due;
+        next.callback.apply(null, next.args);
+      }
+      return true;
+    },
+  };
+}
+
+// Fletcher-16 of an ITEMS_BATCH blob, as prv_batch_checksum()
+function checksum(bytes) {
+  let sum1 = 0;
+  let sum2 = 0;
+  for (let i = 0; i < bytes.length; i++) {
+    sum1 = (sum1 + bytes[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return (sum2 << 8) | sum1;
+}
+
+// What the watch app keeps of the list, enough to follow full transfers and
+// diffs and to toggle items by id like src/c/main.c does. `saved` is the list
+// the watch cached in persistent storage: { hash, count, sections, items },
+// with `partial` set if only the start of it had arrived.
+function createWatch(saved, inboxSize, heapBudget) {
+  let watch = {
+    saved: saved || { hash: 0 },
+    inboxSize: inboxSize || WATCH_INBOX_SIZE,
+    heapBudget: heapBudget || WATCH_HEAP_BUDGET,
+    count: 0,
+    sections: [],
+    items: [],
+    hash: 0,
+    dictBytes: 0,
+    generation: 0,
+    dropped: 0,
+    loaded: 0,
+    complete: false,
+    telemetryPending: false,
+    send: null,
+  };
+  // The cached list is shown at start, with ids reset to the indexes
+  if (watch.saved.hash) {
+    watch.count = watch.saved.count;
+    watch.sections = watch.saved.sections.slice();
+    watch.items = watch.saved.items.map(function (item, index) {
+      return { id: index, flags: item.flags, length: item.length };
+    });
+    watch.hash = watch.saved.hash;
+    watch.dictBytes = watch.saved.dictBytes || 0;
+    watch.loaded = watch.items.length;
+    watch.complete = !watch.saved.partial;
+  }
+
+  function loadedCount() {
+    return watch.items.filter(function (item) { return item; }).length;
+  }
+
+  // Items from the start that arrived without a gap
+  function receivedCount() {
+    let count = 0;
+    while (count < watch.items.length && watch.items[count]) count++;
+    return count;
+  }
+
+  function cacheBytes(items) {
+    return items.reduce(function (sum, item) { return sum + item.length + 4; }, 65 + watch.dictBytes);
+  }
+
+  function listComplete() {
+    let window = WATCH_PAGE_SIZE * WATCH_WINDOW_PAGES;
+    watch.loaded = loadedCount();
+    watch.complete = watch.loaded >= Math.min(watch.count, window);
+    if (!watch.complete) return;
+    watch.telemetryPending = true;
+    if (watch.hash && watch.count <= window && cacheBytes(watch.items) <= WATCH_CACHE_BYTES) {
+      watch.saved = { hash: watch.hash, count: watch.count, sections: watch.sections.slice(),
+                      items: watch.items.slice(), dictBytes: watch.dictBytes };
+    } else {
+      watch.saved = { hash: 0 };
+    }
+  }
+
+  function readRecord(blob, pos) {
+    let length = blob[pos + 1];
+    return { flags: blob[pos], length: length, end: pos + 2 + length };
+  }
+
+  function applyDiff(blob) {
+    let u16 = function (pos) { return blob[pos] | (blob[pos + 1] << 8); };
+    let after = u16(2);
+    let numSections = blob[4];
+    let pos = 5;
+    for (let i = 0; i < numSections; i++, pos += 2) watch.sections[i] = u16(pos);
+    let items = watch.items.slice();
+    while (pos < blob.length) {
+      let type = blob[pos];
+      let index = u16(pos + 1);
+      pos += 3;
+      if (type === DIFF_REMOVE) {
+        items.splice(index, u16(pos));
+        pos += 2;
+      } else if (type === DIFF_INSERT) {
+        let id = u16(pos);
+        let record = readRecord(blob, pos + 2);
+        items.splice(index, 0, { id: id, flags: record.flags, length: record.length });
+        pos = record.end;
+      } else if (type === DIFF_UPDATE) {
+        let record = readRecord(blob, pos);
+        items[index] = { id: items[index].id, flags: record.flags, length: record.length };
+        pos = record.end;
+      } else {
+        throw new Error('Unknown diff operation ' + type);
+      }
+    }
+    if (items.length !== after) throw new Error('Diff leaves ' + items.length + ' items, expected ' + after);
+    watch.items = items;
+    watch.count = after;
+  }
+
+  // Like prv_accept_generation(): messages that start or resume a list set
+  // the generation, other list messages of another generation are dropped
+  function acceptGeneration(named) {
+    if (!('TRANSFER_GEN' in named)) return true;
+    if (('ITEMS_COUNT' in named && !named.LIST_APPEND) || 'ITEMS_DIFF' in named
+        || (watch.hash && named.RESUME_HASH === watch.hash)) {
+      watch.generation = named.TRANSFER_GEN;
+      return true;
+    }
+    return named.TRANSFER_GEN === watch.generation;
+  }
+
+  // A message from the phone was delivered
+  watch.receive = function (named) {
+    if (!acceptGeneration(named)) {
+      watch.dropped++;
+      return;
+    }
+    if ('ITEMS_COUNT' in named) {
+      if (!named.LIST_APPEND) {
+        watch.items = [];
+        watch.dictBytes = named.LABEL_DICT ? named.LABEL_DICT.length : 0;
+      }
+      watch.count = named.ITEMS_COUNT;
+      watch.items.length = Math.min(watch.items.length, watch.count);
+      watch.sections.length = named.SECTION_COUNT || 0;
+      watch.hash = named.LIST_HASH || 0;
+      watch.complete = false;
+    }
+    if ('SECTION_HEADERS' in named) {
+      // See prv_set_sections() on the watch
+      let blob = named.SECTION_HEADERS;
+      for (let pos = 1, index = blob[0]; pos + 3 <= blob.length; index++) {
+        watch.sections[index] = blob[pos] | (blob[pos + 1] << 8);
+        pos += 3 + blob[pos + 2];
+      }
+    }
+    if ('ITEMS_BATCH' in named && 'BATCH_CHECK' in named) {
+      let check = named.BATCH_CHECK >>> 0;
+      let generation = check >>> 16;
+      if (generation !== 0 && generation !== watch.generation) {
+        watch.dropped++;
+        return;
+      }
+      if ((check & 0xffff) !== checksum(named.ITEMS_BATCH)) throw new Error('Batch checksum mismatch');
+    }
+    if ('ITEMS_BATCH' in named) {
+      let blob = named.ITEMS_BATCH;
+      let index = blob[0] | (blob[1] << 8);
+      for (let pos = 2; pos < blob.length; index++) {
+        let record = readRecord(blob, pos);
+        watch.items[index] = { id: index, flags: record.flags, length: record.length };
+        pos = record.end;
+      }
+    }
+    if ('ITEMS_DIFF' in named) {
+      applyDiff(named.ITEMS_DIFF);
+      watch.hash = named.LIST_HASH || 0;
+    }
+    if ('ITEMS_COUNT' in named || 'ITEMS_BATCH' in named || 'ITEMS_DIFF' in named) listComplete();
+  };
+
+  watch.hello = function () {
+    let hello = {
+      WATCH_INBOX_SIZE: watch.inboxSize,
+      CACHED_LIST_HASH: watch.complete ? watch.hash : 0,
+      WATCH_PAGE_SIZE: WATCH_PAGE_SIZE,
+      WATCH_WINDOW_PAGES: WATCH_WINDOW_PAGES,
+      WATCH_POOL_BUDGET: WATCH_POOL_BUDGET,
+      WATCH_HEAP_BUDGET: watch.heapBudget,
+    };
+    let received = receivedCount();
+    if (!watch.complete && watch.hash && received > 0) {
+      hello.RESUME_HASH = watch.hash;
+      hello.RESUME_INDEX = received;
+    }
+    watch.send(hello);
+  };
+
+  // The app is closed, an unfinished list is kept as far as it arrived
+  watch.close = function () {
+    if (watch.complete || !watch.hash) return;
+    let items = watch.items.slice(0, receivedCount());
+    if (items.length > 0 && cacheBytes(items) <= WATCH_CACHE_BYTES) {
+      watch.saved = { hash: watch.hash, count: watch.count, sections: watch.sections.slice(),
+                      items: items, dictBytes: watch.dictBytes, partial: true };
+    }
+  };
+
+  // The user pressed select on item `index`
+  watch.toggle = function (index) {
+    let item = watch.items[index];
+    if (!item) throw new Error('Item ' + index + ' is not on the watch');
+    item.flags ^= 1;
+    // One entry of the toggle journal, see toggle_journal.h
+    let payload = { ITEM_TOGGLES: [item.id & 0xff, item.id >> 8, item.flags & 1],
+                    TOGGLES_LIST_HASH: watch.hash };
+    if (watch.telemetryPending) {
+      // Same layout as telemetry_serialize(), the model does not time anything
+      let blob = [2, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, watch.count & 0xff, watch.count >> 8];
+      while (blob.length < 27) blob.push(0);
+      blob.push(0xff, 0xff, 0xff, 0xff);
+      payload.TELEMETRY = blob;
+      watch.telemetryPending = false;
+    }
+    watch.send(payload);
+  };
+
+  return watch;
+}
+
+// options:
+//   server       mock-webdav server
+//   url          the configured WebDAV URL (a folder if it ends in '/')
+//   storage      localStorage contents, kept across sessions by passing the
+//                previous session's `storage`
+//   watch        saved watch state from a previous session ({ hash })
+//   linkLatency, throughput, nackRate, seed, helloDelay, inboxSize,
+//   heapBudget, verbose
+function createSession(options) {
+  let server = options.server;
+  let clock = createClock();
+  let rand = random(options.seed || 7);
+  let linkLatency = options.linkLatency !== undefined ? options.linkLatency : 80;
+  let throughput = options.throughput || 4000;
+  let nackRate = options.nackRate || 0;
+  let store = Object.assign({
+    CONFIG_WEB_DAV_URL: options.url,
+    CONFIG_USER: 'user',
+    CONFIG_APP_PASSWORD: 'secret',
+  }, options.storage || {});
+  let listeners = {};
+  let linkFreeAt = 0;
+  let savedGlobals = null;
+  let realLog = console.log;
+
+  let stats = {
+    messages: 0,
+    messageBytes: 0,
+    nacks: 0,
+    messagesByKind: {},
+    watchMessages: 0,
+    http: 0,
+    httpByMethod: {},
+    httpBytes: 0,
+    httpErrors: 0,
+    firstItemMs: null,
+    listMs: null,
+  };
+  let watch = createWatch(options.watch, options.inboxSize, options.heapBudget);
+
+  function kindOf(named) {
+    let kinds = ['ITEMS_DIFF', 'ITEMS_BATCH', 'ITEMS_ITEM', 'ITEMS_COUNT', 'SECTION_HEADERS', 'SET_STATUS'];
+    for (let i = 0; i < kinds.length; i++) {
+      if (kinds[i] in named) return kinds[i];
+    }
+    return Object.keys(named)[0] || 'empty';
+  }
+
+  function sendAppMessage(payload, ack, nack) {
+    let named = {};
+    Object.keys(payload).forEach(function (key) { named[keyNames[key] || key] = payload[key]; });
+    let size = messageSize(payload);
+    if (size > watch.inboxSize) throw new Error('Message of ' + size + ' bytes exceeds the watch inbox');
+    let kind = kindOf(named);
+    stats.messages++;
+    stats.messageBytes += size;
+    stats.messagesByKind[kind] = (stats.messagesByKind[kind] || 0) + 1;
+
+    // Messages queue up on the link one after the other
+    let start = Math.max(clock.now(), linkFreeAt);
+    let done = start + linkLatency + Math.ceil(size * 1000 / throughput);
+    linkFreeAt = done;
+    let rejected = nackRate > 0 && rand() < nackRate;
+    clock.setTimeout(function () {
+      if (rejected) {
+        stats.nacks++;
+        if (nack) nack({ error: 'NACK' });
+        return;
+      }
+      watch.receive(named);
+      // Items of a new list, the first of them are the first screen
+      if (kind === 'ITEMS_COUNT' && !named.LIST_APPEND) stats.firstItemMs = null;
+      if (kind === 'ITEMS_BATCH' || kind === 'ITEMS_DIFF' || kind === 'ITEMS_ITEM') {
+        if (stats.firstItemMs === null) stats.firstItemMs = clock.now();
+      }
+      if (kind === 'ITEMS_BATCH' || kind === 'ITEMS_DIFF' || kind === 'ITEMS_COUNT') {
+        if (watch.complete) stats.listMs = clock.now();
+      }
+      if (ack) ack({});
+    }, done - clock.now());
+  }
+
+  function XMLHttpRequestStub() {
+    let xhr = this;
+    let method = null;
+    let url = null;
+    let headers = {};
+    let responseHeaders = {};
+    xhr.status = 0;
+    xhr.responseText = '';
+    xhr.open = function (m, u) { method = m; url = u; };
+    xhr.setRequestHeader = function (name, value) { headers[name] = value; };
+    xhr.getResponseHeader = function (name) {
+      let value = responseHeaders[name.toLowerCase()];
+      return value === undefined ? null : value;
+    };
+    xhr.send = function (body) {
+      stats.http++;
+      stats.httpByMethod[method] = (stats.httpByMethod[method] || 0) + 1;
+      let response = server.handle(method, url, headers, body);
+      stats.httpBytes += (body ? Buffer.byteLength(body) : 0) + Buffer.byteLength(response.body || '');
+      clock.setTimeout(function () {
+        if (response.error) {
+          stats.httpErrors++;
+          if (xhr.onerror) xhr.onerror();
+          return;
+        }
+        if (response.status >= 500) stats.httpErrors++;
+        xhr.status = response.status;
+        responseHeaders = response.headers || {};
+        xhr.responseText = response.body || '';
+        if (xhr.onprogress) xhr.onprogress.call(xhr);
+        if (xhr.onload) xhr.onload.call(xhr);
+      }, response.delay);
+    };
+  }
+
+  function installGlobals() {
+    savedGlobals = {
+      Pebble: global.Pebble,
+      XMLHttpRequest: global.XMLHttpRequest,
+      localStorage: global.localStorage,
+      random: Math.random,
+    };
+    Math.random = random((options.seed || 7) + 1);
+    global.localStorage = {
+      getItem: function (key) { return key in store ? store[key] : null; },
+      setItem: function (key, value) { store[key] = String(value); },
+      removeItem: function (key) { delete store[key]; },
+    };
+    global.Pebble = {
+      addEventListener: function (event, callback) {
+        (listeners[event] = listeners[event] || []).push(callback);
+      },
+      openURL: function () {},
+      sendAppMessage: sendAppMessage,
+    };
+    global.XMLHttpRequest = XMLHttpRequestStub;
+    clock.install();
+    if (!options.verbose) console.log = function () {};
+  }
+
+  function emit(event, data) {
+    (listeners[event] || []).forEach(function (callback) { callback(data || {}); });
+  }
+
+  // Messages from the watch take the same link
+  watch.send = function (named) {
+    let payload = {};
+    Object.keys(named).forEach(function (name) { payload[messageKeys[name]] = named[name]; });
+    stats.watchMessages++;
+    let start = Math.max(clock.now(), linkFreeAt);
+    linkFreeAt = start + linkLatency;
+    clock.setTimeout(function () { emit('appmessage', { payload: payload }); }, linkFreeAt - clock.now());
+  };
+
+  installGlobals();
+  // A fresh companion, like a new PebbleKit JS start
+  Object.keys(require.cache).forEach(function (file) {
+    if (file.startsWith(PKJS_DIR)) delete require.cache[file];
+  });
+  require(path.join(PKJS_DIR, 'index.js'));
+
+  return {
+    watch: watch,
+    stats: stats,
+    storage: store,
+    clock: clock,
+    setNackRate: function (rate) { nackRate = rate; },
+    start: function () {
+      emit('ready');
+      clock.setTimeout(watch.hello, options.helloDelay !== undefined ? options.helloDelay : 100);
+    },
+    reload: function () {
+      emit('ready');
+    },
+    run: function (limit) {
+      if (!clock.run(limit)) throw new Error('Session still busy after ' + (limit || 600000) + ' ms');
+      return clock.now();
+    },
+    // Stop in the middle of whatever is going on, see the top
+    stop: function () {
+      watch.close();
+      return this.finish();
+    },
+    finish: function () {
+      clock.uninstall();
+      Math.random = savedGlobals.random;
+      global.Pebble = savedGlobals.Pebble;
+      global.XMLHttpRequest = savedGlobals.XMLHttpRequest;
+      global.localStorage = savedGlobals.localStorage;
+      console.log = realLog;
+      return watch.saved;
+    },
+  };
+}
+
+module.exports = {
+  createSession: createSession,
+  messageKeys: messageKeys,
+};
@@ -0,0 +1,206 @@
+// In-process stand-in for a WebDAV server (Nextcloud style) used by the
+// pipeline benchmark. It answers GET, PUT and PROPFIND (Depth: 1) requests
+// from an in-memory tree and behaves like the real thing where the companion
+// relies on it:
+//  - files carry a strong ETag, GET honours If-None-Match (304), PUT honours
+//    If-Match (412);
+//  - a collection's ETag changes whenever anything below it changes;
+//  - responses take `latency` ms (plus `perKb` ms per KB of body) and a
+//    seeded fraction `errorRate` of them fail with 503.
+//
+//   let server = mockWebdav.create({ origin: 'https://dav.test', latency: 60 });
+//   server.putFile('/dav/notes/todo.md', text);
+//   let response = server.handle(method, url, headers, body);
+//   // -> { status, headers, body, delay }
+
+const DEFAULT_OPTIONS = { origin: 'https://dav.test', latency: 60, perKb: 2, errorRate: 0, seed: 1 };
+
+function withSlash(path) {
+  return path.endsWith('/') ? path : path + '/';
+}
+
+function parentOf(path) {
+  let trimmed = path.endsWith('/') ? path.slice(0, -1) : path;
+  return trimmed.slice(0, trimmed.lastIndexOf('/') + 1);
+}
+
+function encodePath(path) {
+  return path.split('/').map(encodeURIComponent).join('/');
+}
+
+function escapeXml(text) {
+  return text.replace(/&/g, '&amp;').replace(/</g, '&lt;').replace(/>/g, '&gt;');
+}
+
+// Small deterministic PRNG so error injection is repeatable
+function random(seed) {
+  let state = seed >>> 0 || 1;
+  return function () {
+    state = (Math.imul(state, 1664525) + 1013904223) >>> 0;
+    return (state >>> 8) / 0x1000000;
+  };
+}
+
+function create(options) {
+  options = Object.assign({}, DEFAULT_OPTIONS, options || {});
+  // path (decoded, collections end in '/') -> { collection, body, etag, lastModified }
+  let nodes = {};
+  let version = 0;
+  let clock = 1700000000000;
+  let rand = random(options.seed);
+  let failures = [];
+  let stats = { requests: {}, statuses: {}, bytesIn: 0, bytesOut: 0, injectedErrors: 0 };
+
+  function touch(path) {
+    version++;
+    clock += 1000;
+    let node = nodes[path];
+    node.etag = '"' + version.toString(16) + '"';
+    node.lastModified = clock;
+    let parent = parentOf(path);
+    if (parent && parent !== path && nodes[parent]) touch(parent);
+  }
+
+  function mkcol(path) {
+    path = withSlash(path);
+    if (nodes[path]) return;
+    let parent = parentOf(path);
+    if (parent && parent !== path) mkcol(parent);
+    nodes[path] = { collection: true };
+    touch(path);
+  }
+
+  function putFile(path, body) {
+    mkcol(parentOf(path));
+    nodes[path] = nodes[path] || { collection: false };
+    nodes[path].body = body;
+    touch(path);
+  }
+
+  function getFile(path) {
+    let node = nodes[path];
+    return node && !node.collection ? node.body : null;
+  }
+
+  // Change a file as another client would.
+  function editFile(path, edit) {
+    putFile(path, edit(getFile(path) || ''));
+  }
+
+  // The next request with `method` fails with `status` (0: network error).
+  function failNext(method, status) {
+    failures.push({ method: method, status: status });
+  }
+
+  function respond(status, headers, body) {
+    body = body || '';
+    let delay = options.latency + Math.round(options.perKb * Buffer.byteLength(body) / 1024);
+    stats.statuses[status] = (stats.statuses[status] || 0) + 1;
+    stats.bytesOut += Buffer.byteLength(body);
+    return { status: status, headers: headers || {}, body: body, delay: delay };
+  }
+
+  function propfind(path) {
+    let node = nodes[path];
+    if (!node || !node.collection) return respond(404);
+    let paths = Object.keys(nodes).filter(function (p) {
+      return p === path || (p !== path && parentOf(p) === path);
+    });
+    let body = '<?xml version="1.0"?>\n<d:multistatus xmlns:d="DAV:" xmlns:oc="http://owncloud.org/ns">' +
+      paths.map(function (p) {
+        let n = nodes[p];
+        return '<d:response><d:href>' + escapeXml(encodePath(p)) + '</d:href><d:propstat><d:prop>' +
+          '<d:resourcetype>' + (n.collection ? '<d:collection/>' : '') + '</d:resourcetype>' +
+          '<d:getetag>' + escapeXml(n.etag) + '</d:getetag>' +
+          '<d:getlastmodified>' + new Date(n.lastModified).toUTCString() + '</d:getlastmodified>' +
+          '</d:prop><d:status>HTTP/1.1 200 OK</d:status></d:propstat></d:response>\n';
+      }).join('') + '</d:multistatus>';
+    return respond(207, { 'content-type': 'application/xml; charset=utf-8' }, body);
+  }
+
+  function handle(method, url, headers, body) {
+    stats.requests[method] = (stats.requests[method] || 0) + 1;
+    stats.bytesIn += body ? Buffer.byteLength(body) : 0;
+    headers = headers || {};
+
+    let failure = failures.findIndex(function (f) { return f.method === method; });
+    if (failure >= 0) {
+      let status = failures.splice(failure, 1)[0].status;
+      stats.injectedErrors++;
+      if (status === 0) return { error: true, delay: options.latency };
+      return respond(status);
+    }
+    if (options.errorRate > 0 && rand() < options.errorRate) {
+      stats.injectedErrors++;
+      return respond(503, {}, 'Service Unavailable');
+    }
+
+    if (!url.startsWith(options.origin)) return respond(404);
+    let path = decodeURIComponent(url.slice(options.origin.length));
+    let node = nodes[path];
+
+    if (method === 'PROPFIND') return propfind(withSlash(path));
+    if (method === 'GET') {
+      if (!node || node.collection) return respond(404);
+      if (headers['If-None-Match'] === node.etag) return respond(304, { etag: node.etag });
+      return respond(200, { etag: node.etag, 'last-modified': new Date(node.lastModified).toUTCString() },
+                     node.body);
+    }
+    if (method === 'PUT') {
+      let ifMatch = headers['If-Match'];
+      if (ifMatch && (!node || node.etag !== ifMatch)) return respond(412);
+      if (!nodes[parentOf(path)]) return respond(409);
+      let created = !node;
+      putFile(path, body || '');
+      return respond(created ? 201 : 204, { etag: nodes[path].etag });
+    }
+    return respond(405);
+  }
+
+  return {
+    origin: options.origin,
+    options: options,
+    stats: stats,
+    mkcol: mkcol,
+    putFile: putFile,
+    getFile: getFile,
+    editFile: editFile,
+    failNext: failNext,
+    handle: handle,
+    paths: function () { return Object.keys(nodes); },
+  };
+}
+
+// Markdown with `count` unchecked items, every `checkedEvery`th item checked
+// already, and a heading and some prose in between like a real note.
+function generateDocument(title, count, checkedEvery) {
+  let words = ['Buy', 'Call', 'Fix', 'Review', 'Write', 'Plan', 'Email', 'Book'];
+  let lines = ['# ' + title, '', 'Some notes about ' + title + '.', ''];
+  for (let i = 0; i < count; i++) {
+    if (i > 0 && i % 20 === 0) lines.push('', '## Part ' + i / 20, '');
+    let checked = checkedEvery > 0 && i % checkedEvery === checkedEvery - 1;
+    lines.push('- [' + (checked ? 'x' : ' ') + '] ' + words[i % words.length] + ' ' + title +
+               ' task ' + i + ' #project');
+  }
+  return lines.join('\n') + '\n';
+}
+
+// Fill `root` with `dirs` folders of `filesPerDir` markdown files each (plus
+// a file that is not markdown), every file with `itemsPerFile` items.
+function generateTree(server, root, dirs, filesPerDir, itemsPerFile) {
+  server.mkcol(root);
+  for (let d = 0; d < dirs; d++) {
+    let dir = root + 'Project ' + d + '/';
+    server.mkcol(dir);
+    server.putFile(dir + 'cover.png', 'not markdown');
+    for (let f = 0; f < filesPerDir; f++) {
+      server.putFile(dir + 'Notes ' + f + '.md', generateDocument('p' + d + 'n' + f, itemsPerFile, 4));
+    }
+  }
+}
+
+module.exports = {
+  create: create,
+  generateDocument: generateDocument,
+  generateTree: generateTree,
+};